@@ -0,0 +1,29 @@
+--
+-- COPY throughput of the prefix_range text input and output functions,
+-- on 10 million rows written to a server side file:
+--
+--   psql -v file=/tmp/prefix_copy.data -f bench/copy.sql dim
+--
+\timing off
+set client_min_messages to warning;
+
+drop table if exists copy_text, copy_prefix;
+create unlogged table copy_text(prefix text);
+create unlogged table copy_prefix(prefix prefix_range);
+
+insert into copy_text
+     select '01' || lpad((n * 7919 % 100000000)::text, 8, '0')
+            || case when n % 10 = 0 then '[2-5]' else '' end
+       from generate_series(1, 10000000) as t(n);
+
+copy copy_text to :'file';
+vacuum analyze copy_text;
+
+\timing on
+-- input
+copy copy_prefix from :'file';
+-- output
+copy copy_prefix to '/dev/null';
+\timing off
+
+drop table copy_text, copy_prefix;
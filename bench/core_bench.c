@@ -0,0 +1,91 @@
+/*
+ * Microbenchmark of the prefix_range core primitives, outside of the
+ * server: ns/op of each of them on telephone keys of 4 to 15 digits, a
+ * tenth of them with a [x-y] range.
+ *
+ *   make core-bench
+ */
+#include <time.h>
+
+#include "prefix_core.h"
+
+#define NKEYS   4096
+#define LOOPS   2000
+
+static prefix_range *keys[NKEYS];
+static volatile long sink;
+
+static uint64_t
+next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+/*
+ * Keys share prefixes the way numbering plans do: a few country codes,
+ * then operators, then numbers.
+ */
+static void
+make_keys(void) {
+  uint64_t state = 0x9E3779B97F4A7C15ULL;
+  char buf[16];
+  int i, j, len;
+
+  for(i=0; i<NKEYS; i++) {
+    len = 4 + next_random(&state) % 12;
+    buf[0] = '0' + next_random(&state) % 3;
+    for(j=1; j<len; j++)
+      buf[j] = '0' + next_random(&state) % (j < 4 ? 4 : 10);
+    buf[len] = 0;
+
+    if( i % 10 == 0 )
+      keys[i] = make_prefix_range(buf, '2', '5');
+    else
+      keys[i] = make_prefix_range(buf, 0, 0);
+  }
+}
+
+static double
+elapsed_ns(struct timespec *start) {
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+#define BENCH(name, expr)						\
+  do {									\
+    struct timespec start;						\
+    long acc = 0;							\
+    int l, k;								\
+									\
+    clock_gettime(CLOCK_MONOTONIC, &start);				\
+    for(l=0; l<LOOPS; l++)						\
+      for(k=0; k<NKEYS; k++) {						\
+	prefix_range *a = keys[k];					\
+	prefix_range *b = keys[(k * 7 + l) % NKEYS];			\
+	expr;								\
+      }									\
+    sink += acc;							\
+    printf("%-14s %8.2f ns/op\n", name,				\
+	   elapsed_ns(&start) / ((double) LOOPS * NKEYS));		\
+  } while(0)
+
+int
+main(void) {
+  make_keys();
+
+  BENCH("pr_mismatch",  acc += pr_mismatch(a->prefix, b->prefix,
+					   Min(strlen(a->prefix), strlen(b->prefix))));
+  BENCH("pr_eq",        acc += pr_eq(a, b));
+  BENCH("pr_cmp",       acc += pr_cmp(a, b));
+  BENCH("pr_contains",  acc += pr_contains(a, b, true));
+  BENCH("pr_overlaps",  acc += pr_overlaps(a, b));
+  BENCH("pr_union",     { prefix_range *r = pr_union(a, b); acc += r->first; pr_free(r); });
+  BENCH("pr_inter",     { prefix_range *r = pr_inter(a, b); acc += r->first; pr_free(r); });
+  BENCH("__pr_penalty", acc += (long) (__pr_penalty(a, b) * 1000));
+
+  return 0;
+}
@@ -0,0 +1,28 @@
+--
+-- Time the operations going through the byte kernels on telephone keys
+-- of 8 to 15 digits: parsing, GiST index build (union, penalty and
+-- picksplit) and lookups.
+--
+--   psql -f bench/keys.sql dim
+--
+\timing off
+set client_min_messages to warning;
+
+drop table if exists bench_keys;
+create unlogged table bench_keys(number text, prefix prefix_range);
+
+insert into bench_keys(number)
+     select lpad((n::bigint * 2654435761 % 1000000000000000)::text,
+                 8 + n % 8, '0')
+       from generate_series(1, 1000000) as t(n);
+
+\timing on
+-- parsing
+update bench_keys set prefix = number::prefix_range;
+-- union, penalty and picksplit
+create index bench_keys_prefix_idx on bench_keys using gist(prefix);
+-- containment
+select count(*) from bench_keys where prefix @> number;
+\timing off
+
+drop table bench_keys;
@@ -0,0 +1,3 @@
+\set n random(0, 99999999)
+select * from prefix_lookup('idx_prefix', '01' || lpad(:n::text, 8, '0'))
+         as t(prefix prefix_range, name text, shortname text, state char);
@@ -0,0 +1,5 @@
+\set n random(0, 99999999)
+select * from ranges
+ where prefix @> ('01' || lpad(:n::text, 8, '0'))
+ order by length(prefix) desc
+ limit 1;
@@ -0,0 +1,36 @@
+--
+-- Compare sequential scans evaluating @> on prefix_range values stored
+-- with a 1 byte varlena header (the main storage) and with a 4 bytes
+-- one (the plain storage). The functions use both in place, so that the
+-- timings are the same: a copy per row would show on the first table.
+--
+--   psql -f bench/packed.sql dim
+--
+\timing off
+set client_min_messages to warning;
+set max_parallel_workers_per_gather to 0;
+
+drop table if exists bench_packed, bench_plain;
+create unlogged table bench_packed(prefix prefix_range);
+create unlogged table bench_plain(prefix prefix_range);
+alter table bench_plain alter column prefix set storage plain;
+
+insert into bench_packed
+     select lpad((n::bigint * 2654435761 % 100000000)::text, 4 + n % 5, '0')
+       from generate_series(1, 2000000) as t(n);
+insert into bench_plain select prefix from bench_packed;
+vacuum analyze bench_packed, bench_plain;
+
+select relname, pg_size_pretty(pg_relation_size(oid)) as size
+  from pg_class
+ where relname in ('bench_packed', 'bench_plain')
+order by relname;
+
+\timing on
+select count(*) from bench_packed where prefix @> '0146640123';
+select count(*) from bench_plain where prefix @> '0146640123';
+select count(*) from bench_packed where prefix @> '0146640123';
+select count(*) from bench_plain where prefix @> '0146640123';
+\timing off
+
+drop table bench_packed, bench_plain;
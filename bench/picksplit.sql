@@ -0,0 +1,120 @@
+--
+-- Compare the GiST picksplit strategies on the same numbering plan,
+-- generated with bench/plan.sql (see there for size and numbers):
+--
+--   psql -v size=1000000 -f bench/picksplit.sql dim
+--
+-- First prefix_picksplit_stats() runs the strategies on samples of the
+-- plan the size of a page, then an index is built with the opclass of
+-- each strategy, for its build time, depth, page count and the average
+-- number of index pages a lookup visits, and the inner keys figures of
+-- prefix_index_stats().
+--
+\if :{?page_size}
+\else
+\set page_size 250
+\endif
+\if :{?samples}
+\else
+\set samples 100
+\endif
+\if :{?lookups}
+\else
+\set lookups 1000
+\endif
+
+\ir plan.sql
+
+create temp table bench_sample as
+     select row_number() over () - 1 as n, prefix
+       from (select prefix from bench_plan
+              order by random()
+              limit :samples * :page_size) as s;
+
+select s.strategy,
+       round(avg(s.balance)::numeric, 3) as balance,
+       round(avg(s.left_length + s.right_length) / 2.0, 2) as union_length,
+       round(avg(s.overlap::int), 2) as overlap,
+       round(avg(s.shared), 2) as shared,
+       sum(s.misplaced) as misplaced
+  from (select array_agg(prefix) as page
+          from bench_sample
+      group by n / :page_size) as p,
+       prefix_picksplit_stats(p.page) as s
+group by s.strategy
+order by s.strategy;
+
+-- index pages read by a bitmap index scan, per number looked up
+create function pg_temp.bench_pages(idx text, lookups integer)
+returns numeric
+language plpgsql
+as $$
+declare
+  num   text;
+  plan  jsonb;
+  total bigint := 0;
+begin
+  set local enable_seqscan to off;
+  set local enable_indexscan to off;
+
+  for num in select number from bench_numbers order by id limit lookups
+  loop
+    execute format('explain (analyze, buffers, format json)
+                    select * from bench_plan where prefix @> %L::text', num)
+       into plan;
+
+    total := total
+           + coalesce((select sum((p->>'Shared Hit Blocks')::bigint
+                                  + (p->>'Shared Read Blocks')::bigint)
+                         from jsonb_path_query(plan,
+                                               'strict $.** ? (@."Index Name" == $idx)',
+                                               jsonb_build_object('idx', idx)) as p),
+                      0);
+  end loop;
+
+  return round(total::numeric / lookups, 2);
+end;
+$$;
+
+create function pg_temp.bench_split(opclass text, lookups integer,
+                                    out build_ms numeric,
+                                    out depth integer,
+                                    out pages bigint,
+                                    out inner_length numeric,
+                                    out inner_empty numeric,
+                                    out inner_overlap numeric,
+                                    out pages_per_lookup numeric)
+language plpgsql
+as $$
+declare
+  start timestamptz := clock_timestamp();
+begin
+  execute format('create index bench_split_idx on bench_plan using gist (prefix %I)',
+                 opclass);
+  build_ms := round(extract(epoch from clock_timestamp() - start)::numeric * 1000, 1);
+
+  select max(s.level), sum(s.pages)
+    into depth, pages
+    from prefix_index_stats('bench_split_idx') as s;
+
+  -- inner levels only, the leaves have no overlap_ratio
+  select round((sum(s.avg_prefix_length * s.tuples) / sum(s.tuples))::numeric, 2),
+         round((sum(s.empty_ratio * s.tuples) / sum(s.tuples))::numeric, 3),
+         round((sum(s.overlap_ratio * s.tuples) / sum(s.tuples))::numeric, 3)
+    into inner_length, inner_empty, inner_overlap
+    from prefix_index_stats('bench_split_idx') as s
+   where s.overlap_ratio is not null;
+
+  pages_per_lookup := pg_temp.bench_pages('bench_split_idx', lookups);
+
+  drop index bench_split_idx;
+end;
+$$;
+
+select o.opclass, s.*
+  from unnest(array['gist_prefix_range_ops',
+                    'gist_prefix_range_presort_ops',
+                    'gist_prefix_range_jordan_ops']) as o(opclass),
+       pg_temp.bench_split(o.opclass, :lookups) as s;
+
+drop table bench_sample;
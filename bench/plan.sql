@@ -0,0 +1,64 @@
+--
+-- Generate a synthetic multi-country numbering plan of :size prefixes,
+-- in bench_plan, and :numbers telephone numbers to look up, in
+-- bench_numbers:
+--
+--   psql -v size=1000000 -f bench/plan.sql dim
+--
+-- Prefixes are a country code followed by 1 to 10 national digits,
+-- with an exponential depth distribution: most prefixes are short,
+-- a few are long, as in operator and range allocations. Countries are
+-- weighted by their share of the plan. The random generator is seeded,
+-- so that a given size always gives the same tables.
+--
+\if :{?size}
+\else
+\set size 100000
+\endif
+\if :{?numbers}
+\else
+\set numbers 100000
+\endif
+
+\timing off
+set client_min_messages to warning;
+set max_parallel_workers_per_gather to 0;
+
+drop table if exists bench_plan, bench_numbers;
+create table bench_plan(prefix prefix_range, name text);
+create table bench_numbers(id int primary key, number text);
+
+create temp table bench_countries(cc text, lo float8, hi float8);
+insert into bench_countries
+     values ('1',     0, 20), ('86',   20, 32), ('91',  32, 42),
+            ('49',   42, 52), ('44',   52, 60), ('33',  60, 68),
+            ('39',   68, 74), ('7',    74, 80), ('34',  80, 85),
+            ('81',   85, 90), ('55',   90, 95), ('61',  95, 98),
+            ('234',  98, 100);
+
+select setseed(0.5);
+
+insert into bench_plan(prefix, name)
+     select prefix::prefix_range, 'operator ' || abs(hashtext(prefix)) % 500
+       from (select c.cc || lpad(floor(random() * 10 ^ t.depth)::bigint::text,
+                                 t.depth, '0') as prefix
+               from (select random() * 100 as r,
+                            1 + least(9, floor(-ln(1 - random()) * 1.5))::int
+                              as depth
+                       from generate_series(1, (:size * 1.5)::int)) as t
+               join bench_countries c on t.r >= c.lo and t.r < c.hi
+           group by 1) as p
+      limit :size;
+
+insert into bench_numbers(id, number)
+     select t.n, c.cc || lpad(floor(random() * 10 ^ 10)::bigint::text, 10, '0')
+       from (select n, random() * 100 as r
+               from generate_series(1, :numbers) as n) as t
+       join bench_countries c on t.r >= c.lo and t.r < c.hi;
+
+vacuum analyze bench_plan, bench_numbers;
+
+select count(*) as prefixes,
+       round(avg(length(prefix)), 2) as avg_length,
+       max(length(prefix)) as max_length
+  from bench_plan;
@@ -0,0 +1,4 @@
+-- index build, rolled back, run with -M simple -D method=gist
+begin;
+create index bench_plan_build_idx on bench_plan using :method (prefix);
+rollback;
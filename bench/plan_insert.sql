@@ -0,0 +1,4 @@
+-- new prefixes, removed by bench/run.sh after the run
+\set n random(0, 99999999)
+insert into bench_plan(prefix, name)
+     values (('99' || :n::text)::prefix_range, 'bench insert');
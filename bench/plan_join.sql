@@ -0,0 +1,5 @@
+-- all the prefixes of a batch of 1000 numbers, see bench/run.sh
+\set lo random(1, :numbers - 999)
+select count(*)
+  from bench_numbers n join bench_plan p on p.prefix @> n.number
+ where n.id between :lo and :lo + 999;
@@ -0,0 +1,7 @@
+-- longest prefix match of a number of bench_numbers, see bench/run.sh
+\set id random(1, :numbers)
+select number from bench_numbers where id = :id \gset
+select * from bench_plan
+ where prefix @> :number::text
+ order by length(prefix) desc
+ limit 1;
@@ -0,0 +1,5 @@
+-- longest prefix match with prefix_lookup(), see bench/run.sh
+\set id random(1, :numbers)
+select number from bench_numbers where id = :id \gset
+select * from prefix_lookup('bench_plan_idx', :number::text)
+         as t(prefix prefix_range, name text);
@@ -0,0 +1,77 @@
+#!/bin/sh
+#
+# End to end benchmark of the extension on synthetic numbering plans, see
+# the "Benchmarking numbering plans" section of TESTS.md. Run with
+# `make bench`, against the database given by the libpq environment
+# variables (PGDATABASE, PGHOST, ...):
+#
+#   BENCH_SIZES    numbering plan sizes (100000 1000000 10000000)
+#   BENCH_TIME     duration of each pgbench run, in seconds (10)
+#   BENCH_NUMBERS  number of telephone numbers to look up (100000)
+#   PGBINDIR       where to find psql and pgbench (the PATH)
+#
+set -e
+
+BENCH_SIZES=${BENCH_SIZES:-"100000 1000000 10000000"}
+BENCH_TIME=${BENCH_TIME:-10}
+BENCH_NUMBERS=${BENCH_NUMBERS:-100000}
+
+dir=$(dirname "$0")
+bin=${PGBINDIR:+$PGBINDIR/}
+psql="${bin}psql -X -q -v ON_ERROR_STOP=1"
+pgbench="${bin}pgbench -n"
+
+# transactions per second, and average latency in ms, of a pgbench run
+tps() {
+    $pgbench "$@" | sed -n 's/^tps = \([0-9.]*\).*/\1/p' | tail -1
+}
+
+latency() {
+    $pgbench "$@" | sed -n 's/^latency average = \([0-9.]*\) ms.*/\1/p'
+}
+
+$psql -c 'create extension if not exists prefix'
+
+printf '%10s | %-7s | %12s | %10s | %10s | %10s | %10s\n' \
+       size method 'index (ms)' lookup direct join insert
+
+for size in $BENCH_SIZES
+do
+    $psql -v size="$size" -v numbers="$BENCH_NUMBERS" \
+          -f "$dir/plan.sql" > /dev/null
+
+    for method in seqscan gist btree hash
+    do
+        build=-
+        direct=-
+
+        if [ $method != seqscan ]
+        then
+            build=$(latency -M simple -t 1 -D method=$method \
+                            -f "$dir/plan_create_index.sql")
+            $psql -c "create index bench_plan_idx on bench_plan using $method (prefix)"
+        fi
+
+        lookup=$(tps -M prepared -T "$BENCH_TIME" -D numbers="$BENCH_NUMBERS" \
+                     -f "$dir/plan_lookup.sql")
+
+        if [ $method = gist ]
+        then
+            direct=$(tps -M prepared -T "$BENCH_TIME" -D numbers="$BENCH_NUMBERS" \
+                         -f "$dir/plan_lookup_direct.sql")
+        fi
+
+        join=$(tps -M prepared -T "$BENCH_TIME" -D numbers="$BENCH_NUMBERS" \
+                   -f "$dir/plan_join.sql")
+        insert=$(tps -M prepared -T "$BENCH_TIME" -f "$dir/plan_insert.sql")
+
+        $psql -c "delete from bench_plan where name = 'bench insert'" \
+              -c "drop index if exists bench_plan_idx" \
+              -c "vacuum analyze bench_plan"
+
+        printf '%10s | %-7s | %12s | %10s | %10s | %10s | %10s\n' \
+               "$size" $method "$build" "$lookup" "$direct" "$join" "$insert"
+    done
+done
+
+$psql -c 'drop table bench_plan, bench_numbers'
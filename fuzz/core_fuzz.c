@@ -0,0 +1,81 @@
+/*
+ * libFuzzer harness of the prefix_range core algebra:
+ *
+ *   - the union of a and b contains both a and b;
+ *   - when a and b overlap, their intersection is contained by both;
+ *   - pr_overlaps() is symmetric.
+ *
+ *   make core-fuzz
+ *   ./fuzz/core_fuzz -max_total_time=60
+ *
+ * The input is split in two values, each a flag byte telling whether
+ * it has a [x-y] range, the range bounds, then the prefix.
+ */
+#include <stddef.h>
+
+#include "prefix_core.h"
+
+static prefix_range *
+fuzz_value(const uint8_t *data, size_t size) {
+  char first = 0, last = 0;
+  prefix_range *pr;
+  size_t i, n = 0;
+
+  if( size >= 3 && (data[0] & 1) ) {
+    first = data[1] ? data[1] : '0';
+    last  = data[2] ? data[2] : '9';
+    data += 3;
+    size -= 3;
+  }
+  else if( size > 0 ) {
+    data++;
+    size--;
+  }
+
+  pr = pr_alloc(sizeof(prefix_range) + size + 1);
+  for(i=0; i<size; i++)
+    if( data[i] != 0 )
+      pr->prefix[n++] = data[i];
+  pr->prefix[n] = 0;
+  pr->first = first;
+  pr->last  = last;
+
+  return pr_normalize_inplace(pr);
+}
+
+static void
+check(bool condition, const char *what, prefix_range *a, prefix_range *b) {
+  if( !condition ) {
+    fprintf(stderr, "%s: a = '%s'[%d-%d], b = '%s'[%d-%d]\n", what,
+	    a->prefix, a->first, a->last, b->prefix, b->first, b->last);
+    abort();
+  }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  size_t half = size / 2;
+  prefix_range *a = fuzz_value(data, half);
+  prefix_range *b = fuzz_value(data + half, size - half);
+  prefix_range *u = pr_union(a, b);
+  bool overlaps = pr_overlaps(a, b);
+
+  check(pr_contains(u, a, true), "union does not contain a", a, b);
+  check(pr_contains(u, b, true), "union does not contain b", a, b);
+  check(overlaps == pr_overlaps(b, a), "overlaps is not symmetric", a, b);
+
+  if( overlaps ) {
+    prefix_range *i = pr_inter(a, b);
+
+    check(pr_contains(a, i, true), "a does not contain the intersection", a, b);
+    check(pr_contains(b, i, true), "b does not contain the intersection", a, b);
+    pr_free(i);
+  }
+
+  pr_free(u);
+  pr_free(a);
+  pr_free(b);
+  return 0;
+}
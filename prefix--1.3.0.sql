@@ -0,0 +1,1592 @@
+---
+--- prefix_range datatype installation
+---
+
+CREATE OR REPLACE FUNCTION prefix_range_in(cstring)
+RETURNS prefix_range
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_out(prefix_range)
+RETURNS cstring
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_recv(internal)
+RETURNS prefix_range
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_send(prefix_range)
+RETURNS bytea
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE TYPE prefix_range (
+	INPUT     = prefix_range_in,
+	OUTPUT    = prefix_range_out,
+	RECEIVE   = prefix_range_recv,
+	SEND      = prefix_range_send,
+	ALIGNMENT = int4,
+	STORAGE   = main
+);
+COMMENT ON TYPE prefix_range IS 'prefix range: (prefix)?([a-b])?';
+
+CREATE OR REPLACE FUNCTION prefix_range(text, text, text)
+RETURNS prefix_range
+AS '$libdir/prefix', 'prefix_range_init'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range(text)
+RETURNS prefix_range
+AS '$libdir/prefix', 'prefix_range_cast_from_text'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION text(prefix_range)
+RETURNS text
+AS '$libdir/prefix', 'prefix_range_cast_to_text'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE CAST (text as prefix_range) WITH FUNCTION prefix_range(text) AS IMPLICIT;
+CREATE CAST (prefix_range as text) WITH FUNCTION text(prefix_range);
+
+
+CREATE OR REPLACE FUNCTION prefix_range_eq(prefix_range, prefix_range)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_neq(prefix_range, prefix_range)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_lt(prefix_range, prefix_range)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_le(prefix_range, prefix_range)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_gt(prefix_range, prefix_range)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_ge(prefix_range, prefix_range)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_cmp(prefix_range, prefix_range)
+RETURNS integer
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_overlaps(prefix_range, prefix_range)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_contains(prefix_range, prefix_range)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_contains_strict(prefix_range, prefix_range)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_contained_by(prefix_range, prefix_range)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_contained_by_strict(prefix_range, prefix_range)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_union(prefix_range, prefix_range)
+RETURNS prefix_range
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_inter(prefix_range, prefix_range)
+RETURNS prefix_range
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION length(prefix_range)
+RETURNS int
+AS '$libdir/prefix', 'prefix_range_length'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OPERATOR = (
+	LEFTARG = prefix_range,
+	RIGHTARG = prefix_range,
+	PROCEDURE = prefix_range_eq,
+	COMMUTATOR = '=',
+	NEGATOR = '<>',
+	RESTRICT = eqsel,
+	JOIN = eqjoinsel
+);
+COMMENT ON OPERATOR =(prefix_range, prefix_range) IS 'equals?';
+
+CREATE OPERATOR <> (
+	LEFTARG = prefix_range,
+	RIGHTARG = prefix_range,
+	PROCEDURE = prefix_range_neq,
+	COMMUTATOR = '<>',
+	NEGATOR = '=',
+	RESTRICT = neqsel,
+	JOIN = neqjoinsel
+);
+COMMENT ON OPERATOR <>(prefix_range, prefix_range) IS 'not equals?';
+
+CREATE OPERATOR < (
+	LEFTARG = prefix_range,
+	RIGHTARG = prefix_range,
+	PROCEDURE = prefix_range_lt,
+	COMMUTATOR = > , 
+	NEGATOR = >= ,
+   	RESTRICT = scalarltsel, 
+	JOIN = scalarltjoinsel
+);
+COMMENT ON OPERATOR <(prefix_range, prefix_range) IS 'less-than';
+
+CREATE OPERATOR <= (
+	LEFTARG = prefix_range,
+	RIGHTARG = prefix_range,
+	PROCEDURE = prefix_range_le,
+	COMMUTATOR = >= , 
+	NEGATOR = > ,
+   	RESTRICT = scalarltsel, 
+	JOIN = scalarltjoinsel
+);
+COMMENT ON OPERATOR <=(prefix_range, prefix_range) IS 'less-than-or-equal';
+
+CREATE OPERATOR > (
+	LEFTARG = prefix_range,
+	RIGHTARG = prefix_range,
+	PROCEDURE = prefix_range_gt,
+	COMMUTATOR = < , 
+	NEGATOR = <= ,
+   	RESTRICT = scalargtsel, 
+	JOIN = scalargtjoinsel
+);
+COMMENT ON OPERATOR >(prefix_range, prefix_range) IS 'greater-than';
+
+CREATE OPERATOR >= (
+	LEFTARG = prefix_range,
+	RIGHTARG = prefix_range,
+	PROCEDURE = prefix_range_ge,
+	COMMUTATOR = <= , 
+	NEGATOR = < ,
+   	RESTRICT = scalargtsel, 
+	JOIN = scalargtjoinsel
+);
+COMMENT ON OPERATOR >=(prefix_range, prefix_range) IS 'greater-than-or-equal';
+
+CREATE OPERATOR | (
+	LEFTARG = prefix_range,
+	RIGHTARG = prefix_range,
+	PROCEDURE = prefix_range_union
+);
+COMMENT ON OPERATOR |(prefix_range, prefix_range) IS 'union';
+
+CREATE OPERATOR & (
+	LEFTARG = prefix_range,
+	RIGHTARG = prefix_range,
+	PROCEDURE = prefix_range_inter
+);
+COMMENT ON OPERATOR &(prefix_range, prefix_range) IS 'intersection';
+
+CREATE OPERATOR && (
+	LEFTARG = prefix_range,
+	RIGHTARG = prefix_range,
+	PROCEDURE = prefix_range_overlaps,
+	COMMUTATOR = '&&',
+	RESTRICT = areasel,
+	JOIN = areajoinsel
+);
+COMMENT ON OPERATOR &&(prefix_range, prefix_range) IS 'overlaps?';
+
+CREATE OPERATOR @> (
+	LEFTARG    = prefix_range,
+	RIGHTARG   = prefix_range,
+	PROCEDURE  = prefix_range_contains,
+	COMMUTATOR = '<@',
+	RESTRICT   = contsel,
+	JOIN       = contjoinsel
+);
+COMMENT ON OPERATOR @>(prefix_range, prefix_range) IS 'contains?';
+
+CREATE OPERATOR <@ (
+	LEFTARG = prefix_range,
+	RIGHTARG = prefix_range,
+	PROCEDURE = prefix_range_contained_by,
+	COMMUTATOR = '@>',
+	RESTRICT   = contsel,
+	JOIN       = contjoinsel
+);
+COMMENT ON OPERATOR <@(prefix_range, prefix_range) IS 'contained by?';
+
+CREATE OPERATOR CLASS btree_prefix_range_ops
+DEFAULT FOR TYPE prefix_range USING btree
+AS
+	OPERATOR	1	< ,
+	OPERATOR	2	<= ,
+	OPERATOR	3	= ,
+	OPERATOR	4	>= ,
+	OPERATOR	5	> ,
+	FUNCTION	1	prefix_range_cmp(prefix_range, prefix_range);
+
+
+--
+-- Up until 8.4, consistent took 3 arguments, then 5. In all cases, the
+-- CREATE OPERATOR CLASS command will not check this.
+--
+
+CREATE OR REPLACE FUNCTION gpr_consistent(internal, prefix_range, smallint, oid)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gpr_consistent(internal, prefix_range, smallint, oid, internal)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gpr_compress(internal)
+RETURNS internal 
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gpr_decompress(internal)
+RETURNS internal 
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gpr_penalty(internal, internal, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C STRICT;
+
+CREATE OR REPLACE FUNCTION pr_penalty(prefix_range, prefix_range)
+RETURNS float4
+AS '$libdir/prefix'
+LANGUAGE C STRICT;
+
+CREATE OR REPLACE FUNCTION gpr_picksplit(internal, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gpr_picksplit_presort(internal, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gpr_picksplit_jordan(internal, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gpr_union(internal, internal)
+RETURNS text
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gpr_same(prefix_range, prefix_range, internal)
+RETURNS internal 
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+
+CREATE OPERATOR CLASS gist_prefix_range_ops
+DEFAULT FOR TYPE prefix_range USING gist 
+AS
+	OPERATOR	1	@>,
+	OPERATOR	2	<@,
+	OPERATOR	3	=,
+	OPERATOR	4	&&,
+	FUNCTION	1	gpr_consistent (internal, prefix_range, smallint, oid, internal),
+	FUNCTION	2	gpr_union (internal, internal),
+	FUNCTION	3	gpr_compress (internal),
+	FUNCTION	4	gpr_decompress (internal),
+	FUNCTION	5	gpr_penalty (internal, internal, internal),
+	FUNCTION	6	gpr_picksplit (internal, internal),
+	FUNCTION	7	gpr_same (prefix_range, prefix_range, internal);
+
+--
+-- Hash indexes support, and index lookups of @> with hash indexes
+-- hashing only the prefix, through prefix_candidates() and the planner
+-- support function (PostgreSQL 12 and later).
+--
+
+CREATE OR REPLACE FUNCTION prefix_range_hash(prefix_range)
+RETURNS integer
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OPERATOR CLASS hash_prefix_range_ops
+DEFAULT FOR TYPE prefix_range USING hash
+AS
+	OPERATOR	1	= ,
+	FUNCTION	1	prefix_range_hash(prefix_range);
+
+CREATE OR REPLACE FUNCTION prefix_range_same_prefix(prefix_range, prefix_range)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OPERATOR ~= (
+	LEFTARG = prefix_range,
+	RIGHTARG = prefix_range,
+	PROCEDURE = prefix_range_same_prefix,
+	COMMUTATOR = '~=',
+	RESTRICT = eqsel,
+	JOIN = eqjoinsel
+);
+COMMENT ON OPERATOR ~=(prefix_range, prefix_range) IS 'same prefix?';
+
+CREATE OR REPLACE FUNCTION prefix_range_prefix_hash(prefix_range)
+RETURNS integer
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OPERATOR CLASS hash_prefix_range_prefix_ops
+FOR TYPE prefix_range USING hash
+AS
+	OPERATOR	1	~= ,
+	FUNCTION	1	prefix_range_prefix_hash(prefix_range);
+
+CREATE OR REPLACE FUNCTION prefix_candidates(prefix_range, ranges bool DEFAULT true)
+RETURNS prefix_range[]
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_support(internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+DO $$
+BEGIN
+  IF current_setting('server_version_num')::int >= 120000
+  THEN
+    EXECUTE 'ALTER FUNCTION prefix_range_contains(prefix_range, prefix_range)
+                SUPPORT prefix_range_support';
+    EXECUTE 'ALTER FUNCTION prefix_range_contained_by(prefix_range, prefix_range)
+                SUPPORT prefix_range_support';
+  END IF;
+END;
+$$;
+
+--
+-- prefix_range @> text and text <@ prefix_range, indexed by GiST on the
+-- prefix_range side, and by btree on the text side thanks to the
+-- planner support function (PostgreSQL 12 and later).
+--
+
+CREATE OR REPLACE FUNCTION prefix_range_contains_text(prefix_range, text)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION text_contained_by_prefix_range(text, prefix_range)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OPERATOR @> (
+	LEFTARG    = prefix_range,
+	RIGHTARG   = text,
+	PROCEDURE  = prefix_range_contains_text,
+	COMMUTATOR = '<@',
+	RESTRICT   = contsel,
+	JOIN       = contjoinsel
+);
+COMMENT ON OPERATOR @>(prefix_range, text) IS 'contains?';
+
+CREATE OPERATOR <@ (
+	LEFTARG    = text,
+	RIGHTARG   = prefix_range,
+	PROCEDURE  = text_contained_by_prefix_range,
+	COMMUTATOR = '@>',
+	RESTRICT   = contsel,
+	JOIN       = contjoinsel
+);
+COMMENT ON OPERATOR <@(text, prefix_range) IS 'contained by?';
+
+ALTER OPERATOR FAMILY gist_prefix_range_ops USING gist
+  ADD OPERATOR 5 @> (prefix_range, text);
+
+DO $$
+BEGIN
+  IF current_setting('server_version_num')::int >= 120000
+  THEN
+    EXECUTE 'ALTER FUNCTION prefix_range_contains_text(prefix_range, text)
+                SUPPORT prefix_range_support';
+    EXECUTE 'ALTER FUNCTION text_contained_by_prefix_range(text, prefix_range)
+                SUPPORT prefix_range_support';
+  END IF;
+END;
+$$;
+
+--
+-- GIN indexing of text numbers by their prefixes, for number <@ prefix
+-- and number <@ ANY(prefixes) queries. From PostgreSQL 13 on, the
+-- indexed depth is an operator class parameter.
+--
+
+CREATE OR REPLACE FUNCTION gin_prefix_text_extract_value(text, internal, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gin_prefix_text_extract_query(prefix_range, internal, int2, internal, internal, internal, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gin_prefix_text_consistent(internal, int2, prefix_range, int4, internal, internal, internal, internal)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gin_prefix_text_options(internal)
+RETURNS void
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE;
+
+DO $$
+DECLARE
+  options text := '';
+BEGIN
+  IF current_setting('server_version_num')::int >= 130000
+  THEN
+    options := ',
+	FUNCTION	7	gin_prefix_text_options(internal)';
+  END IF;
+
+  EXECUTE 'CREATE OPERATOR CLASS gin_prefix_text_ops
+FOR TYPE text USING gin
+AS
+	OPERATOR	1	<@ (text, prefix_range),
+	FUNCTION	1	bttext_pattern_cmp(text, text),
+	FUNCTION	2	gin_prefix_text_extract_value(text, internal, internal),
+	FUNCTION	3	gin_prefix_text_extract_query(prefix_range, internal, int2, internal, internal, internal, internal),
+	FUNCTION	4	gin_prefix_text_consistent(internal, int2, prefix_range, int4, internal, internal, internal, internal)'
+    || options || ',
+	STORAGE		text';
+END;
+$$;
+
+--
+-- Longest prefix match straight from a gist_prefix_range_ops index,
+-- without planning a query.
+--
+
+CREATE OR REPLACE FUNCTION prefix_lookup(regclass, text)
+RETURNS record
+AS '$libdir/prefix'
+LANGUAGE C STABLE STRICT;
+
+--
+-- Routing snapshots: a prefix table compiled into a flat bytea image,
+-- searched in place.
+--
+
+CREATE OR REPLACE FUNCTION prefix_snapshot_agg_trans(internal, prefix_range, int8)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION prefix_snapshot_agg_final(internal)
+RETURNS bytea
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE;
+
+DO $$
+DECLARE
+  parallel text := '';
+BEGIN
+  IF current_setting('server_version_num')::int >= 90600
+  THEN
+    parallel := ',
+	PARALLEL = SAFE';
+  END IF;
+
+  EXECUTE 'CREATE AGGREGATE prefix_snapshot_agg(prefix_range, int8) (
+	SFUNC = prefix_snapshot_agg_trans,
+	STYPE = internal,
+	FINALFUNC = prefix_snapshot_agg_final'
+    || parallel || '
+)';
+END;
+$$;
+
+CREATE OR REPLACE FUNCTION prefix_snapshot_lookup(bytea, text)
+RETURNS int8
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+--
+-- Matching numbers against an array of prefixes, compiled into a trie
+-- once per query.
+--
+
+CREATE OR REPLACE FUNCTION prefix_contains_any(prefix_range[], text)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_longest_any(prefix_range[], text)
+RETURNS int4
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+--
+-- Compaction of a set of prefixes into the smallest prefix_range array
+-- covering the same numbers.
+--
+
+CREATE OR REPLACE FUNCTION prefix_range_compact_trans(internal, prefix_range)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION prefix_range_compact_final(internal)
+RETURNS prefix_range[]
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION prefix_range_compact_combine(internal, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION prefix_range_compact_serialize(internal)
+RETURNS bytea
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range_compact_deserialize(bytea, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+DO $$
+BEGIN
+  IF current_setting('server_version_num')::int >= 90600
+  THEN
+    EXECUTE 'CREATE AGGREGATE prefix_range_compact(prefix_range) (
+	SFUNC = prefix_range_compact_trans,
+	STYPE = internal,
+	FINALFUNC = prefix_range_compact_final,
+	COMBINEFUNC = prefix_range_compact_combine,
+	SERIALFUNC = prefix_range_compact_serialize,
+	DESERIALFUNC = prefix_range_compact_deserialize,
+	PARALLEL = SAFE
+)';
+  ELSE
+    EXECUTE 'CREATE AGGREGATE prefix_range_compact(prefix_range) (
+	SFUNC = prefix_range_compact_trans,
+	STYPE = internal,
+	FINALFUNC = prefix_range_compact_final
+)';
+  END IF;
+END;
+$$;
+
+CREATE OR REPLACE FUNCTION prefix_ranges_from_interval(text, text)
+RETURNS SETOF prefix_range
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT
+ROWS 10;
+
+--
+-- Reload a prefix table from a staging table, only applying the
+-- differences.
+--
+
+CREATE OR REPLACE FUNCTION prefix_table_sync(target regclass,
+                                             staging regclass,
+                                             key name DEFAULT 'prefix',
+                                             OUT inserted bigint,
+                                             OUT updated bigint,
+                                             OUT deleted bigint)
+RETURNS record
+AS '$libdir/prefix'
+LANGUAGE C VOLATILE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_overlaps_report(tab regclass,
+                                                  key name DEFAULT 'prefix',
+                                                  containment bool DEFAULT false,
+                                                  OUT a prefix_range,
+                                                  OUT b prefix_range,
+                                                  OUT kind text)
+RETURNS SETOF record
+AS '$libdir/prefix'
+LANGUAGE C STABLE STRICT;
+
+--
+-- Rollup of numbers by prefix, up to a given depth.
+--
+
+CREATE TYPE prefix_rollup_row AS (
+	prefix	prefix_range,
+	count	bigint,
+	sum	numeric
+);
+
+CREATE OR REPLACE FUNCTION prefix_rollup_trans(internal, text, numeric, int)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION prefix_rollup_combine(internal, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION prefix_rollup_serialize(internal)
+RETURNS bytea
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_rollup_deserialize(bytea, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_rollup_final(internal)
+RETURNS prefix_rollup_row[]
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE;
+
+DO $$
+BEGIN
+  IF current_setting('server_version_num')::int >= 90600
+  THEN
+    EXECUTE 'CREATE AGGREGATE prefix_rollup(text, numeric, int) (
+	SFUNC = prefix_rollup_trans,
+	STYPE = internal,
+	FINALFUNC = prefix_rollup_final,
+	COMBINEFUNC = prefix_rollup_combine,
+	SERIALFUNC = prefix_rollup_serialize,
+	DESERIALFUNC = prefix_rollup_deserialize,
+	PARALLEL = SAFE
+)';
+  ELSE
+    EXECUTE 'CREATE AGGREGATE prefix_rollup(text, numeric, int) (
+	SFUNC = prefix_rollup_trans,
+	STYPE = internal,
+	FINALFUNC = prefix_rollup_final
+)';
+  END IF;
+END;
+$$;
+
+--
+-- range_union_agg(prefix_range) is the smallest prefix_range containing
+-- all the aggregated ones, as computed by the | operator. The state is
+-- a prefix_range, so partial aggregates need no serialization.
+--
+
+DO $$
+BEGIN
+  IF current_setting('server_version_num')::int >= 90600
+  THEN
+    EXECUTE 'CREATE AGGREGATE range_union_agg(prefix_range) (
+	SFUNC = prefix_range_union,
+	STYPE = prefix_range,
+	COMBINEFUNC = prefix_range_union,
+	PARALLEL = SAFE
+)';
+  ELSE
+    EXECUTE 'CREATE AGGREGATE range_union_agg(prefix_range) (
+	SFUNC = prefix_range_union,
+	STYPE = prefix_range
+)';
+  END IF;
+END;
+$$;
+
+--
+-- prefix_set: a set of prefix_range values in a single datum, stored
+-- as a trie.
+--
+
+CREATE OR REPLACE FUNCTION prefix_set_in(cstring)
+RETURNS prefix_set
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_set_out(prefix_set)
+RETURNS cstring
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_set_recv(internal)
+RETURNS prefix_set
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_set_send(prefix_set)
+RETURNS bytea
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE TYPE prefix_set (
+	INPUT          = prefix_set_in,
+	OUTPUT         = prefix_set_out,
+	RECEIVE        = prefix_set_recv,
+	SEND           = prefix_set_send,
+	INTERNALLENGTH = VARIABLE,
+	ALIGNMENT      = int4,
+	STORAGE        = extended
+);
+COMMENT ON TYPE prefix_set IS 'set of prefix ranges: {prefix_range, ...}';
+
+CREATE OR REPLACE FUNCTION prefix_set(prefix_range[])
+RETURNS prefix_set
+AS '$libdir/prefix', 'prefix_set_from_array'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_ranges(prefix_set)
+RETURNS prefix_range[]
+AS '$libdir/prefix', 'prefix_set_to_array'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE CAST (prefix_range[] as prefix_set) WITH FUNCTION prefix_set(prefix_range[]);
+CREATE CAST (prefix_set as prefix_range[]) WITH FUNCTION prefix_ranges(prefix_set);
+
+CREATE OR REPLACE FUNCTION prefix_set_contains_text(prefix_set, text)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION text_contained_by_prefix_set(text, prefix_set)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_set_overlaps(prefix_set, prefix_range)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_set_union(prefix_set, prefix_set)
+RETURNS prefix_set
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_set_inter(prefix_set, prefix_set)
+RETURNS prefix_set
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_set_except(prefix_set, prefix_set)
+RETURNS prefix_set
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OPERATOR @> (
+	LEFTARG    = prefix_set,
+	RIGHTARG   = text,
+	PROCEDURE  = prefix_set_contains_text,
+	COMMUTATOR = '<@',
+	RESTRICT   = contsel,
+	JOIN       = contjoinsel
+);
+COMMENT ON OPERATOR @>(prefix_set, text) IS 'contains?';
+
+CREATE OPERATOR <@ (
+	LEFTARG    = text,
+	RIGHTARG   = prefix_set,
+	PROCEDURE  = text_contained_by_prefix_set,
+	COMMUTATOR = '@>',
+	RESTRICT   = contsel,
+	JOIN       = contjoinsel
+);
+COMMENT ON OPERATOR <@(text, prefix_set) IS 'contained by?';
+
+CREATE OPERATOR && (
+	LEFTARG  = prefix_set,
+	RIGHTARG = prefix_range,
+	PROCEDURE = prefix_set_overlaps,
+	RESTRICT = areasel,
+	JOIN     = areajoinsel
+);
+COMMENT ON OPERATOR &&(prefix_set, prefix_range) IS 'overlaps?';
+
+CREATE OPERATOR | (
+	LEFTARG = prefix_set,
+	RIGHTARG = prefix_set,
+	PROCEDURE = prefix_set_union
+);
+COMMENT ON OPERATOR |(prefix_set, prefix_set) IS 'union';
+
+CREATE OPERATOR & (
+	LEFTARG = prefix_set,
+	RIGHTARG = prefix_set,
+	PROCEDURE = prefix_set_inter
+);
+COMMENT ON OPERATOR &(prefix_set, prefix_set) IS 'intersection';
+
+CREATE OPERATOR - (
+	LEFTARG = prefix_set,
+	RIGHTARG = prefix_set,
+	PROCEDURE = prefix_set_except
+);
+COMMENT ON OPERATOR -(prefix_set, prefix_set) IS 'difference';
+
+CREATE OR REPLACE FUNCTION gin_prefix_set_extract_value(prefix_set, internal, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gin_prefix_set_extract_query(prefix_range, internal, int2, internal, internal, internal, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gin_prefix_set_consistent(internal, int2, prefix_range, int4, internal, internal, internal, internal)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gin_prefix_set_compare_partial(text, text, int2, internal)
+RETURNS int4
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OPERATOR CLASS gin_prefix_set_ops
+DEFAULT FOR TYPE prefix_set USING gin
+AS
+	OPERATOR	1	&& (prefix_set, prefix_range),
+	FUNCTION	1	bttext_pattern_cmp(text, text),
+	FUNCTION	2	gin_prefix_set_extract_value(prefix_set, internal, internal),
+	FUNCTION	3	gin_prefix_set_extract_query(prefix_range, internal, int2, internal, internal, internal, internal),
+	FUNCTION	4	gin_prefix_set_consistent(internal, int2, prefix_range, int4, internal, internal, internal, internal),
+	FUNCTION	5	gin_prefix_set_compare_partial(text, text, int2, internal),
+	STORAGE		text;
+
+--
+-- prefix_period: a prefix_range valid from a lower timestamptz included
+-- to an upper one excluded, indexed as a single GiST key.
+--
+
+CREATE OR REPLACE FUNCTION prefix_period_in(cstring)
+RETURNS prefix_period
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_period_out(prefix_period)
+RETURNS cstring
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_period_recv(internal)
+RETURNS prefix_period
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_period_send(prefix_period)
+RETURNS bytea
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE TYPE prefix_period (
+	INPUT          = prefix_period_in,
+	OUTPUT         = prefix_period_out,
+	RECEIVE        = prefix_period_recv,
+	SEND           = prefix_period_send,
+	INTERNALLENGTH = VARIABLE,
+	ALIGNMENT      = double,
+	STORAGE        = plain
+);
+COMMENT ON TYPE prefix_period IS 'prefix range valid for a period: prefix_range@[lower,upper)';
+
+CREATE OR REPLACE FUNCTION prefix_period(prefix_range, timestamptz, timestamptz)
+RETURNS prefix_period
+AS '$libdir/prefix', 'prefix_period_make'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_period(text, timestamptz)
+RETURNS prefix_period
+AS '$libdir/prefix', 'prefix_period_at'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix(prefix_period)
+RETURNS prefix_range
+AS '$libdir/prefix', 'prefix_period_prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION lower(prefix_period)
+RETURNS timestamptz
+AS '$libdir/prefix', 'prefix_period_lower'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION upper(prefix_period)
+RETURNS timestamptz
+AS '$libdir/prefix', 'prefix_period_upper'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_period_contains(prefix_period, prefix_period)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_period_overlaps(prefix_period, prefix_period)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OPERATOR @> (
+	LEFTARG    = prefix_period,
+	RIGHTARG   = prefix_period,
+	PROCEDURE  = prefix_period_contains,
+	RESTRICT   = contsel,
+	JOIN       = contjoinsel
+);
+COMMENT ON OPERATOR @>(prefix_period, prefix_period) IS 'contains?';
+
+CREATE OPERATOR && (
+	LEFTARG    = prefix_period,
+	RIGHTARG   = prefix_period,
+	PROCEDURE  = prefix_period_overlaps,
+	COMMUTATOR = &&,
+	RESTRICT   = areasel,
+	JOIN       = areajoinsel
+);
+COMMENT ON OPERATOR &&(prefix_period, prefix_period) IS 'overlaps?';
+
+CREATE OR REPLACE FUNCTION gpp_consistent(internal, prefix_period, smallint, oid, internal)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gpp_compress(internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gpp_decompress(internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gpp_penalty(internal, internal, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gpp_picksplit(internal, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gpp_union(internal, internal)
+RETURNS prefix_period
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION gpp_same(prefix_period, prefix_period, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OPERATOR CLASS gist_prefix_period_ops
+DEFAULT FOR TYPE prefix_period USING gist
+AS
+	OPERATOR	1	@>,
+	OPERATOR	2	&&,
+	FUNCTION	1	gpp_consistent (internal, prefix_period, smallint, oid, internal),
+	FUNCTION	2	gpp_union (internal, internal),
+	FUNCTION	3	gpp_compress (internal),
+	FUNCTION	4	gpp_decompress (internal),
+	FUNCTION	5	gpp_penalty (internal, internal, internal),
+	FUNCTION	6	gpp_picksplit (internal, internal),
+	FUNCTION	7	gpp_same (prefix_period, prefix_period, internal);
+
+--
+-- prefix_key() to partition prefix tables by, the planner support
+-- function then prunes the partitions for @> and <@ clauses (PostgreSQL
+-- 12 and later).
+--
+
+CREATE OR REPLACE FUNCTION prefix_key(prefix_range, len int)
+RETURNS text
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+--
+-- e164_prefix: digit prefixes of E.164 numbers, in a 64 bits integer
+-- passed by value when int8 is.
+--
+
+CREATE OR REPLACE FUNCTION e164_prefix_in(cstring)
+RETURNS e164_prefix
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_out(e164_prefix)
+RETURNS cstring
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_recv(internal)
+RETURNS e164_prefix
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_send(e164_prefix)
+RETURNS bytea
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+DO $$
+BEGIN
+  IF (SELECT typbyval FROM pg_type WHERE oid = 'int8'::regtype)
+  THEN
+    EXECUTE 'CREATE TYPE e164_prefix (
+	INPUT          = e164_prefix_in,
+	OUTPUT         = e164_prefix_out,
+	RECEIVE        = e164_prefix_recv,
+	SEND           = e164_prefix_send,
+	INTERNALLENGTH = 8,
+	PASSEDBYVALUE,
+	ALIGNMENT      = double,
+	STORAGE        = plain
+)';
+  ELSE
+    EXECUTE 'CREATE TYPE e164_prefix (
+	INPUT          = e164_prefix_in,
+	OUTPUT         = e164_prefix_out,
+	RECEIVE        = e164_prefix_recv,
+	SEND           = e164_prefix_send,
+	INTERNALLENGTH = 8,
+	ALIGNMENT      = double,
+	STORAGE        = plain
+)';
+  END IF;
+END;
+$$;
+COMMENT ON TYPE e164_prefix IS 'prefix of at most 15 digits: 0146[2-5]';
+
+CREATE OR REPLACE FUNCTION e164_prefix(prefix_range)
+RETURNS e164_prefix
+AS '$libdir/prefix', 'e164_prefix_from_prefix_range'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_range(e164_prefix)
+RETURNS prefix_range
+AS '$libdir/prefix', 'e164_prefix_to_prefix_range'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE CAST (prefix_range as e164_prefix) WITH FUNCTION e164_prefix(prefix_range) AS ASSIGNMENT;
+CREATE CAST (e164_prefix as prefix_range) WITH FUNCTION prefix_range(e164_prefix) AS ASSIGNMENT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_eq(e164_prefix, e164_prefix)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_neq(e164_prefix, e164_prefix)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_lt(e164_prefix, e164_prefix)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_le(e164_prefix, e164_prefix)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_gt(e164_prefix, e164_prefix)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_ge(e164_prefix, e164_prefix)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_cmp(e164_prefix, e164_prefix)
+RETURNS int4
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_sortsupport(internal)
+RETURNS void
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_hash(e164_prefix)
+RETURNS int4
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_contains(e164_prefix, e164_prefix)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_contained_by(e164_prefix, e164_prefix)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_overlaps(e164_prefix, e164_prefix)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_union(e164_prefix, e164_prefix)
+RETURNS e164_prefix
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION e164_prefix_inter(e164_prefix, e164_prefix)
+RETURNS e164_prefix
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OPERATOR = (
+	LEFTARG    = e164_prefix,
+	RIGHTARG   = e164_prefix,
+	PROCEDURE  = e164_prefix_eq,
+	COMMUTATOR = '=',
+	NEGATOR    = '<>',
+	RESTRICT   = eqsel,
+	JOIN       = eqjoinsel,
+	HASHES,
+	MERGES
+);
+COMMENT ON OPERATOR =(e164_prefix, e164_prefix) IS 'equals?';
+
+CREATE OPERATOR <> (
+	LEFTARG    = e164_prefix,
+	RIGHTARG   = e164_prefix,
+	PROCEDURE  = e164_prefix_neq,
+	COMMUTATOR = '<>',
+	NEGATOR    = '=',
+	RESTRICT   = neqsel,
+	JOIN       = neqjoinsel
+);
+COMMENT ON OPERATOR <>(e164_prefix, e164_prefix) IS 'not equals?';
+
+CREATE OPERATOR < (
+	LEFTARG    = e164_prefix,
+	RIGHTARG   = e164_prefix,
+	PROCEDURE  = e164_prefix_lt,
+	COMMUTATOR = > ,
+	NEGATOR    = >= ,
+	RESTRICT   = scalarltsel,
+	JOIN       = scalarltjoinsel
+);
+COMMENT ON OPERATOR <(e164_prefix, e164_prefix) IS 'less-than';
+
+CREATE OPERATOR <= (
+	LEFTARG    = e164_prefix,
+	RIGHTARG   = e164_prefix,
+	PROCEDURE  = e164_prefix_le,
+	COMMUTATOR = >= ,
+	NEGATOR    = > ,
+	RESTRICT   = scalarltsel,
+	JOIN       = scalarltjoinsel
+);
+COMMENT ON OPERATOR <=(e164_prefix, e164_prefix) IS 'less-than-or-equal';
+
+CREATE OPERATOR > (
+	LEFTARG    = e164_prefix,
+	RIGHTARG   = e164_prefix,
+	PROCEDURE  = e164_prefix_gt,
+	COMMUTATOR = < ,
+	NEGATOR    = <= ,
+	RESTRICT   = scalargtsel,
+	JOIN       = scalargtjoinsel
+);
+COMMENT ON OPERATOR >(e164_prefix, e164_prefix) IS 'greater-than';
+
+CREATE OPERATOR >= (
+	LEFTARG    = e164_prefix,
+	RIGHTARG   = e164_prefix,
+	PROCEDURE  = e164_prefix_ge,
+	COMMUTATOR = <= ,
+	NEGATOR    = < ,
+	RESTRICT   = scalargtsel,
+	JOIN       = scalargtjoinsel
+);
+COMMENT ON OPERATOR >=(e164_prefix, e164_prefix) IS 'greater-than-or-equal';
+
+CREATE OPERATOR @> (
+	LEFTARG    = e164_prefix,
+	RIGHTARG   = e164_prefix,
+	PROCEDURE  = e164_prefix_contains,
+	COMMUTATOR = '<@',
+	RESTRICT   = contsel,
+	JOIN       = contjoinsel
+);
+COMMENT ON OPERATOR @>(e164_prefix, e164_prefix) IS 'contains?';
+
+CREATE OPERATOR <@ (
+	LEFTARG    = e164_prefix,
+	RIGHTARG   = e164_prefix,
+	PROCEDURE  = e164_prefix_contained_by,
+	COMMUTATOR = '@>',
+	RESTRICT   = contsel,
+	JOIN       = contjoinsel
+);
+COMMENT ON OPERATOR <@(e164_prefix, e164_prefix) IS 'contained by?';
+
+CREATE OPERATOR && (
+	LEFTARG    = e164_prefix,
+	RIGHTARG   = e164_prefix,
+	PROCEDURE  = e164_prefix_overlaps,
+	COMMUTATOR = '&&',
+	RESTRICT   = areasel,
+	JOIN       = areajoinsel
+);
+COMMENT ON OPERATOR &&(e164_prefix, e164_prefix) IS 'overlaps?';
+
+CREATE OPERATOR | (
+	LEFTARG    = e164_prefix,
+	RIGHTARG   = e164_prefix,
+	PROCEDURE  = e164_prefix_union
+);
+COMMENT ON OPERATOR |(e164_prefix, e164_prefix) IS 'union';
+
+CREATE OPERATOR & (
+	LEFTARG    = e164_prefix,
+	RIGHTARG   = e164_prefix,
+	PROCEDURE  = e164_prefix_inter
+);
+COMMENT ON OPERATOR &(e164_prefix, e164_prefix) IS 'intersection';
+
+CREATE OPERATOR CLASS btree_e164_prefix_ops
+DEFAULT FOR TYPE e164_prefix USING btree
+AS
+	OPERATOR	1	< ,
+	OPERATOR	2	<= ,
+	OPERATOR	3	= ,
+	OPERATOR	4	>= ,
+	OPERATOR	5	> ,
+	FUNCTION	1	e164_prefix_cmp(e164_prefix, e164_prefix);
+
+DO $$
+BEGIN
+  IF current_setting('server_version_num')::int >= 90200
+  THEN
+    EXECUTE 'ALTER OPERATOR FAMILY btree_e164_prefix_ops USING btree
+                ADD FUNCTION 2 (e164_prefix, e164_prefix) e164_prefix_sortsupport(internal)';
+  END IF;
+END;
+$$;
+
+CREATE OPERATOR CLASS hash_e164_prefix_ops
+DEFAULT FOR TYPE e164_prefix USING hash
+AS
+	OPERATOR	1	= ,
+	FUNCTION	1	e164_prefix_hash(e164_prefix);
+
+CREATE OR REPLACE FUNCTION ge164_consistent(internal, e164_prefix, smallint, oid, internal)
+RETURNS bool
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION ge164_compress(internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION ge164_decompress(internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION ge164_penalty(internal, internal, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION ge164_picksplit(internal, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION ge164_union(internal, internal)
+RETURNS e164_prefix
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION ge164_same(e164_prefix, e164_prefix, internal)
+RETURNS internal
+AS '$libdir/prefix'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OPERATOR CLASS gist_e164_prefix_ops
+DEFAULT FOR TYPE e164_prefix USING gist
+AS
+	OPERATOR	1	@>,
+	OPERATOR	2	<@,
+	OPERATOR	3	=,
+	OPERATOR	4	&&,
+	FUNCTION	1	ge164_consistent (internal, e164_prefix, smallint, oid, internal),
+	FUNCTION	2	ge164_union (internal, internal),
+	FUNCTION	3	ge164_compress (internal),
+	FUNCTION	4	ge164_decompress (internal),
+	FUNCTION	5	ge164_penalty (internal, internal, internal),
+	FUNCTION	6	ge164_picksplit (internal, internal),
+	FUNCTION	7	ge164_same (e164_prefix, e164_prefix, internal);
+
+--
+-- Picksplit strategies: the presort and jordan opclasses, to compare
+-- them with the default one on real data, and prefix_picksplit_stats()
+-- to run them all on a page sample.
+--
+
+CREATE OPERATOR CLASS gist_prefix_range_presort_ops
+FOR TYPE prefix_range USING gist
+AS
+	OPERATOR	1	@>,
+	OPERATOR	2	<@,
+	OPERATOR	3	=,
+	OPERATOR	4	&&,
+	OPERATOR	5	@> (prefix_range, text),
+	FUNCTION	1	gpr_consistent (internal, prefix_range, smallint, oid, internal),
+	FUNCTION	2	gpr_union (internal, internal),
+	FUNCTION	3	gpr_compress (internal),
+	FUNCTION	4	gpr_decompress (internal),
+	FUNCTION	5	gpr_penalty (internal, internal, internal),
+	FUNCTION	6	gpr_picksplit_presort (internal, internal),
+	FUNCTION	7	gpr_same (prefix_range, prefix_range, internal);
+
+CREATE OPERATOR CLASS gist_prefix_range_jordan_ops
+FOR TYPE prefix_range USING gist
+AS
+	OPERATOR	1	@>,
+	OPERATOR	2	<@,
+	OPERATOR	3	=,
+	OPERATOR	4	&&,
+	OPERATOR	5	@> (prefix_range, text),
+	FUNCTION	1	gpr_consistent (internal, prefix_range, smallint, oid, internal),
+	FUNCTION	2	gpr_union (internal, internal),
+	FUNCTION	3	gpr_compress (internal),
+	FUNCTION	4	gpr_decompress (internal),
+	FUNCTION	5	gpr_penalty (internal, internal, internal),
+	FUNCTION	6	gpr_picksplit_jordan (internal, internal),
+	FUNCTION	7	gpr_same (prefix_range, prefix_range, internal);
+
+CREATE OR REPLACE FUNCTION prefix_picksplit_stats(prefix_range[],
+                                                  OUT strategy text,
+                                                  OUT nleft integer,
+                                                  OUT nright integer,
+                                                  OUT balance float8,
+                                                  OUT union_left prefix_range,
+                                                  OUT union_right prefix_range,
+                                                  OUT left_length integer,
+                                                  OUT right_length integer,
+                                                  OUT overlap boolean,
+                                                  OUT shared integer,
+                                                  OUT misplaced integer)
+RETURNS SETOF record
+AS '$libdir/prefix'
+LANGUAGE C STRICT;
+
+--
+-- Inspection of gist_prefix_range_ops indexes, by page and by level
+-- (PostgreSQL 12 and later).
+--
+
+CREATE OR REPLACE FUNCTION prefix_index_pages(regclass,
+                                              OUT blkno bigint,
+                                              OUT level integer,
+                                              OUT leaf boolean,
+                                              OUT tuples integer,
+                                              OUT free_space integer,
+                                              OUT avg_prefix_length float8,
+                                              OUT empty integer,
+                                              OUT overlapping integer)
+RETURNS SETOF record
+AS '$libdir/prefix'
+LANGUAGE C STRICT;
+
+CREATE OR REPLACE FUNCTION prefix_index_stats(regclass,
+                                              OUT level integer,
+                                              OUT pages bigint,
+                                              OUT tuples bigint,
+                                              OUT avg_tuples float8,
+                                              OUT avg_free_space float8,
+                                              OUT avg_prefix_length float8,
+                                              OUT empty_ratio float8,
+                                              OUT overlap_ratio float8)
+RETURNS SETOF record
+AS '$libdir/prefix'
+LANGUAGE C STRICT;
+
+--
+-- Parallel safety (PostgreSQL 9.6 and later). The functions only
+-- compute on their arguments and are safe, with the exception of:
+--
+--   prefix_lookup()          restricted, caches open relations in the backend
+--   prefix_overlaps_report() restricted, reads the table with SPI
+--   prefix_table_sync()      unsafe (the default), writes to the table
+--
+
+DO $$
+DECLARE
+  f text;
+BEGIN
+  IF current_setting('server_version_num')::int < 90600
+  THEN
+    RETURN;
+  END IF;
+
+  FOREACH f IN ARRAY ARRAY[
+    'prefix_range_in(cstring)',
+    'prefix_range_out(prefix_range)',
+    'prefix_range_recv(internal)',
+    'prefix_range_send(prefix_range)',
+    'prefix_range(text, text, text)',
+    'prefix_range(text)',
+    'text(prefix_range)',
+    'prefix_range_eq(prefix_range, prefix_range)',
+    'prefix_range_neq(prefix_range, prefix_range)',
+    'prefix_range_lt(prefix_range, prefix_range)',
+    'prefix_range_le(prefix_range, prefix_range)',
+    'prefix_range_gt(prefix_range, prefix_range)',
+    'prefix_range_ge(prefix_range, prefix_range)',
+    'prefix_range_cmp(prefix_range, prefix_range)',
+    'prefix_range_overlaps(prefix_range, prefix_range)',
+    'prefix_range_contains(prefix_range, prefix_range)',
+    'prefix_range_contains_strict(prefix_range, prefix_range)',
+    'prefix_range_contained_by(prefix_range, prefix_range)',
+    'prefix_range_contained_by_strict(prefix_range, prefix_range)',
+    'prefix_range_union(prefix_range, prefix_range)',
+    'prefix_range_inter(prefix_range, prefix_range)',
+    'length(prefix_range)',
+    'gpr_consistent(internal, prefix_range, smallint, oid)',
+    'gpr_consistent(internal, prefix_range, smallint, oid, internal)',
+    'gpr_compress(internal)',
+    'gpr_decompress(internal)',
+    'gpr_penalty(internal, internal, internal)',
+    'pr_penalty(prefix_range, prefix_range)',
+    'gpr_picksplit(internal, internal)',
+    'gpr_picksplit_presort(internal, internal)',
+    'gpr_picksplit_jordan(internal, internal)',
+    'gpr_union(internal, internal)',
+    'gpr_same(prefix_range, prefix_range, internal)',
+    'prefix_range_hash(prefix_range)',
+    'prefix_range_same_prefix(prefix_range, prefix_range)',
+    'prefix_range_prefix_hash(prefix_range)',
+    'prefix_candidates(prefix_range, bool)',
+    'prefix_range_support(internal)',
+    'prefix_range_contains_text(prefix_range, text)',
+    'text_contained_by_prefix_range(text, prefix_range)',
+    'gin_prefix_text_extract_value(text, internal, internal)',
+    'gin_prefix_text_extract_query(prefix_range, internal, int2, internal, internal, internal, internal)',
+    'gin_prefix_text_consistent(internal, int2, prefix_range, int4, internal, internal, internal, internal)',
+    'gin_prefix_text_options(internal)',
+    'prefix_snapshot_agg_trans(internal, prefix_range, int8)',
+    'prefix_snapshot_agg_final(internal)',
+    'prefix_snapshot_lookup(bytea, text)',
+    'prefix_contains_any(prefix_range[], text)',
+    'prefix_longest_any(prefix_range[], text)',
+    'prefix_range_compact_trans(internal, prefix_range)',
+    'prefix_range_compact_combine(internal, internal)',
+    'prefix_range_compact_serialize(internal)',
+    'prefix_range_compact_deserialize(bytea, internal)',
+    'prefix_range_compact_final(internal)',
+    'prefix_ranges_from_interval(text, text)',
+    'prefix_rollup_trans(internal, text, numeric, int)',
+    'prefix_rollup_combine(internal, internal)',
+    'prefix_rollup_serialize(internal)',
+    'prefix_rollup_deserialize(bytea, internal)',
+    'prefix_rollup_final(internal)',
+    'prefix_set_in(cstring)',
+    'prefix_set_out(prefix_set)',
+    'prefix_set_recv(internal)',
+    'prefix_set_send(prefix_set)',
+    'prefix_set(prefix_range[])',
+    'prefix_ranges(prefix_set)',
+    'prefix_set_contains_text(prefix_set, text)',
+    'text_contained_by_prefix_set(text, prefix_set)',
+    'prefix_set_overlaps(prefix_set, prefix_range)',
+    'prefix_set_union(prefix_set, prefix_set)',
+    'prefix_set_inter(prefix_set, prefix_set)',
+    'prefix_set_except(prefix_set, prefix_set)',
+    'gin_prefix_set_extract_value(prefix_set, internal, internal)',
+    'gin_prefix_set_extract_query(prefix_range, internal, int2, internal, internal, internal, internal)',
+    'gin_prefix_set_consistent(internal, int2, prefix_range, int4, internal, internal, internal, internal)',
+    'gin_prefix_set_compare_partial(text, text, int2, internal)',
+    'prefix_period_in(cstring)',
+    'prefix_period_out(prefix_period)',
+    'prefix_period_recv(internal)',
+    'prefix_period_send(prefix_period)',
+    'prefix_period(prefix_range, timestamptz, timestamptz)',
+    'prefix_period(text, timestamptz)',
+    'prefix(prefix_period)',
+    'lower(prefix_period)',
+    'upper(prefix_period)',
+    'prefix_period_contains(prefix_period, prefix_period)',
+    'prefix_period_overlaps(prefix_period, prefix_period)',
+    'gpp_consistent(internal, prefix_period, smallint, oid, internal)',
+    'gpp_compress(internal)',
+    'gpp_decompress(internal)',
+    'gpp_penalty(internal, internal, internal)',
+    'gpp_picksplit(internal, internal)',
+    'gpp_union(internal, internal)',
+    'gpp_same(prefix_period, prefix_period, internal)',
+    'prefix_key(prefix_range, int)',
+    'e164_prefix_in(cstring)',
+    'e164_prefix_out(e164_prefix)',
+    'e164_prefix_recv(internal)',
+    'e164_prefix_send(e164_prefix)',
+    'e164_prefix(prefix_range)',
+    'prefix_range(e164_prefix)',
+    'e164_prefix_eq(e164_prefix, e164_prefix)',
+    'e164_prefix_neq(e164_prefix, e164_prefix)',
+    'e164_prefix_lt(e164_prefix, e164_prefix)',
+    'e164_prefix_le(e164_prefix, e164_prefix)',
+    'e164_prefix_gt(e164_prefix, e164_prefix)',
+    'e164_prefix_ge(e164_prefix, e164_prefix)',
+    'e164_prefix_cmp(e164_prefix, e164_prefix)',
+    'e164_prefix_contains(e164_prefix, e164_prefix)',
+    'e164_prefix_contained_by(e164_prefix, e164_prefix)',
+    'e164_prefix_overlaps(e164_prefix, e164_prefix)',
+    'e164_prefix_union(e164_prefix, e164_prefix)',
+    'e164_prefix_inter(e164_prefix, e164_prefix)',
+    'e164_prefix_sortsupport(internal)',
+    'e164_prefix_hash(e164_prefix)',
+    'ge164_consistent(internal, e164_prefix, smallint, oid, internal)',
+    'ge164_compress(internal)',
+    'ge164_decompress(internal)',
+    'ge164_penalty(internal, internal, internal)',
+    'ge164_picksplit(internal, internal)',
+    'ge164_union(internal, internal)',
+    'ge164_same(e164_prefix, e164_prefix, internal)',
+    'prefix_picksplit_stats(prefix_range[])',
+    'prefix_index_pages(regclass)',
+    'prefix_index_stats(regclass)']
+  LOOP
+    EXECUTE 'ALTER FUNCTION ' || f || ' PARALLEL SAFE';
+  END LOOP;
+
+  EXECUTE 'ALTER FUNCTION prefix_lookup(regclass, text) PARALLEL RESTRICTED';
+  EXECUTE 'ALTER FUNCTION prefix_overlaps_report(regclass, name, bool) PARALLEL RESTRICTED';
+END;
+$$;
@@ -14,14 +14,80 @@
 #include "postgres.h"
 
 #include "access/gist.h"
+#include "access/gin.h"
 #include "access/skey.h"
 #include "utils/elog.h"
 #include "utils/palloc.h"
 #include "utils/builtins.h"
 #include "libpq/pqformat.h"
+#include "mb/pg_wchar.h"
+#include "utils/guc.h"
+#include "funcapi.h"
+#include "utils/array.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/datum.h"
+#include "miscadmin.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "utils/tuplestore.h"
+#include "utils/typcache.h"
+#include "catalog/pg_type.h"
+#include "utils/timestamp.h"
+
+#if PG_VERSION_NUM >= 130000
+#include "access/reloptions.h"
+#include "common/hashfn.h"
+#else
+#include "access/hash.h"
+#endif
+#if PG_VERSION_NUM >= 90200
+#include "utils/sortsupport.h"
+#endif
+#if PG_VERSION_NUM >= 90300
+#include "access/htup_details.h"
+#endif
 #if PG_VERSION_NUM >= 160000
 #include "varatt.h"
 #endif
+#if PG_VERSION_NUM >= 120000
+#include "access/genam.h"
+#include "access/relscan.h"
+#include "access/table.h"
+#include "access/tableam.h"
+#include "access/xact.h"
+#include "catalog/pg_class.h"
+#include "commands/explain.h"
+#include "executor/executor.h"
+#include "nodes/extensible.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "nodes/supportnodes.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_opfamily.h"
+#include "utils/pg_locale.h"
+#include "parser/parse_func.h"
+#include "parser/parsetree.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_collation.h"
+#include "rewrite/rewriteManip.h"
+#include "utils/partcache.h"
+#include "optimizer/cost.h"
+#include "optimizer/optimizer.h"
+#include "optimizer/pathnode.h"
+#include "optimizer/paths.h"
+#include "optimizer/restrictinfo.h"
+#include "optimizer/tlist.h"
+#include "utils/resowner.h"
+#include "utils/ruleutils.h"
+#include "utils/snapmgr.h"
+#include "access/gist_private.h"
+#include "storage/bufmgr.h"
+#include "utils/acl.h"
+#include "catalog/index.h"
+#include "utils/rls.h"
+#endif
+#include <limits.h>
 #include <math.h>
 
 /**
@@ -44,22 +110,9 @@
 #define  DEBUG_MAKE_VARLENA
 */
 
-PG_MODULE_MAGIC;
-
-/**
- * prefix_range datatype, varlena structure
- */
-typedef struct {
-  char first;
-  char last;
-  char prefix[1]; /* this is a varlena structure, data follows */
-} prefix_range;
+#include "prefix_core.h"
 
-enum pr_delimiters_t {
-  PR_OPEN   = '[',
-  PR_CLOSE  = ']',
-  PR_SEP    = '-'
-} pr_delimiters;
+PG_MODULE_MAGIC;
 
 /**
  * prefix_range input/output functions and operators
@@ -86,278 +139,157 @@ Datum prefix_range_contains(PG_FUNCTION_ARGS);
 Datum prefix_range_contains_strict(PG_FUNCTION_ARGS);
 Datum prefix_range_contained_by(PG_FUNCTION_ARGS);
 Datum prefix_range_contained_by_strict(PG_FUNCTION_ARGS);
+Datum prefix_range_contains_text(PG_FUNCTION_ARGS);
+Datum text_contained_by_prefix_range(PG_FUNCTION_ARGS);
 Datum prefix_range_union(PG_FUNCTION_ARGS);
 Datum prefix_range_inter(PG_FUNCTION_ARGS);
+Datum prefix_range_hash(PG_FUNCTION_ARGS);
+Datum prefix_range_same_prefix(PG_FUNCTION_ARGS);
+Datum prefix_range_prefix_hash(PG_FUNCTION_ARGS);
+Datum prefix_candidates(PG_FUNCTION_ARGS);
+Datum prefix_key(PG_FUNCTION_ARGS);
+Datum prefix_range_support(PG_FUNCTION_ARGS);
 
+/*
+ * prefix_range only has char fields, so that the values are used in
+ * place whatever their varlena header: the 1 byte header ones, that the
+ * heap and indexes store for short values, are not copied out.
+ */
 #define DatumGetPrefixRange(X)	          ((prefix_range *) VARDATA_ANY(X) )
+#define DatumGetPrefixRangeP(X)	          DatumGetPrefixRange(PG_DETOAST_DATUM_PACKED(X))
 #define PrefixRangeGetDatum(X)	          PointerGetDatum(make_varlena(X))
-#define PG_GETARG_PREFIX_RANGE_P(n)	  DatumGetPrefixRange(PG_DETOAST_DATUM(PG_GETARG_DATUM(n)))
+#define PG_GETARG_PREFIX_RANGE_P(n)	  DatumGetPrefixRangeP(PG_GETARG_DATUM(n))
 #define PG_RETURN_PREFIX_RANGE_P(x)	  return PrefixRangeGetDatum(x)
 
-/**
- * Used by prefix_contains_internal and pr_contains_prefix.
- *
- * plen is the length of string p, qlen the length of string q, the
- * caller are dealing with either text * or char * and its their
- * responsabolity to use either strlen() or VARSIZE_ANY_EXHDR()
- */
-static inline
-bool __prefix_contains(char *p, char *q, int plen, int qlen) {
-  if(qlen < plen )
-    return false;
-
-  return memcmp(p, q, plen) == 0;
-}
-
-static inline
-char *__greater_prefix(char *a, char *b, int alen, int blen)
-{
-  int i = 0;
-  char *result = NULL;
-
-  for(i=0; i<alen && i<blen && a[i] == b[i]; i++);
-
-  /* i is the last common char position in a, or 0 */
-  if( i == 0 ) {
-    /**
-     * return ""
-     */
-    result = (char *)palloc(sizeof(char));
-  }
-  else {
-    result = (char *)palloc((i+1) * sizeof(char));
-    memcpy(result, a, i);
-  }
-  result[i] = 0;
-
-  return result;
-}
-
-/**
- * Helper function which builds a prefix_range from a prefix, a first
- * and a last component, making a copy of the prefix string.
- */
-static inline
-prefix_range *build_pr(const char *prefix, char first, char last) {
-  int s = strlen(prefix) + 1;
-  prefix_range *pr = palloc(sizeof(prefix_range) + s);
-  memcpy(pr->prefix, prefix, s);
-  pr->first = first;
-  pr->last  = last;
-
-#ifdef DEBUG_PR_IN
-  elog(NOTICE,
-       "build_pr: pr->prefix = '%s', pr->first = %d, pr->last = %d",
-       pr->prefix, pr->first, pr->last);
-#endif
-
-  return pr;
-}
-
-/**
- * Normalize a prefix_range. Two cases are handled:
- *
- *  abc[x-x] is rewritten abcx
- *  abc[x-y] is rewritten abc[y-x] when y < x
- */
-static inline
-prefix_range *pr_normalize(prefix_range *a) {
-  char tmpswap;
-  char *prefix;
-
-  prefix_range *pr = build_pr(a->prefix, a->first, a->last);
-
-  if( pr->first == pr->last ) {
-    int s = strlen(pr->prefix)+2;
-    prefix = (char *)palloc(s);
-    memcpy(prefix, pr->prefix, s-2);
-    prefix[s-2] = pr->first;
-    prefix[s-1] = 0;
-
-#ifdef DEBUG_PR_NORMALIZE
-    elog(NOTICE, "prefix_range %s %s %s", a->prefix, pr->prefix, prefix);
-#endif
-
-    pfree(pr);
-    pr = build_pr(prefix, 0, 0);
-  }
-  else if( pr->first > pr->last ) {
-    tmpswap   = pr->first;
-    pr->first = pr->last;
-    pr->last  = tmpswap;
-  }
-  return pr;
-}
-
-/*
- * Init a prefix value from the prefix_range(text, text, text)
- * function
- */
-static inline
-prefix_range *make_prefix_range(char *str, char first, char last) {
-  int len;
-  prefix_range *pr = NULL;
-
-  if( str != NULL )
-    pr  = build_pr(str, first, last);
-
-  else
-    pr = build_pr("", first, last);
-
-  len = strlen(pr->prefix);
-  memcpy(pr->prefix, str, len);
-  pr->prefix[len] = 0;
-
-  return pr_normalize(pr);
-}
-
 /**
  * First, the input reader. A prefix range will have to respect the
  * following regular expression: .*([[].-.[]])?
  *
  * examples : 123[4-6], [1-3], 234, 01[] --- last one not covered by
  * regexp.
+ *
+ * The value is validated, normalized and built as a prefix_range datum
+ * in a single pass and a single allocation: the prefix is never longer
+ * than str, even with abc[x-x] normalized to abcx. Returns NULL when
+ * str is not a valid prefix_range.
  */
-
-static inline
-prefix_range *pr_from_str(char *str) {
-  prefix_range *pr = NULL;
-  char *prefix = (char *)palloc(strlen(str)+1);
-  char current = 0, previous = 0;
-  bool opened = false;
-  bool closed = false;
+static struct varlena *
+pr_parse(const char *str) {
+  int len = strlen(str);
+  struct varlena *vdat = palloc(VARHDRSZ + sizeof(prefix_range) + len + 1);
+  prefix_range *pr = (prefix_range *) VARDATA(vdat);
+  const char *ptr;
+  char first = 0, last = 0, previous = PR_OPEN;
   bool sawsep = false;
-  char *ptr, *prefix_ptr = prefix;
-
-  bzero(prefix, strlen(str)+1);
-
-  for(ptr=str; *ptr != 0; ptr++) {
-    previous = current;
-    current = *ptr;
-
-    if( !opened && current != PR_OPEN )
-      *prefix_ptr++ = current;
+  int n;
 
-#ifdef DEBUG_PR_IN
-    elog(NOTICE, "prefix_range previous='%c' current='%c' prefix='%s'",
-	 (previous?previous:' '), current, prefix);
-#endif
-
-    switch( current ) {
-
-    case PR_OPEN:
-      if( opened ) {
-#ifdef DEBUG_PR_IN
-	elog(ERROR,
-	     "prefix_range %s contains several %c", str, PR_OPEN);
-#endif
+  /* the prefix, up to the range opening, at once for plain numbers */
+  if( pr_all_digits(str, len) )
+    ptr = str + len;
+  else
+    for(ptr=str; *ptr != 0 && *ptr != PR_OPEN; ptr++)
+      if( *ptr == PR_CLOSE )
 	return NULL;
-      }
-      opened = true;
 
-      pr = build_pr(prefix, 0, 0);
-      break;
+  n = ptr - str;
+  memcpy(pr->prefix, str, n);
 
-    case PR_SEP:
-      if( opened ) {
-	if( closed ) {
-#ifdef DEBUG_PR_IN
-	  elog(ERROR,
-	       "prefix_range %s contains trailing character", str);
-#endif
-	  return NULL;
-	}
-	sawsep = true;
+  if( *ptr == PR_OPEN ) {
+    /*
+     * Bounds are the characters around the last separator, the others
+     * are ignored: [123-5] is [3-5].
+     */
+    for(ptr++; *ptr != PR_CLOSE; ptr++) {
+      switch( *ptr ) {
+      case 0:
+      case PR_OPEN:
+	return NULL;
 
-	if( previous == PR_OPEN ) {
-#ifdef DEBUG_PR_IN
-	  elog(ERROR,
-	       "prefix_range %s has separator following range opening, without data", str);
-#endif
+      case PR_SEP:
+	if( previous == PR_OPEN )
 	  return NULL;
-	}
 
-	pr->first = previous;
-      }
-      break;
-
-    case PR_CLOSE:
-      if( !opened ) {
-#ifdef DEBUG_PR_IN
-	elog(ERROR,
-	     "prefix_range %s closes a range which is not opened ", str);
-#endif
-	return NULL;
+	first  = previous;
+	sawsep = true;
+	break;
       }
+      previous = *ptr;
+    }
 
-      if( closed ) {
-#ifdef DEBUG_PR_IN
-	elog(ERROR,
-	     "prefix_range %s contains several %c", str, PR_CLOSE);
-#endif
+    if( sawsep ) {
+      if( previous == PR_SEP )
 	return NULL;
-      }
-      closed = true;
+      last = previous;
+    }
+    else if( previous != PR_OPEN )
+      return NULL;
 
-      if( sawsep ) {
-	if( previous == PR_SEP ) {
-#ifdef DEBUG_PR_IN
-	  elog(ERROR,
-	       "prefix_range %s has a closed range without last bound", str);
-#endif
-	  return NULL;
-	}
-	pr->last = previous;
-      }
-      else {
-	if( previous != PR_OPEN ) {
-#ifdef DEBUG_PR_IN
-	  elog(ERROR,
-	       "prefix_range %s has a closing range without separator", str);
-#endif
-	  return NULL;
-	}
-      }
-      break;
+    /* trailing characters */
+    if( ptr[1] != 0 )
+      return NULL;
+  }
 
-    default:
-      if( closed ) {
-#ifdef DEBUG_PR_IN
-	elog(ERROR,
-	     "prefix_range %s contains trailing characters", str);
-#endif
-	return NULL;
-      }
-      break;
-    }
+  /* normalize, as pr_normalize() does */
+  if( first != 0 && first == last ) {
+    pr->prefix[n++] = first;
+    first = last = 0;
   }
+  else if( first > last ) {
+    char swap = first;
 
-  if( ! opened ) {
-    pr = build_pr(prefix, 0, 0);
+    first = last;
+    last  = swap;
   }
+  pr->first = first;
+  pr->last  = last;
+  pr->prefix[n] = 0;
+  pr->prefix[n + 1] = 0;
 
-  if( opened && !closed ) {
-#ifdef DEBUG_PR_IN
-    elog(ERROR, "prefix_range %s opens a range but does not close it", str);
-#endif
+  SET_VARSIZE(vdat, VARHDRSZ + sizeof(prefix_range) + n + 1);
+  return vdat;
+}
+
+static inline
+prefix_range *pr_from_str(char *str) {
+  struct varlena *vdat = pr_parse(str);
+
+  if( vdat == NULL )
     return NULL;
-  }
 
-  pr = pr_normalize(pr);
+  return (prefix_range *) VARDATA(vdat);
+}
 
-#ifdef DEBUG_PR_IN
-  if( pr != NULL ) {
-    if( pr->first && pr->last )
-      elog(NOTICE,
-	   "prefix_range %s: prefix = '%s', first = '%c', last = '%c'",
-	   str, pr->prefix, pr->first, pr->last);
-    else
-      elog(NOTICE,
-	   "prefix_range %s: prefix = '%s', no first nor last",
-	   str, pr->prefix);
+/**
+ * Get a prefix_range from a text value, as the text to prefix_range
+ * cast does, without going through the input function for the common
+ * case of a plain number. Returns NULL for an invalid value.
+ */
+static inline
+prefix_range *pr_try_from_text(text *txt) {
+  char *str = VARDATA_ANY(txt);
+  int len = VARSIZE_ANY_EXHDR(txt);
+  prefix_range *pr;
+
+  if( memchr(str, PR_OPEN, len) == NULL && memchr(str, PR_CLOSE, len) == NULL ) {
+    pr = (prefix_range *) palloc(sizeof(prefix_range) + len);
+    pr->first = 0;
+    pr->last  = 0;
+    memcpy(pr->prefix, str, len);
+    pr->prefix[len] = 0;
+
+    return pr;
   }
-#endif
+  return pr_from_str(text_to_cstring(txt));
+}
 
+static inline
+prefix_range *pr_from_text(text *txt) {
+  prefix_range *pr = pr_try_from_text(txt);
+
+  if( pr == NULL )
+    ereport(ERROR,
+	    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+	     errmsg("invalid prefix_range value: \"%s\"", text_to_cstring(txt))));
   return pr;
 }
 
@@ -391,146 +323,6 @@ struct varlena *make_varlena(prefix_range *pr) {
   return NULL;
 }
 
-/*
- * Allow users to use length(prefix) rather than length(prefix::text), and
- * while at it, provides an implementation which won't count the displaying
- * artifacts that are the [] and -.
- */
-static inline
-int pr_length(prefix_range *pr) {
-  int len = strlen(pr->prefix);
-
-  if( pr->first != 0 || pr->last != 0 )
-    len += 1;
-
-  return len;
-}
-
-static inline
-bool pr_eq(prefix_range *a, prefix_range *b) {
-  int sa = strlen(a->prefix);
-  int sb = strlen(b->prefix);
-
-  return sa == sb
-    && memcmp(a->prefix, b->prefix, sa) == 0
-    && a->first == b->first
-    && a->last  == b->last;
-}
-
-/*
- * We invent a prefix_range ordering for convenience, but that's
- * dangerous. Use the BTree opclass at your own risk.
- *
- * On the other hand, when your routing table does contain pretty static
- * data and you test it carefully or know it will fit into the ordering
- * simplification, you're good to go.
- *
- * Baring bug, the constraint is to have non-overlapping data.
- */
-
-/*static inline
-bool pr_lt(prefix_range *a, prefix_range *b, bool eqval) {
-*/
-
-static inline
-int pr_cmp(prefix_range *a, prefix_range *b) {
-  int cmp = 0;
-  int alen = strlen(a->prefix);
-  int blen = strlen(b->prefix);
-  int mlen = alen; /* minimum length */
-  char *p  = a->prefix;
-  char *q  = b->prefix;
-
-  /*
-   * First case, common prefix length
-   */
-  if( alen == blen ) {
-    cmp = memcmp(p, q, alen);
-
-    /* Uncommon prefix, easy to compare */
-    if( cmp != 0 )
-      return cmp;
-
-    /* Common prefix, check for (sub)ranges */
-    else
-      return (a->first == b->first) ? (a->last - b->last) : (a->first - b->first);
-  }
-
-  /* For memcmp() safety, we need the minimum length */
-  if( mlen > blen )
-    mlen = blen;
-
-  /*
-   * Don't forget we may have [x-y] prefix style, that's empty prefix, only range.
-   */
-  if( alen == 0 && a->first != 0 ) {
-    /* return (eqval ? (a->first <= q[0]) : (a->first < q[0])); */
-    return a->first - q[0];
-  }
-  else if( blen == 0 && b->first != 0 ) {
-    /* return (eqval ? (p[0] <= b->first) : (p[0] < b->first)); */
-    return p[0] - b->first;
-  }
-
-  /*
-   * General case
-   *
-   * When memcmp() on the shorter of p and q returns 0, that means they
-   * share a common prefix: avoid to say that '93' < '9377' and '9377' <
-   * '93'.
-   */
-  cmp = memcmp(p, q, mlen);
-
-  if( cmp == 0 )
-    /*
-     * we are comparing e.g. '1' and '12' (the shorter contains the
-     * smaller), so let's pretend '12' < '1' as it contains less elements.
-     */
-    return (alen == mlen) ? 1 : -1;
-
-  return cmp;
-}
-
-static inline
-bool pr_lt(prefix_range *a, prefix_range *b, bool eqval) {
-  int cmp = pr_cmp(a, b);
-  return eqval ? cmp <= 0 : cmp < 0;
-}
-
-static inline
-bool pr_gt(prefix_range *a, prefix_range *b, bool eqval) {
-  int cmp = pr_cmp(a, b);
-  return eqval ? cmp >= 0 : cmp > 0;
-}
-
-static inline
-bool pr_contains(prefix_range *left, prefix_range *right, bool eqval) {
-  int sl;
-  int sr;
-  bool left_prefixes_right;
-
-  if( pr_eq(left, right) )
-    return eqval;
-
-  sl = strlen(left->prefix);
-  sr = strlen(right->prefix);
-
-  if( sr < sl )
-    return false;
-
-  left_prefixes_right = memcmp(left->prefix, right->prefix, sl) == 0;
-
-  if( left_prefixes_right ) {
-    if( sl == sr )
-      return left->first == 0 ||
-	(left->first <= right->first && left->last >= right->last);
-
-    return left->first == 0 ||
-      (left->first <= right->prefix[sl] && right->prefix[sl] <= left->last);
-  }
-  return false;
-}
-
 /**
  * does a given prefix_range includes a given prefix?
  */
@@ -556,159 +348,174 @@ bool pr_contains_prefix(prefix_range *pr, text *query, bool eqval) {
   return false;
 }
 
-static
-prefix_range *pr_union(prefix_range *a, prefix_range *b) {
-  prefix_range *res = NULL;
-  int alen = strlen(a->prefix);
-  int blen = strlen(b->prefix);
-  char *gp = NULL;
-  int gplen;
-  char min, max;
+/**
+ * In-memory trie of prefix_range values.
+ *
+ * Each node is reached by the characters of a prefix, and holds the
+ * entries whose prefix ends there: a plain prefix '0146' and a range
+ * '0146[2-5]' both live in the node reached by '0146'. Walking the
+ * trie along a number hence visits every entry that may contain it,
+ * in O(number length), whatever the number of entries.
+ *
+ * Children are kept in a sorted array of labels so that telephony
+ * tries (at most 10 children per node) stay compact.
+ */
+typedef struct pr_trie_entry
+{
+  prefix_range          *pr;        /* the entry, not copied */
+  void                  *data;      /* the caller's payload */
+  struct pr_trie_entry  *next;      /* next entry in the same node */
+} pr_trie_entry;
 
-  if( 0 == alen && 0 == blen ) {
-    res = build_pr("",
-		   a->first <= b->first ? a->first : b->first,
-		   a->last  >= b->last  ? a->last : b->last);
-    return pr_normalize(res);
-  }
+typedef struct pr_trie_node
+{
+  unsigned char          *labels;   /* sorted children labels */
+  struct pr_trie_node   **children;
+  int                     nchildren;
+  int                     maxchildren;
+  pr_trie_entry          *entries;
+  void                   *data;     /* per node payload, see prefix_rollup */
+} pr_trie_node;
+
+typedef struct pr_trie
+{
+  pr_trie_node  *root;
+  int            nnodes;
+  int            nentries;
+  int            maxdepth;          /* length of the longest prefix */
+} pr_trie;
 
-  gp = __greater_prefix(a->prefix, b->prefix, alen, blen);
-  gplen = strlen(gp);
+static inline
+pr_trie_node *pr_trie_node_create(pr_trie *trie) {
+  trie->nnodes++;
+  return (pr_trie_node *) palloc0(sizeof(pr_trie_node));
+}
 
-  if( gplen == 0 ) {
-    res = build_pr("", 0, 0);
-    if( alen > 0 && blen > 0 ) {
-      res->first = a->prefix[0];
-      res->last  = b->prefix[0];
-    }
-    else if( alen == 0 ) {
-      res->first = a->first <= b->prefix[0] ? a->first : b->prefix[0];
-      res->last  = a->last  >= b->prefix[0] ? a->last  : b->prefix[0];
-    }
-    else if( blen == 0 ) {
-      res->first = b->first <= a->prefix[0] ? b->first : a->prefix[0];
-      res->last  = b->last  >= a->prefix[0] ? b->last  : a->prefix[0];
-    }
-  }
-  else {
-    res = build_pr(gp, 0, 0);
+/**
+ * The trie and all its nodes are allocated in CurrentMemoryContext,
+ * callers reset or delete the context to get rid of it.
+ */
+static inline
+pr_trie *pr_trie_create(void) {
+  pr_trie *trie = (pr_trie *) palloc0(sizeof(pr_trie));
+  trie->root = pr_trie_node_create(trie);
+  return trie;
+}
 
-    if( gplen == alen && alen == blen ) {
-      res->first = a->first <= b->first ? a->first : b->first;
-      res->last  = a->last  >= b->last  ? a->last : b->last;
-    }
-    else if( gplen == alen ) {
-      Assert(alen < blen);
-      res->first = a->first <= b->prefix[alen] ? a->first : b->prefix[alen];
-      res->last  = a->last  >= b->prefix[alen] ? a->last  : b->prefix[alen];
-    }
-    else if( gplen == blen ) {
-      Assert(blen < alen);
-      res->first = b->first <= a->prefix[blen] ? b->first : a->prefix[blen];
-      res->last  = b->last  >= a->prefix[blen] ? b->last  : a->prefix[blen];
-    }
-    else {
-      Assert(gplen < alen && gplen < blen);
-      min = a->prefix[gplen];
-      max = b->prefix[gplen];
+/**
+ * Binary search for label in the node children, returns the child
+ * position when found, or the insertion point as -(pos + 1).
+ */
+static inline
+int pr_trie_child_pos(pr_trie_node *node, unsigned char label) {
+  int lo = 0, hi = node->nchildren - 1;
 
-      if( min > max ) {
-	min = b->prefix[gplen];
-	max = a->prefix[gplen];
-      }
-      res->first = min;
-      res->last  = max;
-#ifdef DEBUG_UNION
-    elog(NOTICE, "union a: %s %d %d", a->prefix, a->first, a->last);
-    elog(NOTICE, "union b: %s %d %d", b->prefix, b->first, b->last);
-    elog(NOTICE, "union r: %s %d %d", res->prefix, res->first, res->last);
-#endif
-    }
+  while( lo <= hi ) {
+    int mid = (lo + hi) / 2;
+
+    if( node->labels[mid] == label )
+      return mid;
+    else if( node->labels[mid] < label )
+      lo = mid + 1;
+    else
+      hi = mid - 1;
   }
-  return pr_normalize(res);
+  return -(lo + 1);
 }
 
 static inline
-prefix_range *pr_inter(prefix_range *a, prefix_range *b) {
-  prefix_range *res = NULL;
-  int alen = strlen(a->prefix);
-  int blen = strlen(b->prefix);
-  char *gp = NULL;
-  int gplen;
+pr_trie_node *pr_trie_child(pr_trie_node *node, unsigned char label) {
+  int pos = pr_trie_child_pos(node, label);
+  return pos >= 0 ? node->children[pos] : NULL;
+}
 
-  if( 0 == alen && 0 == blen ) {
-    res = build_pr("",
-		   a->first > b->first ? a->first : b->first,
-		   a->last  < b->last  ? a->last  : b->last);
-    return pr_normalize(res);
-  }
+static inline
+pr_trie_node *pr_trie_add_child(pr_trie *trie,
+				pr_trie_node *node, unsigned char label) {
+  int pos = pr_trie_child_pos(node, label);
 
-  gp = __greater_prefix(a->prefix, b->prefix, alen, blen);
-  gplen = strlen(gp);
+  if( pos >= 0 )
+    return node->children[pos];
 
-  if( gplen != alen && gplen != blen ) {
-    return build_pr("", 0, 0);
-  }
+  pos = -(pos + 1);
 
-  if( gplen == alen && 0 == alen ) {
-    if( a->first <= b->prefix[0] && b->prefix[0] <= a->last ) {
-      res = build_pr(b->prefix, b->first, b->last);
+  if( node->nchildren == node->maxchildren ) {
+    if( node->maxchildren == 0 ) {
+      node->maxchildren = 4;
+      node->labels   = (unsigned char *) palloc(node->maxchildren);
+      node->children = (pr_trie_node **)
+	palloc(node->maxchildren * sizeof(pr_trie_node *));
     }
-    else
-      res = build_pr("", 0, 0);
-  }
-  else if( gplen == blen && 0 == blen ) {
-    if( b->first <= a->prefix[0] && a->prefix[0] <= b->last ) {
-      res = build_pr(a->prefix, a->first, a->last);
+    else {
+      node->maxchildren *= 2;
+      node->labels   = (unsigned char *)
+	repalloc(node->labels, node->maxchildren);
+      node->children = (pr_trie_node **)
+	repalloc(node->children, node->maxchildren * sizeof(pr_trie_node *));
     }
-    else
-      res = build_pr("", 0, 0);
   }
-  else if( gplen == alen && alen == blen ) {
-	  char first, last;
-
-	  if( a->first == 0 )
-		  first = b->first;
-	  else
-		  first = a->first > b->first ? a->first : b->first;
+  memmove(node->labels + pos + 1, node->labels + pos, node->nchildren - pos);
+  memmove(node->children + pos + 1, node->children + pos,
+	  (node->nchildren - pos) * sizeof(pr_trie_node *));
 
-	  if( a->last == 0 )
-		  last = b->last;
-	  else
-		  last = a->last  > b->last  ? b->last  : a->last;
+  node->labels[pos]   = label;
+  node->children[pos] = pr_trie_node_create(trie);
+  node->nchildren++;
 
-	  res = build_pr(gp, first, last);
-
-#ifdef DEBUG_INTER
-    elog(NOTICE, "inter a: %s %d %d", a->prefix, a->first, a->last);
-    elog(NOTICE, "inter b: %s %d %d", b->prefix, b->first, b->last);
-    elog(NOTICE, "inter r: %s %d %d", res->prefix, res->first, res->last);
-#endif
-  }
-  else if( gplen == alen ) {
-    Assert(gplen < blen);
-    res = build_pr(b->prefix, b->first, b->last);
-  }
-  else if( gplen == blen ) {
-    Assert(gplen < alen);
-    res = build_pr(a->prefix, a->first, a->last);
-  }
-
-  return pr_normalize(res);
+  return node->children[pos];
 }
 
 /**
- * true if ranges have at least one common element
+ * Register pr with its payload, pr is not copied.
  */
 static inline
-bool pr_overlaps(prefix_range *a, prefix_range *b) {
-  prefix_range *inter = pr_inter(a, b);
+pr_trie_node *pr_trie_insert(pr_trie *trie, prefix_range *pr, void *data) {
+  pr_trie_node *node = trie->root;
+  pr_trie_entry *entry;
+  int len = strlen(pr->prefix), i;
 
-  return strlen(inter->prefix) > 0 || (inter->first != 0 && inter->last != 0);
-}
+  for(i=0; i<len; i++)
+    node = pr_trie_add_child(trie, node, (unsigned char) pr->prefix[i]);
 
+  entry = (pr_trie_entry *) palloc(sizeof(pr_trie_entry));
+  entry->pr   = pr;
+  entry->data = data;
+  entry->next = node->entries;
+  node->entries = entry;
 
-PG_FUNCTION_INFO_V1(prefix_range_init);
+  trie->nentries++;
+  if( len > trie->maxdepth )
+    trie->maxdepth = len;
+
+  return node;
+}
+
+/**
+ * Fill path with the nodes reached by the successive characters of
+ * str, beginning with the root node, and return how many nodes have
+ * been found: path[d] is the node of the str prefix of length d.
+ *
+ * path must have room for len + 1 nodes.
+ */
+static inline
+int pr_trie_path(pr_trie *trie, const char *str, int len, pr_trie_node **path) {
+  pr_trie_node *node = trie->root;
+  int depth = 0;
+
+  path[depth++] = node;
+
+  while( depth <= len ) {
+    node = pr_trie_child(node, (unsigned char) str[depth-1]);
+
+    if( node == NULL )
+      break;
+    path[depth++] = node;
+  }
+  return depth;
+}
+
+
+PG_FUNCTION_INFO_V1(prefix_range_init);
 Datum
 prefix_range_init(PG_FUNCTION_ARGS)
 {
@@ -746,10 +553,10 @@ Datum
 prefix_range_in(PG_FUNCTION_ARGS)
 {
     char *str = PG_GETARG_CSTRING(0);
-    prefix_range *pr = pr_from_str(str);
+    struct varlena *vdat = pr_parse(str);
 
-    if (pr != NULL) {
-      PG_RETURN_PREFIX_RANGE_P(pr);
+    if (vdat != NULL) {
+      PG_RETURN_POINTER(vdat);
     }
 
     ereport(ERROR,
@@ -764,17 +571,102 @@ Datum
 prefix_range_out(PG_FUNCTION_ARGS)
 {
   prefix_range *pr = PG_GETARG_PREFIX_RANGE_P(0);
-  char *out = NULL;
+  int len = strlen(pr->prefix);
+  char *out = (char *) palloc(len + (pr->first ? 6 : 1));
+  char *ptr = out + len;
+
+  memcpy(out, pr->prefix, len);
 
   if( pr->first ) {
-    out = (char *)palloc((strlen(pr->prefix)+6) * sizeof(char));
-    sprintf(out, "%s[%c-%c]", pr->prefix, pr->first, pr->last);
+    *ptr++ = PR_OPEN;
+    *ptr++ = pr->first;
+    *ptr++ = PR_SEP;
+    *ptr++ = pr->last;
+    *ptr++ = PR_CLOSE;
+  }
+  *ptr = 0;
+
+  PG_RETURN_CSTRING(out);
+}
+
+/**
+ * Binary format, version 1: a format byte, the range bounds, then the
+ * prefix, whose length is what's left in the message:
+ *
+ *   PR_WIRE_TEXT    first last prefix
+ *   PR_WIRE_DIGITS  first last digits
+ *
+ * where digits packs the prefix two digits a byte, high nibble first,
+ * with a 0xF nibble padding an odd count.
+ *
+ * The former format, first last prefix '\0', is still received: its
+ * first byte is a range bound, either 0 or a printable character.
+ */
+#define PR_WIRE_TEXT    0x01
+#define PR_WIRE_DIGITS  0x02
+
+static inline
+void pr_wire_invalid(void) {
+  ereport(ERROR,
+	  (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+	   errmsg("invalid prefix_range binary value")));
+}
+
+/*
+ * Validate, normalize and build the prefix_range datum in a single
+ * allocation, laid out as make_varlena() does.
+ */
+static struct varlena *
+pr_wire_varlena(int format, const char *data, int len, char first, char last) {
+  int maxlen = (format == PR_WIRE_DIGITS ? 2 * len : len) + 1;
+  struct varlena *vdat;
+  prefix_range *pr;
+  int i, n = 0;
+
+  if( (first == 0) != (last == 0) )
+    pr_wire_invalid();
+
+  vdat = palloc0(VARHDRSZ + sizeof(prefix_range) + maxlen);
+  pr   = (prefix_range *) VARDATA(vdat);
+
+  if( format == PR_WIRE_DIGITS ) {
+    for(i=0; i<len; i++) {
+      unsigned char hi = ((unsigned char) data[i]) >> 4;
+      unsigned char lo = ((unsigned char) data[i]) & 0x0F;
+
+      if( hi > 9 || (lo > 9 && (lo != 0x0F || i != len - 1)) )
+	pr_wire_invalid();
+
+      pr->prefix[n++] = '0' + hi;
+      if( lo <= 9 )
+	pr->prefix[n++] = '0' + lo;
+    }
   }
   else {
-    out = (char *)palloc((strlen(pr->prefix)+1) * sizeof(char));
-    sprintf(out, "%s", pr->prefix);
+    if( memchr(data, 0, len) != NULL )
+      pr_wire_invalid();
+
+    memcpy(pr->prefix, data, len);
+    n = len;
   }
-  PG_RETURN_CSTRING(out);
+
+  /* abc[x-x] is abcx, abc[y-x] is abc[x-y], as in pr_normalize() */
+  if( first != 0 && first == last ) {
+    pr->prefix[n++] = first;
+    first = last = 0;
+  }
+  else if( first > last ) {
+    char swap = first;
+
+    first = last;
+    last  = swap;
+  }
+  pr->first = first;
+  pr->last  = last;
+  pr->prefix[n] = 0;
+
+  SET_VARSIZE(vdat, VARHDRSZ + sizeof(prefix_range) + n + 1);
+  return vdat;
 }
 
 PG_FUNCTION_INFO_V1(prefix_range_recv);
@@ -782,13 +674,37 @@ Datum
 prefix_range_recv(PG_FUNCTION_ARGS)
 {
     StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
-    const char *first = pq_getmsgbytes(buf, 1);
-    const char *last  = pq_getmsgbytes(buf, 1);
-    const char *prefix = pq_getmsgstring(buf);
-    prefix_range *pr = build_pr(prefix, *first, *last);
-
+    int format = pq_getmsgbyte(buf);
+    char first, last;
+    const char *data;
+    char *converted;
+    int len;
+
+    if( format == PR_WIRE_TEXT || format == PR_WIRE_DIGITS ) {
+      first = (char) pq_getmsgbyte(buf);
+      last  = (char) pq_getmsgbyte(buf);
+      len   = buf->len - buf->cursor;
+      data  = pq_getmsgbytes(buf, len);
+
+      if( format == PR_WIRE_TEXT ) {
+	converted = pg_client_to_server(data, len);
+
+	if( converted != data ) {
+	  data = converted;
+	  len  = strlen(converted);
+	}
+      }
+    }
+    else {
+      first  = (char) format;
+      last   = (char) pq_getmsgbyte(buf);
+      data   = pq_getmsgstring(buf);
+      len    = strlen(data);
+      format = PR_WIRE_TEXT;
+    }
     pq_getmsgend(buf);
-    PG_RETURN_PREFIX_RANGE_P(pr);
+
+    PG_RETURN_POINTER(pr_wire_varlena(format, data, len, first, last));
 }
 
 PG_FUNCTION_INFO_V1(prefix_range_send);
@@ -796,12 +712,23 @@ Datum
 prefix_range_send(PG_FUNCTION_ARGS)
 {
     prefix_range *pr = PG_GETARG_PREFIX_RANGE_P(0);
+    int len = strlen(pr->prefix);
+    bool digits = len > 0 && pr_all_digits(pr->prefix, len);
     StringInfoData buf;
+    int i;
 
     pq_begintypsend(&buf);
+    pq_sendbyte(&buf, digits ? PR_WIRE_DIGITS : PR_WIRE_TEXT);
     pq_sendbyte(&buf, pr->first);
     pq_sendbyte(&buf, pr->last);
-    pq_sendstring(&buf, pr->prefix);
+
+    if( digits ) {
+      for(i=0; i<len; i+=2)
+	pq_sendbyte(&buf, ((pr->prefix[i] - '0') << 4)
+		    | (i + 1 < len ? pr->prefix[i + 1] - '0' : 0x0F));
+    }
+    else
+      pq_sendtext(&buf, pr->prefix, len);
 
     PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
 }
@@ -945,6 +872,35 @@ prefix_range_contained_by_strict(PG_FUNCTION_ARGS)
 			      false ));
 }
 
+/**
+ * prefix_range @> text and text <@ prefix_range, so that number columns
+ * don't need to be casted, which allows to index them, see
+ * prefix_range_support().
+ *
+ * A number that is not a valid prefix_range is contained in no prefix,
+ * rather than an error: a btree index scan never visits it, and the
+ * result must not depend on the plan.
+ */
+PG_FUNCTION_INFO_V1(prefix_range_contains_text);
+Datum
+prefix_range_contains_text(PG_FUNCTION_ARGS)
+{
+  prefix_range *number = pr_try_from_text(PG_GETARG_TEXT_PP(1));
+
+  PG_RETURN_BOOL( number != NULL
+		  && pr_contains(PG_GETARG_PREFIX_RANGE_P(0), number, true) );
+}
+
+PG_FUNCTION_INFO_V1(text_contained_by_prefix_range);
+Datum
+text_contained_by_prefix_range(PG_FUNCTION_ARGS)
+{
+  prefix_range *number = pr_try_from_text(PG_GETARG_TEXT_PP(0));
+
+  PG_RETURN_BOOL( number != NULL
+		  && pr_contains(PG_GETARG_PREFIX_RANGE_P(1), number, true) );
+}
+
 PG_FUNCTION_INFO_V1(prefix_range_union);
 Datum
 prefix_range_union(PG_FUNCTION_ARGS)
@@ -961,6 +917,180 @@ prefix_range_inter(PG_FUNCTION_ARGS)
 				     PG_GETARG_PREFIX_RANGE_P(1)) );
 }
 
+/**
+ * Equal prefix_range values share the same representation, so that we
+ * can hash the first and last components together with the prefix.
+ */
+PG_FUNCTION_INFO_V1(prefix_range_hash);
+Datum
+prefix_range_hash(PG_FUNCTION_ARGS)
+{
+  prefix_range *pr = PG_GETARG_PREFIX_RANGE_P(0);
+
+  return hash_any((unsigned char *) pr,
+		  offsetof(prefix_range, prefix) + strlen(pr->prefix));
+}
+
+/**
+ * prefix_range ~= prefix_range tells whether both values have the same
+ * prefix, whatever their [x-y] ranges. It's the equality of
+ * hash_prefix_range_prefix_ops, whose hash only covers the prefix: any
+ * prefix_range containing a value has the same prefix as one of the
+ * value's truncations, so that probing those finds them all, see
+ * prefix_range_support().
+ */
+PG_FUNCTION_INFO_V1(prefix_range_same_prefix);
+Datum
+prefix_range_same_prefix(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL( strcmp(PG_GETARG_PREFIX_RANGE_P(0)->prefix,
+			 PG_GETARG_PREFIX_RANGE_P(1)->prefix) == 0 );
+}
+
+PG_FUNCTION_INFO_V1(prefix_range_prefix_hash);
+Datum
+prefix_range_prefix_hash(PG_FUNCTION_ARGS)
+{
+  prefix_range *pr = PG_GETARG_PREFIX_RANGE_P(0);
+
+  return hash_any((unsigned char *) pr->prefix, strlen(pr->prefix));
+}
+
+/**
+ * The candidates of a prefix_range are the values that may contain it,
+ * longest first: its truncations, down to the empty prefix, and when
+ * asked for, the ranges around each of its characters.
+ *
+ * Ranges are only enumerated within the character class (digits, lower
+ * case or upper case letters) of the character they cover, that's
+ * [0-9] for phone numbers, and at most 29 ranges per digit. Ranges such
+ * as [0-z] or over punctuation are not enumerated, so the truncations
+ * are the only complete part of the candidates.
+ */
+static inline
+bool pr_char_class(char c, char *lo, char *hi) {
+  if( c >= '0' && c <= '9' ) {
+    *lo = '0';
+    *hi = '9';
+  }
+  else if( c >= 'a' && c <= 'z' ) {
+    *lo = 'a';
+    *hi = 'z';
+  }
+  else if( c >= 'A' && c <= 'Z' ) {
+    *lo = 'A';
+    *hi = 'Z';
+  }
+  else
+    return false;
+
+  return true;
+}
+
+static inline
+int pr_candidates(prefix_range *pr, bool ranges, Datum **result) {
+  int len = strlen(pr->prefix), k, n = 0, max = 2 * (len + 1);
+  char *buf = (char *) palloc(len + 1);
+  Datum *elems = (Datum *) palloc(max * sizeof(Datum));
+
+  memcpy(buf, pr->prefix, len + 1);
+
+  for(k=len; k>=0; k--) {
+    char first, last, lo, hi;
+
+    buf[k] = 0;
+
+    if( k == len ) {
+      first = pr->first;
+      last  = pr->last;
+    }
+    else
+      first = last = pr->prefix[k];
+
+    if( first != 0 && ranges
+	&& pr_char_class(first, &lo, &hi) && last >= lo && last <= hi ) {
+      int a, b;
+
+      for(a=lo; a<=first; a++) {
+	for(b=last; b<=hi; b++) {
+	  if( a == b )
+	    continue;
+
+	  if( n == max ) {
+	    max *= 2;
+	    elems = (Datum *) repalloc(elems, max * sizeof(Datum));
+	  }
+	  elems[n++] = PrefixRangeGetDatum(build_pr(buf, a, b));
+	}
+      }
+    }
+    else if( k == len && first != 0 )
+      elems[n++] = PrefixRangeGetDatum(build_pr(buf, first, last));
+
+    if( n == max ) {
+      max *= 2;
+      elems = (Datum *) repalloc(elems, max * sizeof(Datum));
+    }
+    elems[n++] = PrefixRangeGetDatum(build_pr(buf, 0, 0));
+  }
+  pfree(buf);
+
+  *result = elems;
+  return n;
+}
+
+/**
+ * prefix_candidates(prefix_range, ranges bool) returns prefix_range[]
+ *
+ * Any prefix_range containing the argument has the same prefix as one
+ * of the resulting array elements, allowing hash_prefix_range_prefix_ops
+ * indexes to answer @> queries with a probe per element, see
+ * prefix_range_support().
+ */
+PG_FUNCTION_INFO_V1(prefix_candidates);
+Datum
+prefix_candidates(PG_FUNCTION_ARGS)
+{
+  prefix_range *pr = PG_GETARG_PREFIX_RANGE_P(0);
+  bool ranges = PG_GETARG_BOOL(1);
+  Oid prtype = get_fn_expr_argtype(fcinfo->flinfo, 0);
+  Datum *elems;
+  int n;
+
+  if( !OidIsValid(prtype) )
+    ereport(ERROR,
+	    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	     errmsg("could not determine the prefix_range type")));
+
+  n = pr_candidates(pr, ranges, &elems);
+
+  PG_RETURN_ARRAYTYPE_P(construct_array(elems, n, prtype, -1, false, 'i'));
+}
+
+/**
+ * prefix_key(prefix_range, len int) returns text
+ *
+ * The first len characters of the prefix, without its [x-y] range, to
+ * partition prefix tables by: a prefix_range containing a number has
+ * the key of one of its truncations, so that prefix_range_support()
+ * prunes the partitions for @> queries.
+ */
+PG_FUNCTION_INFO_V1(prefix_key);
+Datum
+prefix_key(PG_FUNCTION_ARGS)
+{
+  prefix_range *pr = PG_GETARG_PREFIX_RANGE_P(0);
+  int32 len = PG_GETARG_INT32(1);
+
+  if( len < 0 )
+    ereport(ERROR,
+	    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+	     errmsg("prefix_key length must not be negative")));
+
+  PG_RETURN_TEXT_P(cstring_to_text_with_len(pr->prefix,
+					    Min(len, (int32) strlen(pr->prefix))));
+}
+
 /**
  * GiST support methods
  *
@@ -984,6 +1114,7 @@ Datum pr_penalty(PG_FUNCTION_ARGS);
   OPERATOR	2	<@,
   OPERATOR	3	=,
   OPERATOR	4	&&,
+  OPERATOR	5	@>(prefix_range, text),
 */
 static inline
 bool pr_consistent(StrategyNumber strategy,
@@ -1040,11 +1171,23 @@ Datum
 gpr_consistent(PG_FUNCTION_ARGS)
 {
     GISTENTRY *entry = (GISTENTRY *) PG_GETARG_POINTER(0);
-    prefix_range *query = PG_GETARG_PREFIX_RANGE_P(1);
     StrategyNumber strategy = (StrategyNumber) PG_GETARG_UINT16(2);
     prefix_range *key = DatumGetPrefixRange(entry->key);
+    prefix_range *query;
     bool *recheck;
 
+    /*
+     * Strategy 5 is @> with a text query, that we process as @>. An
+     * invalid number is contained in no prefix, see
+     * prefix_range_contains_text().
+     */
+    if( strategy == 5 ) {
+      query = pr_try_from_text(PG_GETARG_TEXT_PP(1));
+      strategy = 1;
+    }
+    else
+      query = PG_GETARG_PREFIX_RANGE_P(1);
+
     Assert( PG_NARGS() == 4 || PG_NARGS() == 5);
 
     if( PG_NARGS() == 5 ) {
@@ -1058,155 +1201,43 @@ gpr_consistent(PG_FUNCTION_ARGS)
       recheck  = (bool *) PG_GETARG_POINTER(4);
       *recheck = false;
     }
+    if( query == NULL )
+      PG_RETURN_BOOL(false);
+
     PG_RETURN_BOOL( pr_consistent(strategy, key, query, GIST_LEAF(entry)) );
 }
 
 /*
- * GiST Compress and Decompress methods for prefix_range
- * do not do anything.
+ * GiST Compress and Decompress methods for prefix_range only
+ * decompress the keys that are compressed or toasted: the others,
+ * including the short header ones, are used as they are.
  */
+static GISTENTRY *
+gpr_detoast_entry(GISTENTRY *entry) {
+  struct varlena *key = PG_DETOAST_DATUM_PACKED(entry->key);
+
+  if( key != (struct varlena *) DatumGetPointer(entry->key) ) {
+    GISTENTRY *retval = (GISTENTRY *) palloc(sizeof(GISTENTRY));
+
+    gistentryinit(*retval, PointerGetDatum(key),
+		  entry->rel, entry->page, entry->offset, entry->leafkey);
+    return retval;
+  }
+  return entry;
+}
+
 PG_FUNCTION_INFO_V1(gpr_compress);
 Datum
 gpr_compress(PG_FUNCTION_ARGS)
 {
-    PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+    PG_RETURN_POINTER(gpr_detoast_entry((GISTENTRY *) PG_GETARG_POINTER(0)));
 }
 
 PG_FUNCTION_INFO_V1(gpr_decompress);
 Datum
 gpr_decompress(PG_FUNCTION_ARGS)
 {
-    PG_RETURN_POINTER(PG_GETARG_POINTER(0));
-}
-
-static
-float __pr_penalty(prefix_range *orig, prefix_range *new)
-{
-  float penalty;
-  char *gp;
-  int  nlen, olen, gplen, dist = 0;
-  char tmp;
-
-#ifdef DEBUG_PENALTY
-  if( orig->prefix[0] != 0 ) {
-    /**
-     * The prefix main test case deals with phone number data, hence
-     * containing only numbers...
-     */
-    if( orig->prefix[0] < '0' || orig->prefix[0] > '9' )
-      elog(NOTICE, "__pr_penalty(%s, %s) orig->first=%d orig->last=%d ",
-	   DatumGetCString(DirectFunctionCall1(prefix_range_out,PrefixRangeGetDatum(orig))),
-	   DatumGetCString(DirectFunctionCall1(prefix_range_out,PrefixRangeGetDatum(new))),
-	   orig->first, orig->last);
-    Assert(orig->prefix[0] >= '0' && orig->prefix[0] <= '9');
-  }
-#endif
-
-  olen  = strlen(orig->prefix);
-  nlen  = strlen(new->prefix);
-  gp    = __greater_prefix(orig->prefix, new->prefix, olen, nlen);
-  gplen = strlen(gp);
-
-  dist  = 1;
-
-  if( 0 == olen && 0 == nlen ) {
-    if( orig->last >= new->first )
-      dist = 0;
-    else
-      dist = new->first - orig->last;
-  }
-  else if( 0 == olen ) {
-    /**
-     * penalty('[a-b]', 'xyz');
-     */
-    if( orig->first != 0 ) {
-      tmp = new->prefix[0];
-
-      if( orig->first <= tmp && tmp <= orig->last ) {
-	gplen = 1;
-
-	dist = 1 + (int)tmp - (int)orig->first;
-	if( (1 + (int)orig->last - (int)tmp) < dist )
-	  dist = 1 + (int)orig->last - (int)tmp;
-      }
-      else
-	dist = (orig->first > tmp ? orig->first - tmp  : tmp - orig->last );
-    }
-  }
-  else if( 0 == nlen ) {
-    /**
-     * penalty('abc', '[x-y]');
-     */
-    if( new->first != 0 ) {
-      tmp = orig->prefix[0];
-
-      if( new->first <= tmp && tmp <= new->last ) {
-	gplen = 1;
-
-	dist = 1 + (int)tmp - (int)new->first;
-	if( (1 + (int)new->last - (int)tmp) < dist )
-	  dist = 1 + (int)new->last - (int)tmp;
-      }
-      else
-	dist = (new->first > tmp ? new->first - tmp  : tmp - new->last );
-    }
-  }
-  else {
-    /**
-     * General case
-     */
-
-    if( gplen > 0 ) {
-      if( olen > gplen && nlen == gplen && new->first != 0 ) {
-	/**
-	 * gpr_penalty('abc[f-l]', 'ab[x-y]')
-	 */
-	if( new->first <= orig->prefix[gplen]
-	    && orig->prefix[gplen] <= new->last ) {
-
-	  dist   = 1 + (int)orig->prefix[gplen] - (int)new->first;
-	  if( (1 + (int)new->last - (int)orig->prefix[gplen]) < dist )
-	    dist = 1 + (int)new->last - (int)orig->prefix[gplen];
-
-	  gplen += 1;
-	}
-	else {
-	  dist += 1;
-	}
-      }
-      else if( nlen > gplen && olen == gplen && orig->first != 0 ) {
-	/**
-	 * gpr_penalty('ab[f-l]', 'abc[x-y]')
-	 */
-	if( orig->first <= new->prefix[gplen]
-	    && new->prefix[gplen] <= orig->last ) {
-
-	  dist   = 1 + (int)new->prefix[gplen] - (int)orig->first;
-	  if( (1 + (int)orig->last - (int)new->prefix[gplen]) < dist )
-	    dist = 1 + (int)orig->last - (int)new->prefix[gplen];
-
-	  gplen += 1;
-	}
-	else {
-	  dist += 1;
-	}
-      }
-    }
-    /**
-     * penalty('abc[f-l]', 'xyz[g-m]'), nothing common
-     * dist = 1, gplen = 0, penalty = 1
-     */
-  }
-  penalty = (((float)dist) / powf(256, gplen));
-
-#ifdef DEBUG_PENALTY
-  elog(NOTICE, "__pr_penalty(%s, %s) == %d/(256^%d) == %g",
-       DatumGetCString(DirectFunctionCall1(prefix_range_out,PrefixRangeGetDatum(orig))),
-       DatumGetCString(DirectFunctionCall1(prefix_range_out,PrefixRangeGetDatum(new))),
-       dist, gplen, penalty);
-#endif
-
-  return penalty;
+    PG_RETURN_POINTER(gpr_detoast_entry((GISTENTRY *) PG_GETARG_POINTER(0)));
 }
 
 PG_FUNCTION_INFO_V1(gpr_penalty);
@@ -1235,8 +1266,7 @@ pr_penalty(PG_FUNCTION_ARGS)
 
 /*
  * That's an experimental feature, only used in the
- * gist_prefix_range_jordan_ops opclass, which is not talked about in the
- * user documentation of the module.
+ * gist_prefix_range_jordan_ops opclass, see prefix_picksplit_stats().
  */
 static int gpr_cmp(const void *a, const void *b) {
   GISTENTRY **e1 = (GISTENTRY **)a;
@@ -1259,7 +1289,6 @@ gpr_picksplit_jordan(PG_FUNCTION_ARGS)
 {
     GistEntryVector *entryvec = (GistEntryVector *) PG_GETARG_POINTER(0);
     OffsetNumber maxoff = entryvec->n - 1;
-    GISTENTRY *ent      = entryvec->vector;
     GIST_SPLITVEC *v = (GIST_SPLITVEC *) PG_GETARG_POINTER(1);
 
     int	i, nbytes;
@@ -1286,7 +1315,7 @@ gpr_picksplit_jordan(PG_FUNCTION_ARGS)
     unionR = NULL;
 
     /* Initialize the raw entry vector. */
-    raw_entryvec = (GISTENTRY **) malloc(entryvec->n * sizeof(void *));
+    raw_entryvec = (GISTENTRY **) palloc(entryvec->n * sizeof(void *));
     for (i=FirstOffsetNumber; i <= maxoff; i=OffsetNumberNext(i))
       raw_entryvec[i] = &(entryvec->vector[i]);
 
@@ -1301,8 +1330,8 @@ gpr_picksplit_jordan(PG_FUNCTION_ARGS)
     cut = maxoff / 2;
     cut_tolerance = cut / 2;
     for (i=cut - 1; i > FirstOffsetNumber; i=OffsetNumberPrev(i)) {
-      tmp_union = pr_union(DatumGetPrefixRange(ent[i].key),
-			   DatumGetPrefixRange(ent[i+1].key));
+      tmp_union = pr_union(DatumGetPrefixRange(raw_entryvec[i]->key),
+			   DatumGetPrefixRange(raw_entryvec[i+1]->key));
 
       if( strlen(tmp_union->prefix) == 0 )
 	break;
@@ -1314,8 +1343,8 @@ gpr_picksplit_jordan(PG_FUNCTION_ARGS)
      * upper-index of the first group.
      */
     for (i=1 + cut; i < maxoff; i=OffsetNumberNext(i)) {
-      tmp_union = pr_union(DatumGetPrefixRange(ent[i].key),
-			   DatumGetPrefixRange(ent[i-1].key));
+      tmp_union = pr_union(DatumGetPrefixRange(raw_entryvec[i]->key),
+			   DatumGetPrefixRange(raw_entryvec[i-1]->key));
 
       if( strlen(tmp_union->prefix) == 0 )
 	break;
@@ -1408,7 +1437,7 @@ OffsetNumber *pr_presort(GistEntryVector *list)
   OffsetNumber i, u;
 
   int result_it, result_it_maxes = FirstOffsetNumber;
-  OffsetNumber *result = (OffsetNumber *) malloc(list->n * sizeof(OffsetNumber));
+  OffsetNumber *result = (OffsetNumber *) palloc(list->n * sizeof(OffsetNumber));
 
 #ifdef DEBUG_PRESORT_MAX
 #define DEBUG_COUNT
@@ -1629,10 +1658,12 @@ Datum pr_picksplit(GistEntryVector *entryvec, GIST_SPLITVEC *v, bool presort) {
      */
     float pll, plr, prl, prr;
 
-#ifdef DEBUG_PICKSPLIT
     OffsetNumber i;
-#endif
 
+    /**
+     * With presort, offl and offr walk the presorted order, and sort
+     * maps them back to the entries offsets.
+     */
     if( presort ) {
       sort = pr_presort(entryvec);
 
@@ -1642,6 +1673,12 @@ Datum pr_picksplit(GistEntryVector *entryvec, GIST_SPLITVEC *v, bool presort) {
       }
 #endif
     }
+    else {
+      sort = (OffsetNumber *) palloc((maxoff + 1) * sizeof(OffsetNumber));
+
+      for(i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
+	sort[i] = i;
+    }
 
     nbytes = (maxoff + 1) * sizeof(OffsetNumber);
     listL = (OffsetNumber *) palloc(nbytes);
@@ -1653,11 +1690,11 @@ Datum pr_picksplit(GistEntryVector *entryvec, GIST_SPLITVEC *v, bool presort) {
     offl = FirstOffsetNumber;
     offr = maxoff;
 
-    unionL = DatumGetPrefixRange(ent[offl].key);
-    unionR = DatumGetPrefixRange(ent[offr].key);
+    unionL = DatumGetPrefixRange(ent[sort[offl]].key);
+    unionR = DatumGetPrefixRange(ent[sort[offr]].key);
 
-    v->spl_left[v->spl_nleft++]   = offl;
-    v->spl_right[v->spl_nright++] = offr;
+    v->spl_left[v->spl_nleft++]   = sort[offl];
+    v->spl_right[v->spl_nright++] = sort[offr];
     v->spl_left  = listL;
     v->spl_right = listR;
 
@@ -1666,14 +1703,8 @@ Datum pr_picksplit(GistEntryVector *entryvec, GIST_SPLITVEC *v, bool presort) {
 
     while( offl < offr ) {
 
-      if( presort ) {
-	curl = DatumGetPrefixRange(ent[sort[offl]].key);
-	curr = DatumGetPrefixRange(ent[sort[offr]].key);
-      }
-      else {
-	curl = DatumGetPrefixRange(ent[offl].key);
-	curr = DatumGetPrefixRange(ent[offr].key);
-      }
+      curl = DatumGetPrefixRange(ent[sort[offl]].key);
+      curr = DatumGetPrefixRange(ent[sort[offr]].key);
 
 #ifdef DEBUG_PICKSPLIT
       elog(NOTICE, "gpr_picksplit: ent[%3d] = '%s' \tent[%3d] = '%s'",
@@ -1701,8 +1732,8 @@ Datum pr_picksplit(GistEntryVector *entryvec, GIST_SPLITVEC *v, bool presort) {
 
 	  if( strlen(tmp_union->prefix) > 0 ) {
 	    unionL = pr_union(unionL, tmp_union);
-	    v->spl_left[v->spl_nleft++] = offl;
-	    v->spl_left[v->spl_nleft++] = offr;
+	    v->spl_left[v->spl_nleft++] = sort[offl];
+	    v->spl_left[v->spl_nleft++] = sort[offr];
 
 	    offl = OffsetNumberNext(offl);
 	    offr = OffsetNumberPrev(offr);
@@ -1715,8 +1746,8 @@ Datum pr_picksplit(GistEntryVector *entryvec, GIST_SPLITVEC *v, bool presort) {
 	unionL = pr_union(unionL, curl);
 	unionR = pr_union(unionR, curr);
 
-	v->spl_left[v->spl_nleft++]   = offl;
-	v->spl_right[v->spl_nright++] = offr;
+	v->spl_left[v->spl_nleft++]   = sort[offl];
+	v->spl_right[v->spl_nright++] = sort[offr];
 
 	offl = OffsetNumberNext(offl);
 	offr = OffsetNumberPrev(offr);
@@ -1726,7 +1757,7 @@ Datum pr_picksplit(GistEntryVector *entryvec, GIST_SPLITVEC *v, bool presort) {
 	 * Current rightmost entry is added to listL
 	 */
 	unionR = pr_union(unionR, curr);
-	v->spl_right[v->spl_nright++] = offr;
+	v->spl_right[v->spl_nright++] = sort[offr];
 	offr = OffsetNumberPrev(offr);
       }
       else if( pll <= plr && prl < prr ) {
@@ -1734,7 +1765,7 @@ Datum pr_picksplit(GistEntryVector *entryvec, GIST_SPLITVEC *v, bool presort) {
 	 * Current leftmost entry is added to listL
 	 */
 	unionL = pr_union(unionL, curl);
-	v->spl_left[v->spl_nleft++] = offl;
+	v->spl_left[v->spl_nleft++] = sort[offl];
 	offl = OffsetNumberNext(offl);
       }
       else if( (pll - plr) < (prr - prl) ) {
@@ -1742,9 +1773,9 @@ Datum pr_picksplit(GistEntryVector *entryvec, GIST_SPLITVEC *v, bool presort) {
 	 * All entries still in the list go into listL
 	 */
 	for(; offl <= offr; offl = OffsetNumberNext(offl)) {
-	  curl   = DatumGetPrefixRange(ent[offl].key);
+	  curl   = DatumGetPrefixRange(ent[sort[offl]].key);
 	  unionL = pr_union(unionL, curl);
-	  v->spl_left[v->spl_nleft++] = offl;
+	  v->spl_left[v->spl_nleft++] = sort[offl];
 	}
       }
       else {
@@ -1752,9 +1783,9 @@ Datum pr_picksplit(GistEntryVector *entryvec, GIST_SPLITVEC *v, bool presort) {
 	 * All entries still in the list go into listR
 	 */
 	for(; offr >= offl; offr = OffsetNumberPrev(offr)) {
-	  curr   = DatumGetPrefixRange(ent[offr].key);
+	  curr   = DatumGetPrefixRange(ent[sort[offr]].key);
 	  unionR = pr_union(unionR, curr);
-	  v->spl_right[v->spl_nright++] = offr;
+	  v->spl_right[v->spl_nright++] = sort[offr];
 	}
       }
     }
@@ -1765,20 +1796,20 @@ Datum pr_picksplit(GistEntryVector *entryvec, GIST_SPLITVEC *v, bool presort) {
      * where to add it.
      */
     if( offl == offr ) {
-      curl = DatumGetPrefixRange(ent[offl].key);
+      curl = DatumGetPrefixRange(ent[sort[offl]].key);
 
       pll  = __pr_penalty(unionL, curl);
       plr  = __pr_penalty(unionR, curl);
 
       if( pll < plr || (pll == plr && v->spl_nleft < v->spl_nright) ) {
-	curl       = DatumGetPrefixRange(ent[offl].key);
+	curl       = DatumGetPrefixRange(ent[sort[offl]].key);
 	unionL     = pr_union(unionL, curl);
-	v->spl_left[v->spl_nleft++] = offl;
+	v->spl_left[v->spl_nleft++] = sort[offl];
       }
       else {
-	curl       = DatumGetPrefixRange(ent[offl].key);
+	curl       = DatumGetPrefixRange(ent[sort[offl]].key);
 	unionR     = pr_union(unionR, curl);
-	v->spl_right[v->spl_nright++] = offl;
+	v->spl_right[v->spl_nright++] = sort[offl];
       }
     }
 
@@ -1789,7 +1820,7 @@ Datum pr_picksplit(GistEntryVector *entryvec, GIST_SPLITVEC *v, bool presort) {
      * All read entries (maxoff) should have make it to the
      * GIST_SPLITVEC return value.
      */
-    Assert(maxoff = v->spl_nleft+v->spl_nright);
+    Assert(maxoff == v->spl_nleft+v->spl_nright);
 
 #ifdef DEBUG_PICKSPLIT
     elog(NOTICE, "gpr_picksplit(): entryvec->n=%4d maxoff=%4d l=%4d r=%4d l+r=%4d unionL='%s' unionR='%s'",
@@ -1877,3 +1908,6159 @@ gpr_same(PG_FUNCTION_ARGS)
     *result = pr_eq(v1, v2);
     PG_RETURN_POINTER( result );
 }
+
+/**
+ * GIN support for text columns
+ *
+ * gin_prefix_text_ops indexes a number with all its prefixes, up to a
+ * maximum depth, so that number <@ prefix_range is answered by looking
+ * up the prefix_range as a prefix key: 0146[2-5] is looked up as the
+ * keys 01462, 01463, 01464 and 01465. Only when the query is longer
+ * than the indexed depth do we need to recheck the rows.
+ *
+ * Values with [x-y] ranges in them are not expected in number columns,
+ * but still supported: they are indexed with the empty key only, which
+ * all queries also look up and recheck.
+ *
+ * From PostgreSQL 13 on the depth is an operator class parameter:
+ *
+ *   create index on pool using gin(number gin_prefix_text_ops(depth = 8));
+ */
+#define PR_GIN_DEPTH 16
+
+Datum gin_prefix_text_extract_value(PG_FUNCTION_ARGS);
+Datum gin_prefix_text_extract_query(PG_FUNCTION_ARGS);
+Datum gin_prefix_text_consistent(PG_FUNCTION_ARGS);
+Datum gin_prefix_text_options(PG_FUNCTION_ARGS);
+
+#if PG_VERSION_NUM >= 130000
+typedef struct
+{
+  int32 vl_len_;    /* varlena header (do not touch directly!) */
+  int   depth;
+} pr_gin_options;
+#endif
+
+static inline
+int pr_gin_depth(FunctionCallInfo fcinfo) {
+#if PG_VERSION_NUM >= 130000
+  if( PG_HAS_OPCLASS_OPTIONS() )
+    return ((pr_gin_options *) PG_GET_OPCLASS_OPTIONS())->depth;
+#endif
+  return PR_GIN_DEPTH;
+}
+
+/*
+ * Is the query longer than the indexed keys?
+ */
+static inline
+bool pr_gin_truncated(prefix_range *pr, int depth) {
+  int len = strlen(pr->prefix);
+
+  return (pr->first == 0 ? len : len + 1) > depth;
+}
+
+PG_FUNCTION_INFO_V1(gin_prefix_text_extract_value);
+Datum
+gin_prefix_text_extract_value(PG_FUNCTION_ARGS)
+{
+  text *number  = PG_GETARG_TEXT_PP(0);
+  int32 *nkeys  = (int32 *) PG_GETARG_POINTER(1);
+  char *str     = VARDATA_ANY(number);
+  int len       = VARSIZE_ANY_EXHDR(number);
+  int depth     = pr_gin_depth(fcinfo);
+  Datum *keys;
+  int i;
+
+  if( memchr(str, PR_OPEN, len) != NULL || memchr(str, PR_CLOSE, len) != NULL ) {
+    keys = (Datum *) palloc(sizeof(Datum));
+    keys[0] = PointerGetDatum(cstring_to_text_with_len("", 0));
+    *nkeys = 1;
+
+    PG_RETURN_POINTER(keys);
+  }
+
+  if( len > depth )
+    len = depth;
+
+  keys = (Datum *) palloc(Max(len, 1) * sizeof(Datum));
+
+  for(i=0; i<len; i++)
+    keys[i] = PointerGetDatum(cstring_to_text_with_len(str, i + 1));
+
+  *nkeys = len;
+  PG_RETURN_POINTER(keys);
+}
+
+/*
+ * The last key is always the empty key, see above.
+ */
+PG_FUNCTION_INFO_V1(gin_prefix_text_extract_query);
+Datum
+gin_prefix_text_extract_query(PG_FUNCTION_ARGS)
+{
+  prefix_range *pr  = PG_GETARG_PREFIX_RANGE_P(0);
+  int32 *nkeys      = (int32 *) PG_GETARG_POINTER(1);
+  int32 *searchMode = (int32 *) PG_GETARG_POINTER(6);
+  int depth         = pr_gin_depth(fcinfo);
+  int len           = strlen(pr->prefix);
+  Datum *keys;
+  int n = 0;
+
+  /* the empty prefix contains any number */
+  if( len == 0 && pr->first == 0 ) {
+    *nkeys = 0;
+    *searchMode = GIN_SEARCH_MODE_ALL;
+    PG_RETURN_POINTER(NULL);
+  }
+
+  if( pr->first == 0 || pr_gin_truncated(pr, depth) ) {
+    keys = (Datum *) palloc(2 * sizeof(Datum));
+    keys[n++] = PointerGetDatum(cstring_to_text_with_len(pr->prefix,
+							  Min(len, depth)));
+  }
+  else {
+    char *buf = (char *) palloc(len + 1);
+    int c;
+
+    keys = (Datum *) palloc((UCHAR_MAX + 2) * sizeof(Datum));
+    memcpy(buf, pr->prefix, len);
+
+    for(c=(unsigned char) pr->first; c<=(unsigned char) pr->last; c++) {
+      buf[len] = (char) c;
+      keys[n++] = PointerGetDatum(cstring_to_text_with_len(buf, len + 1));
+    }
+  }
+  keys[n++] = PointerGetDatum(cstring_to_text_with_len("", 0));
+
+  *nkeys = n;
+  PG_RETURN_POINTER(keys);
+}
+
+PG_FUNCTION_INFO_V1(gin_prefix_text_consistent);
+Datum
+gin_prefix_text_consistent(PG_FUNCTION_ARGS)
+{
+  bool *check       = (bool *) PG_GETARG_POINTER(0);
+  prefix_range *pr  = PG_GETARG_PREFIX_RANGE_P(2);
+  int32 nkeys       = PG_GETARG_INT32(3);
+  bool *recheck     = (bool *) PG_GETARG_POINTER(5);
+  int i;
+
+  if( nkeys == 0 ) {
+    *recheck = false;
+    PG_RETURN_BOOL(true);
+  }
+
+  for(i=0; i<nkeys-1; i++) {
+    if( check[i] ) {
+      *recheck = pr_gin_truncated(pr, pr_gin_depth(fcinfo));
+      PG_RETURN_BOOL(true);
+    }
+  }
+
+  *recheck = true;
+  PG_RETURN_BOOL(check[nkeys-1]);
+}
+
+PG_FUNCTION_INFO_V1(gin_prefix_text_options);
+Datum
+gin_prefix_text_options(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM >= 130000
+  local_relopts *relopts = (local_relopts *) PG_GETARG_POINTER(0);
+
+  init_local_reloptions(relopts, sizeof(pr_gin_options));
+  add_local_int_reloption(relopts, "depth",
+			  "maximum length of the indexed prefixes",
+			  PR_GIN_DEPTH, 1, 256,
+			  offsetof(pr_gin_options, depth));
+  PG_RETURN_VOID();
+#else
+  ereport(ERROR,
+	  (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	   errmsg("operator class options need PostgreSQL 13 or later")));
+  PG_RETURN_VOID();
+#endif
+}
+
+/**
+ * Direct index lookups
+ *
+ * prefix_lookup(index regclass, number text) returns the row of the
+ * longest prefix_range containing number, probing the given
+ * gist_prefix_range_ops index directly rather than planning and
+ * executing a query:
+ *
+ *   select * from prefix_lookup('idx_prefix', '0146640123')
+ *         as t(prefix prefix_range, name text, shortname text, state text);
+ *
+ * The relations, the index scan and the slot are opened at first call
+ * and kept for the rest of the transaction: they live in
+ * TopTransactionContext, are owned by TopTransactionResourceOwner, and
+ * are closed at commit time.
+ */
+Datum prefix_lookup(PG_FUNCTION_ARGS);
+
+#if PG_VERSION_NUM >= 120000
+
+typedef struct
+{
+  Oid              indexoid;
+  Relation         index;
+  Relation         heap;
+  IndexScanDesc    scan;
+  TupleTableSlot  *slot;
+  AttrNumber       attnum;    /* heap attribute of the index key */
+  Oid              prtype;
+} pr_lookup_state;
+
+static pr_lookup_state *prefix_lookup_state = NULL;
+static bool prefix_lookup_callback = false;
+
+static void
+pr_lookup_close(void)
+{
+  pr_lookup_state *state = prefix_lookup_state;
+  ResourceOwner saved = CurrentResourceOwner;
+
+  prefix_lookup_state = NULL;
+
+  CurrentResourceOwner = TopTransactionResourceOwner;
+  index_endscan(state->scan);
+  ExecDropSingleTupleTableSlot(state->slot);
+  index_close(state->index, NoLock);
+  table_close(state->heap, NoLock);
+  CurrentResourceOwner = saved;
+
+  pfree(state);
+}
+
+/*
+ * At abort time the resource owner releases everything, and the memory
+ * is gone with TopTransactionContext.
+ */
+static void
+pr_lookup_xact_callback(XactEvent event, void *arg)
+{
+  if( prefix_lookup_state == NULL )
+    return;
+
+  switch( event ) {
+  case XACT_EVENT_PRE_COMMIT:
+  case XACT_EVENT_PARALLEL_PRE_COMMIT:
+  case XACT_EVENT_PRE_PREPARE:
+    pr_lookup_close();
+    break;
+
+  case XACT_EVENT_ABORT:
+  case XACT_EVENT_PARALLEL_ABORT:
+    prefix_lookup_state = NULL;
+    break;
+
+  default:
+    break;
+  }
+}
+
+/*
+ * Any GiST index using gpr_consistent, whatever the picksplit strategy
+ * of its opclass.
+ */
+static void
+pr_index_check(Relation index)
+{
+  if( index->rd_rel->relkind != RELKIND_INDEX
+      || index->rd_rel->relam != GIST_AM_OID
+      || index_getprocinfo(index, 1, GIST_CONSISTENT_PROC)->fn_addr != gpr_consistent ) {
+    char *name = pstrdup(RelationGetRelationName(index));
+
+    index_close(index, AccessShareLock);
+    ereport(ERROR,
+	    (errcode(ERRCODE_WRONG_OBJECT_TYPE),
+	     errmsg("index \"%s\" is not a gist_prefix_range_ops index", name)));
+  }
+}
+
+/*
+ * prefix_lookup() reads the table without going through the executor:
+ * check the SELECT privilege here, at each call as the current user may
+ * change within a transaction, and refuse the tables with row level
+ * security, whose policies would not apply.
+ */
+static void
+pr_lookup_check_access(Oid relid)
+{
+  AclResult aclresult;
+
+  aclresult = pg_class_aclcheck(relid, GetUserId(), ACL_SELECT);
+  if( aclresult != ACLCHECK_OK )
+    aclcheck_error(aclresult, OBJECT_TABLE, get_rel_name(relid));
+
+  if( check_enable_rls(relid, InvalidOid, false) == RLS_ENABLED )
+    ereport(ERROR,
+	    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	     errmsg("prefix_lookup() does not support row level security"),
+	     errdetail("Table \"%s\" has row level security enabled.",
+		       get_rel_name(relid))));
+}
+
+static pr_lookup_state *
+pr_lookup_open(Oid indexoid)
+{
+  pr_lookup_state *state;
+  Relation index;
+  MemoryContext oldcxt;
+  ResourceOwner saved;
+  Oid relid = IndexGetRelation(indexoid, true);
+
+  /* not an index at all, index_open() complains below */
+  if( OidIsValid(relid) )
+    pr_lookup_check_access(relid);
+
+  if( prefix_lookup_state != NULL ) {
+    if( prefix_lookup_state->indexoid == indexoid )
+      return prefix_lookup_state;
+
+    pr_lookup_close();
+  }
+
+  if( !prefix_lookup_callback ) {
+    RegisterXactCallback(pr_lookup_xact_callback, NULL);
+    prefix_lookup_callback = true;
+  }
+
+  oldcxt = MemoryContextSwitchTo(TopTransactionContext);
+  saved  = CurrentResourceOwner;
+  CurrentResourceOwner = TopTransactionResourceOwner;
+
+  PG_TRY();
+  {
+    index = index_open(indexoid, AccessShareLock);
+    pr_index_check(index);
+
+    if( index->rd_index->indkey.values[0] == 0 ) {
+      char *name = pstrdup(RelationGetRelationName(index));
+
+      index_close(index, AccessShareLock);
+      ereport(ERROR,
+	      (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	       errmsg("index \"%s\" is an expression index", name)));
+    }
+
+    state = (pr_lookup_state *) palloc0(sizeof(pr_lookup_state));
+    state->indexoid = indexoid;
+    state->index    = index;
+    state->attnum   = index->rd_index->indkey.values[0];
+    state->prtype   = index->rd_opcintype[0];
+    state->heap     = table_open(index->rd_index->indrelid, AccessShareLock);
+    state->scan     = index_beginscan(state->heap, index,
+				      GetActiveSnapshot(), 1, 0);
+    state->slot     = table_slot_create(state->heap, NULL);
+  }
+  PG_CATCH();
+  {
+    CurrentResourceOwner = saved;
+    MemoryContextSwitchTo(oldcxt);
+    PG_RE_THROW();
+  }
+  PG_END_TRY();
+
+  CurrentResourceOwner = saved;
+  MemoryContextSwitchTo(oldcxt);
+
+  prefix_lookup_state = state;
+  return state;
+}
+
+/*
+ * The caller gives the row type in the column definition list, check
+ * that it matches the table.
+ */
+static void
+pr_lookup_check_rowtype(TupleDesc heapdesc, TupleDesc resdesc)
+{
+  int i, j = 0;
+
+  for(i=0; i<heapdesc->natts; i++) {
+    Form_pg_attribute att = TupleDescAttr(heapdesc, i);
+
+    if( att->attisdropped )
+      continue;
+
+    if( j >= resdesc->natts
+	|| TupleDescAttr(resdesc, j)->atttypid != att->atttypid )
+      break;
+    j++;
+  }
+
+  if( i < heapdesc->natts || j != resdesc->natts )
+    ereport(ERROR,
+	    (errcode(ERRCODE_DATATYPE_MISMATCH),
+	     errmsg("return type does not match the indexed table row type")));
+}
+
+static Datum
+pr_lookup_result(HeapTuple tuple, TupleDesc heapdesc, TupleDesc resdesc)
+{
+  Datum *hvalues = (Datum *) palloc(heapdesc->natts * sizeof(Datum));
+  bool *hnulls   = (bool *) palloc(heapdesc->natts * sizeof(bool));
+  Datum *values  = (Datum *) palloc(resdesc->natts * sizeof(Datum));
+  bool *nulls    = (bool *) palloc(resdesc->natts * sizeof(bool));
+  int i, j = 0;
+
+  heap_deform_tuple(tuple, heapdesc, hvalues, hnulls);
+
+  for(i=0; i<heapdesc->natts; i++) {
+    if( TupleDescAttr(heapdesc, i)->attisdropped )
+      continue;
+
+    values[j] = hvalues[i];
+    nulls[j]  = hnulls[i];
+    j++;
+  }
+  return HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(resdesc), values, nulls));
+}
+
+#endif  /* PG_VERSION_NUM >= 120000 */
+
+PG_FUNCTION_INFO_V1(prefix_lookup);
+Datum
+prefix_lookup(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM >= 120000
+  Oid indexoid = PG_GETARG_OID(0);
+  prefix_range *query = pr_from_text(PG_GETARG_TEXT_PP(1));
+  pr_lookup_state *state;
+  TupleDesc tupdesc;
+  ScanKeyData key;
+  HeapTuple best = NULL;
+  int bestlen = -1;
+  ResourceOwner saved;
+
+  if( get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE )
+    ereport(ERROR,
+	    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	     errmsg("function returning record called in context "
+		    "that cannot accept type record")));
+
+  state = pr_lookup_open(indexoid);
+  pr_lookup_check_rowtype(RelationGetDescr(state->heap), tupdesc);
+
+  /*
+   * gistrescan() installs the consistent function in the scan key.
+   */
+  ScanKeyEntryInitialize(&key, 0, 1, 1, state->prtype,
+			 state->index->rd_indcollation[0], InvalidOid,
+			 PrefixRangeGetDatum(query));
+
+  /*
+   * Buffer pins are owned by the transaction too, so that they are
+   * consistent with the scan state whatever happens to the current
+   * portal.
+   */
+  saved = CurrentResourceOwner;
+  CurrentResourceOwner = TopTransactionResourceOwner;
+
+  PG_TRY();
+  {
+    state->scan->xs_snapshot = GetActiveSnapshot();
+    index_rescan(state->scan, &key, 1, NULL, 0);
+
+    while( index_getnext_slot(state->scan, ForwardScanDirection, state->slot) ) {
+      bool isnull;
+      Datum d = slot_getattr(state->slot, state->attnum, &isnull);
+      int len;
+
+      if( isnull )
+	continue;
+
+      len = pr_length(DatumGetPrefixRangeP(d));
+
+      if( len > bestlen ) {
+	if( best != NULL )
+	  heap_freetuple(best);
+
+	best    = ExecCopySlotHeapTuple(state->slot);
+	bestlen = len;
+      }
+    }
+    ExecClearTuple(state->slot);
+    table_index_fetch_reset(state->scan->xs_heapfetch);
+  }
+  PG_CATCH();
+  {
+    CurrentResourceOwner = saved;
+    PG_RE_THROW();
+  }
+  PG_END_TRY();
+
+  CurrentResourceOwner = saved;
+
+  if( best == NULL )
+    PG_RETURN_NULL();
+
+  PG_RETURN_DATUM(pr_lookup_result(best, RelationGetDescr(state->heap), tupdesc));
+#else
+  ereport(ERROR,
+	  (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	   errmsg("prefix_lookup() needs PostgreSQL 12 or later")));
+  PG_RETURN_NULL();
+#endif
+}
+
+/**
+ * Routing snapshots
+ *
+ * prefix_snapshot_agg(prefix_range, int8) compiles a set of prefixes
+ * and their payloads into a flat image, and
+ * prefix_snapshot_lookup(bytea, text) returns the payload of the
+ * longest prefix containing a number, searching the image in place.
+ *
+ * The image contains no pointers, only offsets and indexes relative to
+ * its first byte, so that it can be stored in a bytea column, cached,
+ * or written to a file and memory mapped. Version 1 of the layout is:
+ *
+ *   header   64 bytes, see pr_snapshot_header
+ *   nodes    nnodes pr_snapshot_node of 16 bytes, node 0 is the root
+ *   labels   nnodes bytes, labels[i] is the character leading to node i
+ *   entries  nentries pr_snapshot_entry of 16 bytes
+ *
+ * Each section begins at an offset that is a multiple of 64 bytes, the
+ * cache line size. Nodes are numbered breadth first, so that the
+ * children of a node are consecutive nodes, and the labels of siblings
+ * are consecutive bytes that we binary search. Entries are stored the
+ * same way: a prefix '0146' and a range '0146[2-5]' are both entries of
+ * the node reached by '0146', the range having first and last set.
+ *
+ * Multi-byte fields are in the byte order of the server that built the
+ * image, which the byteorder field allows to check.
+ *
+ * The longest match wins; when a prefix and a range have the same
+ * length, as 01465 and 0146[4-7], the prefix wins, then entries are
+ * ordered by first, last and payload.
+ */
+#define PR_SNAPSHOT_MAGIC      "PRSN"
+#define PR_SNAPSHOT_VERSION    1
+#define PR_SNAPSHOT_BYTEORDER  0x0102
+#define PR_SNAPSHOT_ALIGN      64
+
+typedef struct
+{
+  char    magic[4];
+  uint16  version;
+  uint16  byteorder;
+  uint32  size;           /* image size, header included */
+  uint32  nnodes;
+  uint32  nentries;
+  uint32  maxdepth;       /* length of the longest prefix */
+  uint32  nodes;          /* offsets of the sections */
+  uint32  labels;
+  uint32  entries;
+  char    reserved[28];
+} pr_snapshot_header;
+
+typedef struct
+{
+  uint32  first_child;    /* node index of the first child */
+  uint32  first_entry;    /* index of the first entry */
+  uint32  nentries;
+  uint16  nchildren;
+  uint16  reserved;
+} pr_snapshot_node;
+
+typedef struct
+{
+  int64   payload;
+  uint8   first;          /* 0 for a plain prefix */
+  uint8   last;
+  uint8   reserved[6];
+} pr_snapshot_entry;
+
+typedef struct
+{
+  prefix_range *pr;
+  int64         payload;
+} pr_snapshot_item;
+
+Datum prefix_snapshot_agg_trans(PG_FUNCTION_ARGS);
+Datum prefix_snapshot_agg_final(PG_FUNCTION_ARGS);
+Datum prefix_snapshot_lookup(PG_FUNCTION_ARGS);
+
+static int
+pr_snapshot_item_cmp(const void *a, const void *b) {
+  const pr_snapshot_item *ia = (const pr_snapshot_item *) a;
+  const pr_snapshot_item *ib = (const pr_snapshot_item *) b;
+
+  if( ia->pr->first != ib->pr->first )
+    return (uint8) ia->pr->first < (uint8) ib->pr->first ? -1 : 1;
+
+  if( ia->pr->last != ib->pr->last )
+    return (uint8) ia->pr->last < (uint8) ib->pr->last ? -1 : 1;
+
+  if( ia->payload != ib->payload )
+    return ia->payload < ib->payload ? -1 : 1;
+
+  return 0;
+}
+
+/**
+ * Lay the trie out in a bytea, zero filled so that padding and
+ * reserved fields are always the same.
+ */
+static bytea *
+pr_snapshot_build(pr_trie *trie) {
+  pr_trie_node **queue;
+  pr_snapshot_item *items;
+  pr_snapshot_header header;
+  Size nodes, labels, entries, size;
+  uint32 head, tail = 0, nextchild = 1, nextentry = 0;
+  bytea *result;
+  char *image;
+
+  nodes   = TYPEALIGN(PR_SNAPSHOT_ALIGN, sizeof(pr_snapshot_header));
+  labels  = TYPEALIGN(PR_SNAPSHOT_ALIGN,
+		      nodes + (Size) trie->nnodes * sizeof(pr_snapshot_node));
+  entries = TYPEALIGN(PR_SNAPSHOT_ALIGN, labels + (Size) trie->nnodes);
+  size    = TYPEALIGN(PR_SNAPSHOT_ALIGN,
+		      entries + (Size) trie->nentries * sizeof(pr_snapshot_entry));
+
+  if( size > MaxAllocSize - VARHDRSZ )
+    ereport(ERROR,
+	    (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+	     errmsg("prefix snapshot would be too large")));
+
+  result = (bytea *) palloc0(size + VARHDRSZ);
+  SET_VARSIZE(result, size + VARHDRSZ);
+  image = VARDATA(result);
+
+  queue = (pr_trie_node **) palloc(trie->nnodes * sizeof(pr_trie_node *));
+  items = (pr_snapshot_item *)
+    palloc(Max(trie->nentries, 1) * sizeof(pr_snapshot_item));
+
+  queue[tail++] = trie->root;
+
+  for(head = 0; head < tail; head++) {
+    pr_trie_node *node = queue[head];
+    pr_trie_entry *e;
+    pr_snapshot_node snode;
+    int i, n = 0;
+
+    memset(&snode, 0, sizeof(pr_snapshot_node));
+    snode.first_child = nextchild;
+    snode.nchildren   = node->nchildren;
+
+    for(i=0; i<node->nchildren; i++) {
+      image[labels + nextchild + i] = (char) node->labels[i];
+      queue[tail++] = node->children[i];
+    }
+    nextchild += node->nchildren;
+
+    for(e=node->entries; e != NULL; e=e->next) {
+      items[n].pr      = e->pr;
+      items[n].payload = *(int64 *) e->data;
+      n++;
+    }
+    qsort(items, n, sizeof(pr_snapshot_item), pr_snapshot_item_cmp);
+
+    snode.first_entry = nextentry;
+    snode.nentries    = n;
+
+    for(i=0; i<n; i++) {
+      pr_snapshot_entry sentry;
+
+      memset(&sentry, 0, sizeof(pr_snapshot_entry));
+      sentry.payload = items[i].payload;
+      sentry.first   = (uint8) items[i].pr->first;
+      sentry.last    = (uint8) items[i].pr->last;
+
+      memcpy(image + entries + (Size) nextentry * sizeof(pr_snapshot_entry),
+	     &sentry, sizeof(pr_snapshot_entry));
+      nextentry++;
+    }
+    memcpy(image + nodes + (Size) head * sizeof(pr_snapshot_node),
+	   &snode, sizeof(pr_snapshot_node));
+  }
+
+  memset(&header, 0, sizeof(pr_snapshot_header));
+  memcpy(header.magic, PR_SNAPSHOT_MAGIC, 4);
+  header.version   = PR_SNAPSHOT_VERSION;
+  header.byteorder = PR_SNAPSHOT_BYTEORDER;
+  header.size      = size;
+  header.nnodes    = trie->nnodes;
+  header.nentries  = trie->nentries;
+  header.maxdepth  = trie->maxdepth;
+  header.nodes     = nodes;
+  header.labels    = labels;
+  header.entries   = entries;
+  memcpy(image, &header, sizeof(pr_snapshot_header));
+
+  pfree(queue);
+  pfree(items);
+
+  return result;
+}
+
+PG_FUNCTION_INFO_V1(prefix_snapshot_agg_trans);
+Datum
+prefix_snapshot_agg_trans(PG_FUNCTION_ARGS)
+{
+  MemoryContext aggcontext, oldcxt;
+  pr_trie *trie;
+
+  if( !AggCheckCallContext(fcinfo, &aggcontext) )
+    elog(ERROR, "prefix_snapshot_agg_trans called in non-aggregate context");
+
+  oldcxt = MemoryContextSwitchTo(aggcontext);
+
+  trie = PG_ARGISNULL(0) ? pr_trie_create() : (pr_trie *) PG_GETARG_POINTER(0);
+
+  if( !PG_ARGISNULL(1) && !PG_ARGISNULL(2) ) {
+    prefix_range *pr = PG_GETARG_PREFIX_RANGE_P(1);
+    int64 *payload = (int64 *) palloc(sizeof(int64));
+
+    *payload = PG_GETARG_INT64(2);
+    pr_trie_insert(trie, build_pr(pr->prefix, pr->first, pr->last), payload);
+  }
+  MemoryContextSwitchTo(oldcxt);
+
+  PG_RETURN_POINTER(trie);
+}
+
+/**
+ * Not strict, so that an empty set of rows gives an empty image rather
+ * than NULL.
+ */
+PG_FUNCTION_INFO_V1(prefix_snapshot_agg_final);
+Datum
+prefix_snapshot_agg_final(PG_FUNCTION_ARGS)
+{
+  pr_trie *trie =
+    PG_ARGISNULL(0) ? pr_trie_create() : (pr_trie *) PG_GETARG_POINTER(0);
+
+  PG_RETURN_BYTEA_P(pr_snapshot_build(trie));
+}
+
+static inline
+void pr_snapshot_invalid(void) {
+  ereport(ERROR,
+	  (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+	   errmsg("invalid prefix snapshot image")));
+}
+
+/*
+ * Images big enough to be toasted are detoasted once per query rather
+ * than at each call: the detoasted copy is kept in fn_extra along with
+ * the datum it comes from, the toast pointer or the compressed inline
+ * value, and reused as long as the same datum is given. Plain values
+ * are searched in place.
+ */
+#ifndef VARATT_IS_EXTERNAL_ONDISK
+#define VARATT_IS_EXTERNAL_ONDISK(PTR) VARATT_IS_EXTERNAL(PTR)
+#endif
+
+typedef struct
+{
+  struct varlena *raw;      /* the datum as given, not detoasted */
+  bytea          *image;    /* its detoasted copy */
+} pr_snapshot_cache;
+
+static bytea *
+pr_snapshot_image(FunctionCallInfo fcinfo) {
+  struct varlena *raw = (struct varlena *) PG_GETARG_POINTER(0);
+  pr_snapshot_cache *cache = (pr_snapshot_cache *) fcinfo->flinfo->fn_extra;
+  MemoryContext oldcxt;
+  Size size;
+
+  if( !VARATT_IS_EXTERNAL_ONDISK(raw) && !VARATT_IS_COMPRESSED(raw) )
+    return PG_GETARG_BYTEA_PP(0);
+
+  size = VARSIZE_ANY(raw);
+
+  if( cache == NULL ) {
+    cache = (pr_snapshot_cache *)
+      MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt, sizeof(pr_snapshot_cache));
+    fcinfo->flinfo->fn_extra = cache;
+  }
+  else if( cache->raw != NULL ) {
+    if( VARSIZE_ANY(cache->raw) == size && memcmp(cache->raw, raw, size) == 0 )
+      return cache->image;
+
+    pfree(cache->raw);
+    pfree(cache->image);
+    cache->raw = NULL;
+  }
+
+  oldcxt = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+  cache->image = PG_DETOAST_DATUM_COPY(PG_GETARG_DATUM(0));
+  cache->raw   = (struct varlena *) palloc(size);
+  memcpy(cache->raw, raw, size);
+  MemoryContextSwitchTo(oldcxt);
+
+  return cache->image;
+}
+
+/**
+ * The image comes from a bytea that anyone could have forged, so check
+ * every offset before reading, and read with memcpy() as the bytea data
+ * itself need not be aligned.
+ */
+PG_FUNCTION_INFO_V1(prefix_snapshot_lookup);
+Datum
+prefix_snapshot_lookup(PG_FUNCTION_ARGS)
+{
+  bytea *snapshot = pr_snapshot_image(fcinfo);
+  text *number    = PG_GETARG_TEXT_PP(1);
+  const char *image = VARDATA_ANY(snapshot);
+  const char *str   = VARDATA_ANY(number);
+  uint64 size = VARSIZE_ANY_EXHDR(snapshot);
+  int len = VARSIZE_ANY_EXHDR(number);
+  pr_snapshot_header header;
+  pr_snapshot_node node;
+  uint32 current = 0;
+  int depth = 0, bestlen = -1;
+  bool bestplain = false;
+  int64 best = 0;
+
+  if( size < sizeof(pr_snapshot_header) )
+    pr_snapshot_invalid();
+
+  memcpy(&header, image, sizeof(pr_snapshot_header));
+
+  if( memcmp(header.magic, PR_SNAPSHOT_MAGIC, 4) != 0
+      || header.byteorder != PR_SNAPSHOT_BYTEORDER
+      || header.size != size
+      || header.nnodes == 0
+      || (uint64) header.nodes
+         + (uint64) header.nnodes * sizeof(pr_snapshot_node) > size
+      || (uint64) header.labels + header.nnodes > size
+      || (uint64) header.entries
+         + (uint64) header.nentries * sizeof(pr_snapshot_entry) > size )
+    pr_snapshot_invalid();
+
+  if( header.version != PR_SNAPSHOT_VERSION )
+    ereport(ERROR,
+	    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	     errmsg("unsupported prefix snapshot version %d", header.version)));
+
+  for(;;) {
+    uint32 i, lo, hi;
+
+    memcpy(&node,
+	   image + header.nodes + (uint64) current * sizeof(pr_snapshot_node),
+	   sizeof(pr_snapshot_node));
+
+    if( (uint64) node.first_entry + node.nentries > header.nentries )
+      pr_snapshot_invalid();
+
+    for(i=0; i<node.nentries; i++) {
+      pr_snapshot_entry entry;
+      unsigned char c;
+
+      memcpy(&entry,
+	     image + header.entries
+	     + (uint64) (node.first_entry + i) * sizeof(pr_snapshot_entry),
+	     sizeof(pr_snapshot_entry));
+
+      if( entry.first == 0 ) {
+	if( depth > bestlen || (depth == bestlen && !bestplain) ) {
+	  best      = entry.payload;
+	  bestlen   = depth;
+	  bestplain = true;
+	}
+	continue;
+      }
+
+      if( depth == len )
+	continue;
+
+      c = (unsigned char) str[depth];
+
+      if( entry.first <= c && c <= entry.last && depth + 1 > bestlen ) {
+	best      = entry.payload;
+	bestlen   = depth + 1;
+	bestplain = false;
+      }
+    }
+
+    if( depth == len || node.nchildren == 0 )
+      break;
+
+    if( (uint64) node.first_child + node.nchildren > header.nnodes )
+      pr_snapshot_invalid();
+
+    /* binary search the label among the children */
+    lo = node.first_child;
+    hi = node.first_child + node.nchildren;
+
+    while( lo < hi ) {
+      uint32 mid = lo + (hi - lo) / 2;
+      unsigned char label = (unsigned char) image[header.labels + mid];
+
+      if( label < (unsigned char) str[depth] )
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+    if( lo == node.first_child + node.nchildren
+	|| (unsigned char) image[header.labels + lo] != (unsigned char) str[depth] )
+      break;
+
+    current = lo;
+    depth++;
+  }
+
+  if( bestlen < 0 )
+    PG_RETURN_NULL();
+
+  PG_RETURN_INT64(best);
+}
+
+/**
+ * Matching against an array of prefixes
+ *
+ * prefix_contains_any(prefixes prefix_range[], number text) gives the
+ * same result as number <@ ANY(prefixes), and
+ * prefix_longest_any(prefixes, number) returns the position in the
+ * array (counting from 1) of the longest prefix containing number, the
+ * first one when several have the same length, or NULL.
+ *
+ * The array is compiled once into a trie kept in fn_extra, so that each
+ * call only walks down the trie, in O(number length) whatever the array
+ * size. When the array is not a constant of the query we compare it to
+ * the cached copy at each call, and rebuild the trie when it changed.
+ */
+Datum prefix_contains_any(PG_FUNCTION_ARGS);
+Datum prefix_longest_any(PG_FUNCTION_ARGS);
+
+typedef struct
+{
+  MemoryContext   cxt;        /* the trie and the array copy live here */
+  ArrayType      *array;      /* NULL when the array is stable */
+  pr_trie        *trie;
+  pr_trie_node  **path;
+  int             maxpath;
+} pr_any_cache;
+
+static pr_any_cache *
+pr_any_cache_get(FunctionCallInfo fcinfo) {
+  pr_any_cache *cache = (pr_any_cache *) fcinfo->flinfo->fn_extra;
+  ArrayType *array = PG_GETARG_ARRAYTYPE_P(0);
+  MemoryContext oldcxt;
+  Datum *elems;
+  bool *nulls;
+  int nelems, i;
+  int16 typlen;
+  bool typbyval;
+  char typalign;
+
+  if( cache == NULL ) {
+    cache = (pr_any_cache *)
+      MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt, sizeof(pr_any_cache));
+    cache->cxt = AllocSetContextCreate(fcinfo->flinfo->fn_mcxt,
+				       "prefix array trie",
+				       ALLOCSET_DEFAULT_MINSIZE,
+				       ALLOCSET_DEFAULT_INITSIZE,
+				       ALLOCSET_DEFAULT_MAXSIZE);
+    fcinfo->flinfo->fn_extra = cache;
+  }
+  else if( cache->trie != NULL ) {
+    if( cache->array == NULL )
+      return cache;
+
+    if( VARSIZE(cache->array) == VARSIZE(array)
+	&& memcmp(cache->array, array, VARSIZE(array)) == 0 )
+      return cache;
+  }
+
+  MemoryContextReset(cache->cxt);
+  cache->array   = NULL;
+  cache->path    = NULL;
+  cache->maxpath = 0;
+
+  oldcxt = MemoryContextSwitchTo(cache->cxt);
+
+  if( !get_fn_expr_arg_stable(fcinfo->flinfo, 0) ) {
+    cache->array = (ArrayType *) palloc(VARSIZE(array));
+    memcpy(cache->array, array, VARSIZE(array));
+  }
+
+  get_typlenbyvalalign(ARR_ELEMTYPE(array), &typlen, &typbyval, &typalign);
+  deconstruct_array(array, ARR_ELEMTYPE(array), typlen, typbyval, typalign,
+		    &elems, &nulls, &nelems);
+
+  cache->trie = pr_trie_create();
+
+  for(i=0; i<nelems; i++) {
+    prefix_range *pr;
+    int *pos;
+
+    if( nulls[i] )
+      continue;
+
+    pr  = DatumGetPrefixRangeP(elems[i]);
+    pos = (int *) palloc(sizeof(int));
+    *pos = i + 1;
+
+    pr_trie_insert(cache->trie, build_pr(pr->prefix, pr->first, pr->last), pos);
+  }
+  MemoryContextSwitchTo(oldcxt);
+
+  return cache;
+}
+
+/**
+ * Returns the position of a prefix containing query, the longest one
+ * if asked to, or 0.
+ */
+static int
+pr_any_match(pr_any_cache *cache, prefix_range *query, bool longest) {
+  int len = strlen(query->prefix), depth, d, best = 0, bestlen = -1;
+
+  if( cache->maxpath < len + 1 ) {
+    cache->maxpath = len + 1;
+    cache->path = (pr_trie_node **)
+      MemoryContextAlloc(cache->cxt, cache->maxpath * sizeof(pr_trie_node *));
+  }
+  depth = pr_trie_path(cache->trie, query->prefix, len, cache->path);
+
+  for(d=depth-1; d>=0; d--) {
+    pr_trie_entry *entry;
+
+    for(entry=cache->path[d]->entries; entry != NULL; entry=entry->next) {
+      int pos = *(int *) entry->data, elen;
+
+      if( !pr_contains(entry->pr, query, true) )
+	continue;
+
+      if( !longest )
+	return pos;
+
+      elen = pr_length(entry->pr);
+
+      if( elen > bestlen || (elen == bestlen && pos < best) ) {
+	best    = pos;
+	bestlen = elen;
+      }
+    }
+  }
+  return best;
+}
+
+PG_FUNCTION_INFO_V1(prefix_contains_any);
+Datum
+prefix_contains_any(PG_FUNCTION_ARGS)
+{
+  pr_any_cache *cache = pr_any_cache_get(fcinfo);
+  prefix_range *query = pr_try_from_text(PG_GETARG_TEXT_PP(1));
+
+  PG_RETURN_BOOL( query != NULL && pr_any_match(cache, query, false) > 0 );
+}
+
+PG_FUNCTION_INFO_V1(prefix_longest_any);
+Datum
+prefix_longest_any(PG_FUNCTION_ARGS)
+{
+  pr_any_cache *cache = pr_any_cache_get(fcinfo);
+  prefix_range *query = pr_try_from_text(PG_GETARG_TEXT_PP(1));
+  int pos;
+
+  if( query == NULL )
+    PG_RETURN_NULL();
+
+  pos = pr_any_match(cache, query, true);
+
+  if( pos == 0 )
+    PG_RETURN_NULL();
+
+  PG_RETURN_INT32(pos);
+}
+
+/**
+ * Compaction of prefix sets
+ *
+ * The prefix_range_compact(prefix_range) aggregate returns the smallest
+ * array of prefix_range values covering the same numbers as the
+ * aggregated ones: redundant values are removed, siblings 01460, 01461,
+ * ..., 01465 are merged into 0146[0-5], and a complete set of siblings
+ * such as 0146[0-9] is replaced by its parent 0146, which may then be
+ * merged with its own siblings, and so on.
+ *
+ * Replacing a complete set of siblings with their parent assumes that
+ * numbers only use the character class of the siblings, see
+ * pr_char_class(): digits for phone numbers.
+ *
+ * The values are sorted into a trie, which is then walked once depth
+ * first, merging children into their parent on the way up. Partial
+ * tries built by parallel workers are serialized as the list of their
+ * values, and inserted into the leader trie.
+ */
+Datum prefix_range_compact_trans(PG_FUNCTION_ARGS);
+Datum prefix_range_compact_combine(PG_FUNCTION_ARGS);
+Datum prefix_range_compact_serialize(PG_FUNCTION_ARGS);
+Datum prefix_range_compact_deserialize(PG_FUNCTION_ARGS);
+Datum prefix_range_compact_final(PG_FUNCTION_ARGS);
+
+typedef struct
+{
+  pr_trie  *trie;
+  Oid       prtype;
+} pr_compact_state;
+
+/*
+ * Returns true when the node prefix is entirely covered, otherwise
+ * appends to *result the values covering what's under the node. buf
+ * holds the node prefix in its first depth characters.
+ */
+static bool
+pr_compact_node(pr_trie_node *node, char *buf, int depth, List **result) {
+  bool covered[256];
+  List **sublists;
+  pr_trie_entry *e;
+  char lo, hi;
+  int i, c, j = 0, start = -1, first = -1, count = 0;
+
+  check_stack_depth();
+
+  memset(covered, 0, sizeof(covered));
+
+  for(e=node->entries; e != NULL; e=e->next) {
+    if( e->pr->first == 0 )
+      return true;
+
+    for(c=(unsigned char) e->pr->first; c<=(unsigned char) e->pr->last; c++)
+      covered[c] = true;
+  }
+
+  sublists = (List **) palloc0(Max(node->nchildren, 1) * sizeof(List *));
+
+  for(i=0; i<node->nchildren; i++) {
+    c = node->labels[i];
+
+    if( covered[c] )
+      continue;
+
+    buf[depth] = (char) c;
+    if( pr_compact_node(node->children[i], buf, depth + 1, &sublists[i]) )
+      covered[c] = true;
+  }
+
+  for(c=1; c<256; c++) {
+    if( covered[c] ) {
+      if( first < 0 )
+	first = c;
+      count++;
+    }
+  }
+
+  if( first > 0 && pr_char_class((char) first, &lo, &hi)
+      && count == hi - lo + 1 ) {
+    for(c=(unsigned char) lo; c<=(unsigned char) hi && covered[c]; c++);
+
+    if( c > (unsigned char) hi )
+      return true;
+  }
+
+  /*
+   * Runs of covered characters become ranges, in between are the values
+   * found under the children that are not entirely covered.
+   */
+  for(c=1; c<=256; c++) {
+    if( c < 256 && covered[c] ) {
+      if( start < 0 )
+	start = c;
+      continue;
+    }
+
+    if( start >= 0 ) {
+      buf[depth] = 0;
+
+      if( start == c - 1 ) {
+	buf[depth]     = (char) start;
+	buf[depth + 1] = 0;
+	*result = lappend(*result, build_pr(buf, 0, 0));
+      }
+      else
+	*result = lappend(*result, build_pr(buf, (char) start, (char) (c - 1)));
+
+      start = -1;
+    }
+
+    while( j < node->nchildren && node->labels[j] < c )
+      j++;
+
+    if( j < node->nchildren && node->labels[j] == c )
+      *result = list_concat(*result, sublists[j]);
+  }
+  pfree(sublists);
+
+  return false;
+}
+
+/*
+ * Returns the compacted list of the values in the trie.
+ */
+static List *
+pr_compact_list(pr_trie *trie) {
+  List *result = NIL;
+  char *buf = (char *) palloc(trie->maxdepth + 2);
+
+  if( pr_compact_node(trie->root, buf, 0, &result) )
+    result = list_make1(build_pr("", 0, 0));
+
+  pfree(buf);
+  return result;
+}
+
+static pr_compact_state *
+pr_compact_create(Oid prtype) {
+  pr_compact_state *state = (pr_compact_state *) palloc(sizeof(pr_compact_state));
+
+  state->trie   = pr_trie_create();
+  state->prtype = prtype;
+  return state;
+}
+
+PG_FUNCTION_INFO_V1(prefix_range_compact_trans);
+Datum
+prefix_range_compact_trans(PG_FUNCTION_ARGS)
+{
+  MemoryContext aggcontext, oldcxt;
+  pr_compact_state *state;
+  prefix_range *pr = NULL;
+
+  if( !AggCheckCallContext(fcinfo, &aggcontext) )
+    elog(ERROR, "prefix_range_compact_trans called in non-aggregate context");
+
+  if( !PG_ARGISNULL(1) )
+    pr = PG_GETARG_PREFIX_RANGE_P(1);
+
+  oldcxt = MemoryContextSwitchTo(aggcontext);
+
+  if( PG_ARGISNULL(0) )
+    state = pr_compact_create(get_fn_expr_argtype(fcinfo->flinfo, 1));
+  else
+    state = (pr_compact_state *) PG_GETARG_POINTER(0);
+
+  if( pr != NULL )
+    pr_trie_insert(state->trie, pr_normalize(pr), NULL);
+  MemoryContextSwitchTo(oldcxt);
+
+  PG_RETURN_POINTER(state);
+}
+
+/*
+ * Inserts the entries found under node into the trie, the values are
+ * not copied: both states live in the aggregate context.
+ */
+static void
+pr_compact_merge(pr_trie *trie, pr_trie_node *node) {
+  pr_trie_entry *e;
+  int i;
+
+  check_stack_depth();
+
+  for(e=node->entries; e != NULL; e=e->next)
+    pr_trie_insert(trie, e->pr, NULL);
+
+  for(i=0; i<node->nchildren; i++)
+    pr_compact_merge(trie, node->children[i]);
+}
+
+static void
+pr_compact_send(StringInfo buf, pr_trie_node *node) {
+  pr_trie_entry *e;
+  int i;
+
+  check_stack_depth();
+
+  for(e=node->entries; e != NULL; e=e->next) {
+    int len = strlen(e->pr->prefix);
+
+    pq_sendint(buf, len, 4);
+    pq_sendbytes(buf, e->pr->prefix, len);
+    pq_sendbyte(buf, e->pr->first);
+    pq_sendbyte(buf, e->pr->last);
+  }
+
+  for(i=0; i<node->nchildren; i++)
+    pr_compact_send(buf, node->children[i]);
+}
+
+PG_FUNCTION_INFO_V1(prefix_range_compact_combine);
+Datum
+prefix_range_compact_combine(PG_FUNCTION_ARGS)
+{
+  MemoryContext aggcontext, oldcxt;
+  pr_compact_state *state1, *state2;
+
+  if( !AggCheckCallContext(fcinfo, &aggcontext) )
+    elog(ERROR, "prefix_range_compact_combine called in non-aggregate context");
+
+  if( PG_ARGISNULL(1) ) {
+    if( PG_ARGISNULL(0) )
+      PG_RETURN_NULL();
+    PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+  }
+  state2 = (pr_compact_state *) PG_GETARG_POINTER(1);
+
+  oldcxt = MemoryContextSwitchTo(aggcontext);
+
+  if( PG_ARGISNULL(0) )
+    state1 = pr_compact_create(state2->prtype);
+  else
+    state1 = (pr_compact_state *) PG_GETARG_POINTER(0);
+
+  pr_compact_merge(state1->trie, state2->trie->root);
+  MemoryContextSwitchTo(oldcxt);
+
+  PG_RETURN_POINTER(state1);
+}
+
+/**
+ * The serialized state is the prefix_range type oid, then for each value
+ * its prefix length and bytes, and its first and last characters.
+ */
+PG_FUNCTION_INFO_V1(prefix_range_compact_serialize);
+Datum
+prefix_range_compact_serialize(PG_FUNCTION_ARGS)
+{
+  pr_compact_state *state;
+  StringInfoData buf;
+
+  if( !AggCheckCallContext(fcinfo, NULL) )
+    elog(ERROR, "prefix_range_compact_serialize called in non-aggregate context");
+
+  state = (pr_compact_state *) PG_GETARG_POINTER(0);
+
+  pq_begintypsend(&buf);
+  pq_sendint(&buf, state->prtype, 4);
+  pr_compact_send(&buf, state->trie->root);
+
+  PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+PG_FUNCTION_INFO_V1(prefix_range_compact_deserialize);
+Datum
+prefix_range_compact_deserialize(PG_FUNCTION_ARGS)
+{
+  MemoryContext aggcontext, oldcxt;
+  bytea *serialized = PG_GETARG_BYTEA_PP(0);
+  pr_compact_state *state;
+  StringInfoData buf;
+
+  if( !AggCheckCallContext(fcinfo, &aggcontext) )
+    elog(ERROR, "prefix_range_compact_deserialize called in non-aggregate context");
+
+  initStringInfo(&buf);
+  appendBinaryStringInfo(&buf, VARDATA_ANY(serialized), VARSIZE_ANY_EXHDR(serialized));
+
+  oldcxt = MemoryContextSwitchTo(aggcontext);
+  state = pr_compact_create((Oid) pq_getmsgint(&buf, 4));
+
+  while( buf.cursor < buf.len ) {
+    int len = (int) pq_getmsgint(&buf, 4);
+    const char *bytes = pq_getmsgbytes(&buf, len);
+    char *prefix = (char *) palloc(len + 1);
+    char first, last;
+
+    memcpy(prefix, bytes, len);
+    prefix[len] = 0;
+    first = (char) pq_getmsgbyte(&buf);
+    last  = (char) pq_getmsgbyte(&buf);
+
+    pr_trie_insert(state->trie, build_pr(prefix, first, last), NULL);
+    pfree(prefix);
+  }
+  pq_getmsgend(&buf);
+
+  MemoryContextSwitchTo(oldcxt);
+  pfree(buf.data);
+
+  PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(prefix_range_compact_final);
+Datum
+prefix_range_compact_final(PG_FUNCTION_ARGS)
+{
+  pr_compact_state *state;
+  List *result;
+  ListCell *lc;
+  Datum *elems;
+  int n = 0;
+
+  if( PG_ARGISNULL(0) )
+    PG_RETURN_NULL();
+
+  state = (pr_compact_state *) PG_GETARG_POINTER(0);
+
+  if( !OidIsValid(state->prtype) )
+    ereport(ERROR,
+	    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	     errmsg("could not determine the prefix_range type")));
+
+  result = pr_compact_list(state->trie);
+  elems = (Datum *) palloc(Max(list_length(result), 1) * sizeof(Datum));
+
+  foreach(lc, result)
+    elems[n++] = PrefixRangeGetDatum((prefix_range *) lfirst(lc));
+
+  PG_RETURN_ARRAYTYPE_P(construct_array(elems, n, state->prtype, -1, false, 'i'));
+}
+
+/**
+ * prefix_ranges_from_interval(lo text, hi text) returns setof prefix_range
+ *
+ * Returns the smallest set of prefix_range values covering the numbers
+ * from lo to hi included, which must be made of digits and have the same
+ * length:
+ *
+ *   0146200000 to 0146499999 is 0146[2-4]
+ *   0146250000 to 0146499999 is 01462[5-9] and 0146[3-4]
+ *
+ * Once lo and hi diverge, each digit splits the interval into a partial
+ * subtree for the first digit, a range of complete subtrees, and a
+ * partial subtree for the last digit. Partial subtrees are covered in
+ * turn, each with only one side bounded, so that we produce at most two
+ * values per digit, whatever the size of the interval.
+ */
+Datum prefix_ranges_from_interval(PG_FUNCTION_ARGS);
+
+static inline
+bool pr_all_same_digit(const char *s, int len, char digit) {
+  int i;
+
+  for(i=0; i<len; i++)
+    if( s[i] != digit )
+      return false;
+  return true;
+}
+
+/*
+ * buf holds the depth first characters of the prefix, lo and hi the k
+ * remaining digits of the interval bounds under it.
+ */
+static void
+pr_interval_cover(char *buf, int depth, const char *lo, const char *hi, int k,
+		  const char *zeros, const char *nines, List **result) {
+  char first, last;
+  bool partial;
+
+  check_stack_depth();
+
+  if( k == 0 || (pr_all_same_digit(lo, k, '0') && pr_all_same_digit(hi, k, '9')) ) {
+    buf[depth] = 0;
+    *result = lappend(*result, build_pr(buf, 0, 0));
+    return;
+  }
+
+  if( lo[0] == hi[0] ) {
+    buf[depth] = lo[0];
+    pr_interval_cover(buf, depth + 1, lo + 1, hi + 1, k - 1, zeros, nines, result);
+    return;
+  }
+
+  first = lo[0];
+  last  = hi[0];
+
+  if( !pr_all_same_digit(lo + 1, k - 1, '0') ) {
+    buf[depth] = first;
+    pr_interval_cover(buf, depth + 1, lo + 1, nines, k - 1, zeros, nines, result);
+    first++;
+  }
+
+  partial = !pr_all_same_digit(hi + 1, k - 1, '9');
+  if( partial )
+    last--;
+
+  if( first == last ) {
+    buf[depth]     = first;
+    buf[depth + 1] = 0;
+    *result = lappend(*result, build_pr(buf, 0, 0));
+  }
+  else if( first < last ) {
+    buf[depth] = 0;
+    *result = lappend(*result, build_pr(buf, first, last));
+  }
+
+  if( partial ) {
+    buf[depth] = hi[0];
+    pr_interval_cover(buf, depth + 1, zeros, hi + 1, k - 1, zeros, nines, result);
+  }
+}
+
+PG_FUNCTION_INFO_V1(prefix_ranges_from_interval);
+Datum
+prefix_ranges_from_interval(PG_FUNCTION_ARGS)
+{
+  FuncCallContext *funcctx;
+  List *result;
+
+  if( SRF_IS_FIRSTCALL() ) {
+    MemoryContext oldcxt;
+    char *lo, *hi, *zeros, *nines, *buf;
+    int len, i;
+
+    funcctx = SRF_FIRSTCALL_INIT();
+    oldcxt = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+    lo  = text_to_cstring(PG_GETARG_TEXT_PP(0));
+    hi  = text_to_cstring(PG_GETARG_TEXT_PP(1));
+    len = strlen(lo);
+
+    if( (int) strlen(hi) != len )
+      ereport(ERROR,
+	      (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+	       errmsg("interval bounds must have the same length: \"%s\" and \"%s\"",
+		      lo, hi)));
+
+    for(i=0; i<len; i++)
+      if( lo[i] < '0' || lo[i] > '9' || hi[i] < '0' || hi[i] > '9' )
+	ereport(ERROR,
+		(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+		 errmsg("interval bounds must only contain digits: \"%s\" and \"%s\"",
+			lo, hi)));
+
+    if( strcmp(lo, hi) > 0 )
+      ereport(ERROR,
+	      (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+	       errmsg("interval lower bound \"%s\" is greater than upper bound \"%s\"",
+		      lo, hi)));
+
+    zeros = (char *) palloc(len + 1);
+    nines = (char *) palloc(len + 1);
+    buf   = (char *) palloc(len + 2);
+    memset(zeros, '0', len);
+    memset(nines, '9', len);
+
+    result = NIL;
+    pr_interval_cover(buf, 0, lo, hi, len, zeros, nines, &result);
+
+    funcctx->user_fctx = result;
+    funcctx->max_calls = list_length(result);
+
+    MemoryContextSwitchTo(oldcxt);
+  }
+
+  funcctx = SRF_PERCALL_SETUP();
+  result  = (List *) funcctx->user_fctx;
+
+  if( funcctx->call_cntr < funcctx->max_calls )
+    SRF_RETURN_NEXT(funcctx,
+		    PrefixRangeGetDatum((prefix_range *)
+					list_nth(result, funcctx->call_cntr)));
+
+  SRF_RETURN_DONE(funcctx);
+}
+
+/**
+ * prefix_table_sync(target regclass, staging regclass, key name)
+ *
+ * Brings target to the content of staging, both tables having the same
+ * columns and key being a prefix_range column with unique values: rows
+ * whose key is only found in target are deleted, rows whose key is only
+ * found in staging are inserted, and rows found in both tables are
+ * updated when another column differs. When few rows change between
+ * reloads, that's much cheaper than emptying and loading target again,
+ * both for its indexes and for the WAL.
+ *
+ * Both tables are read sorted by key, as text in the C collation for
+ * the order to be total, and merged in a single pass. target is locked
+ * in SHARE ROW EXCLUSIVE mode, so that it can still be read meanwhile.
+ */
+#define PR_SYNC_BATCH 1000
+
+Datum prefix_table_sync(PG_FUNCTION_ARGS);
+
+typedef struct
+{
+  Portal          portal;
+  SPITupleTable  *tuptable;
+  uint64          ntuples;
+  uint64          pos;
+  bool            done;
+} pr_sync_cursor;
+
+static void
+pr_sync_open(pr_sync_cursor *cursor, const char *query) {
+  SPIPlanPtr plan = SPI_prepare(query, 0, NULL);
+
+  if( plan == NULL )
+    elog(ERROR, "SPI_prepare(\"%s\") failed: %s",
+	 query, SPI_result_code_string(SPI_result));
+
+  memset(cursor, 0, sizeof(pr_sync_cursor));
+  cursor->portal = SPI_cursor_open(NULL, plan, NULL, NULL, true);
+}
+
+/*
+ * Returns the next row of the cursor, or NULL when done. The row is
+ * valid until the next call.
+ */
+static HeapTuple
+pr_sync_next(pr_sync_cursor *cursor) {
+  if( cursor->tuptable != NULL && ++cursor->pos < cursor->ntuples )
+    return cursor->tuptable->vals[cursor->pos];
+
+  if( cursor->tuptable != NULL ) {
+    SPI_freetuptable(cursor->tuptable);
+    cursor->tuptable = NULL;
+  }
+
+  if( cursor->done )
+    return NULL;
+
+  SPI_cursor_fetch(cursor->portal, true, PR_SYNC_BATCH);
+  cursor->tuptable = SPI_tuptable;
+  cursor->ntuples  = SPI_processed;
+  cursor->pos      = 0;
+
+  if( cursor->ntuples == 0 ) {
+    SPI_freetuptable(cursor->tuptable);
+    cursor->tuptable = NULL;
+    cursor->done = true;
+    return NULL;
+  }
+  return cursor->tuptable->vals[0];
+}
+
+static SPIPlanPtr
+pr_sync_prepare(const char *query, int nargs, Oid *argtypes) {
+  SPIPlanPtr plan = SPI_prepare(query, nargs, argtypes);
+
+  if( plan == NULL )
+    elog(ERROR, "SPI_prepare(\"%s\") failed: %s",
+	 query, SPI_result_code_string(SPI_result));
+
+  return plan;
+}
+
+static void
+pr_sync_execute(SPIPlanPtr plan, Datum *values, char *nulls) {
+  int ret = SPI_execute_plan(plan, values, nulls, false, 0);
+
+  if( ret < 0 )
+    elog(ERROR, "SPI_execute_plan() failed: %s", SPI_result_code_string(ret));
+}
+
+static char *
+pr_sync_key(HeapTuple tuple, TupleDesc tupdesc, int fnumber) {
+  char *key = SPI_getvalue(tuple, tupdesc, fnumber);
+
+  if( key == NULL )
+    ereport(ERROR,
+	    (errcode(ERRCODE_NOT_NULL_VIOLATION),
+	     errmsg("prefix_table_sync key column must not be NULL")));
+  return key;
+}
+
+/*
+ * Binary comparison of the column values, detoasted first.
+ */
+static bool
+pr_sync_same(HeapTuple t, TupleDesc tdesc, int tnum,
+	     HeapTuple s, TupleDesc sdesc, int snum) {
+  bool tnull, snull;
+  Datum tval = SPI_getbinval(t, tdesc, tnum, &tnull);
+  Datum sval = SPI_getbinval(s, sdesc, snum, &snull);
+  int16 typlen;
+  bool typbyval;
+
+  if( tnull || snull )
+    return tnull == snull;
+
+  get_typlenbyval(SPI_gettypeid(tdesc, tnum), &typlen, &typbyval);
+
+  if( typlen == -1 ) {
+    tval = PointerGetDatum(PG_DETOAST_DATUM(tval));
+    sval = PointerGetDatum(PG_DETOAST_DATUM(sval));
+  }
+  return datumIsEqual(tval, sval, typbyval, typlen);
+}
+
+PG_FUNCTION_INFO_V1(prefix_table_sync);
+Datum
+prefix_table_sync(PG_FUNCTION_ARGS)
+{
+  Oid target  = PG_GETARG_OID(0);
+  Oid staging = PG_GETARG_OID(1);
+  char *key   = NameStr(*PG_GETARG_NAME(2));
+  char *tname, *sname;
+  TupleDesc tupdesc, tdesc, sdesc;
+  StringInfoData sql, cols, params, sets;
+  pr_sync_cursor tc, sc;
+  SPIPlanPtr pdelete, pinsert, pupdate = NULL;
+  MemoryContext rowcxt, oldcxt;
+  HeapTuple t, s;
+  Oid *argtypes;
+  Datum *values;
+  char *nulls;
+  int64 inserted = 0, updated = 0, deleted = 0;
+  int ncols, keycol = -1, i, n;
+  Datum result[3];
+  bool rnulls[3] = {false, false, false};
+
+  if( get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE )
+    elog(ERROR, "return type must be a row type");
+
+  tname = DatumGetCString(DirectFunctionCall1(regclassout, ObjectIdGetDatum(target)));
+  sname = DatumGetCString(DirectFunctionCall1(regclassout, ObjectIdGetDatum(staging)));
+
+  if( SPI_connect() != SPI_OK_CONNECT )
+    elog(ERROR, "SPI_connect() failed");
+
+  initStringInfo(&sql);
+  appendStringInfo(&sql, "LOCK TABLE %s IN SHARE ROW EXCLUSIVE MODE", tname);
+
+  if( SPI_execute(sql.data, false, 0) != SPI_OK_UTILITY )
+    elog(ERROR, "could not lock table %s", tname);
+
+  resetStringInfo(&sql);
+  appendStringInfo(&sql,
+		   "SELECT t.ctid, t.%s::text COLLATE \"C\", t.* FROM %s t ORDER BY 2",
+		   quote_identifier(key), tname);
+  pr_sync_open(&tc, sql.data);
+
+  resetStringInfo(&sql);
+  appendStringInfo(&sql,
+		   "SELECT s.%s::text COLLATE \"C\", s.* FROM %s s ORDER BY 1",
+		   quote_identifier(key), sname);
+  pr_sync_open(&sc, sql.data);
+
+  /*
+   * target rows are (ctid, key, columns...) and staging rows are (key,
+   * columns...), column i being numbered i + 3 and i + 2.
+   */
+  tdesc = tc.portal->tupDesc;
+  sdesc = sc.portal->tupDesc;
+  ncols = sdesc->natts - 1;
+
+  if( tdesc->natts - 2 != ncols )
+    ereport(ERROR,
+	    (errcode(ERRCODE_DATATYPE_MISMATCH),
+	     errmsg("tables %s and %s do not have the same columns", tname, sname)));
+
+  argtypes = (Oid *) palloc((ncols + 1) * sizeof(Oid));
+  values   = (Datum *) palloc((ncols + 1) * sizeof(Datum));
+  nulls    = (char *) palloc(ncols + 1);
+
+  initStringInfo(&cols);
+  initStringInfo(&params);
+  initStringInfo(&sets);
+
+  for(i=0; i<ncols; i++) {
+    char *name = SPI_fname(tdesc, i + 3);
+
+    if( SPI_gettypeid(tdesc, i + 3) != SPI_gettypeid(sdesc, i + 2) )
+      ereport(ERROR,
+	      (errcode(ERRCODE_DATATYPE_MISMATCH),
+	       errmsg("tables %s and %s do not have the same columns", tname, sname)));
+
+    appendStringInfo(&cols, "%s%s", i > 0 ? ", " : "", quote_identifier(name));
+    appendStringInfo(&params, "%s$%d", i > 0 ? ", " : "", i + 1);
+
+    if( strcmp(name, key) == 0 )
+      keycol = i;
+    else
+      appendStringInfo(&sets, "%s%s = $%d",
+		       sets.len > 0 ? ", " : "", quote_identifier(name), i + 2);
+  }
+
+  if( keycol < 0 )
+    ereport(ERROR,
+	    (errcode(ERRCODE_UNDEFINED_COLUMN),
+	     errmsg("column \"%s\" not found in table %s", key, tname)));
+
+  argtypes[0] = TIDOID;
+  resetStringInfo(&sql);
+  appendStringInfo(&sql, "DELETE FROM %s WHERE ctid = $1", tname);
+  pdelete = pr_sync_prepare(sql.data, 1, argtypes);
+
+  for(i=0; i<ncols; i++)
+    argtypes[i] = SPI_gettypeid(sdesc, i + 2);
+
+  resetStringInfo(&sql);
+  appendStringInfo(&sql, "INSERT INTO %s(%s) VALUES(%s)", tname, cols.data, params.data);
+  pinsert = pr_sync_prepare(sql.data, ncols, argtypes);
+
+  if( sets.len > 0 ) {
+    argtypes[0] = TIDOID;
+    for(i=0; i<ncols; i++)
+      argtypes[i + 1] = SPI_gettypeid(sdesc, i + 2);
+
+    resetStringInfo(&sql);
+    appendStringInfo(&sql, "UPDATE %s SET %s WHERE ctid = $1", tname, sets.data);
+    pupdate = pr_sync_prepare(sql.data, ncols + 1, argtypes);
+  }
+
+  rowcxt = AllocSetContextCreate(CurrentMemoryContext,
+				 "prefix_table_sync",
+				 ALLOCSET_DEFAULT_MINSIZE,
+				 ALLOCSET_DEFAULT_INITSIZE,
+				 ALLOCSET_DEFAULT_MAXSIZE);
+
+  t = pr_sync_next(&tc);
+  s = pr_sync_next(&sc);
+
+  while( t != NULL || s != NULL ) {
+    int cmp;
+    bool isnull;
+
+    CHECK_FOR_INTERRUPTS();
+    oldcxt = MemoryContextSwitchTo(rowcxt);
+
+    if( t == NULL )
+      cmp = 1;
+    else if( s == NULL )
+      cmp = -1;
+    else
+      cmp = strcmp(pr_sync_key(t, tdesc, 2), pr_sync_key(s, sdesc, 1));
+
+    if( cmp < 0 ) {
+      values[0] = SPI_getbinval(t, tdesc, 1, &isnull);
+      pr_sync_execute(pdelete, values, NULL);
+      deleted++;
+    }
+    else if( cmp > 0 ) {
+      for(i=0; i<ncols; i++) {
+	values[i] = SPI_getbinval(s, sdesc, i + 2, &isnull);
+	nulls[i]  = isnull ? 'n' : ' ';
+      }
+      pr_sync_execute(pinsert, values, nulls);
+      inserted++;
+    }
+    else if( pupdate != NULL ) {
+      for(i=0; i<ncols; i++)
+	if( i != keycol && !pr_sync_same(t, tdesc, i + 3, s, sdesc, i + 2) )
+	  break;
+
+      if( i < ncols ) {
+	values[0] = SPI_getbinval(t, tdesc, 1, &isnull);
+	nulls[0]  = ' ';
+
+	for(i=0; i<ncols; i++) {
+	  values[i + 1] = SPI_getbinval(s, sdesc, i + 2, &isnull);
+	  nulls[i + 1]  = isnull ? 'n' : ' ';
+	}
+	pr_sync_execute(pupdate, values, nulls);
+	updated++;
+      }
+    }
+    MemoryContextSwitchTo(oldcxt);
+    MemoryContextReset(rowcxt);
+
+    if( cmp <= 0 )
+      t = pr_sync_next(&tc);
+    if( cmp >= 0 )
+      s = pr_sync_next(&sc);
+  }
+
+  SPI_cursor_close(tc.portal);
+  SPI_cursor_close(sc.portal);
+  SPI_finish();
+
+  n = 0;
+  result[n++] = Int64GetDatum(inserted);
+  result[n++] = Int64GetDatum(updated);
+  result[n++] = Int64GetDatum(deleted);
+
+  PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(tupdesc), result, rnulls)));
+}
+
+/**
+ * prefix_overlaps_report(tab regclass, key name, containment bool)
+ *
+ * Reports the pairs of values of the prefix_range column key that
+ * match some common numbers, which makes routing ambiguous:
+ *
+ *  - duplicate, when both values are the same,
+ *  - overlap, for 0146[2-5] and 0146[4-7], where neither value contains
+ *    the other,
+ *  - contains, when a contains b, only reported when containment is
+ *    true, as that's the usual case of a longest prefix match.
+ *
+ * Partial overlaps only happen between ranges of the same prefix, so
+ * rather than comparing all pairs of values, we sort them into a trie
+ * and sweep the entries of each node in (first, last) order. When asked
+ * for containment, the values containing a node are kept on a stack
+ * while walking down the trie.
+ */
+Datum prefix_overlaps_report(PG_FUNCTION_ARGS);
+
+typedef struct
+{
+  Tuplestorestate  *tupstore;
+  TupleDesc         tupdesc;
+  bool              containment;
+  pr_trie_entry   **containers;
+  int               ncontainers;
+  int               maxcontainers;
+} pr_overlaps_state;
+
+static int
+pr_overlaps_cmp(const void *a, const void *b) {
+  const prefix_range *pa = (*(pr_trie_entry * const *) a)->pr;
+  const prefix_range *pb = (*(pr_trie_entry * const *) b)->pr;
+
+  if( pa->first != pb->first )
+    return (uint8) pa->first < (uint8) pb->first ? -1 : 1;
+
+  if( pa->last != pb->last )
+    return (uint8) pa->last < (uint8) pb->last ? -1 : 1;
+
+  return 0;
+}
+
+static void
+pr_overlaps_emit(pr_overlaps_state *state,
+		 prefix_range *a, prefix_range *b, const char *kind) {
+  Datum values[3];
+  bool nulls[3] = {false, false, false};
+  int i;
+
+  values[0] = PrefixRangeGetDatum(a);
+  values[1] = PrefixRangeGetDatum(b);
+  values[2] = CStringGetTextDatum(kind);
+
+  tuplestore_putvalues(state->tupstore, state->tupdesc, values, nulls);
+
+  for(i=0; i<3; i++)
+    pfree(DatumGetPointer(values[i]));
+}
+
+static void
+pr_overlaps_push(pr_overlaps_state *state, pr_trie_entry *entry) {
+  if( state->ncontainers == state->maxcontainers ) {
+    state->maxcontainers = state->maxcontainers == 0 ? 16 : 2 * state->maxcontainers;
+
+    if( state->containers == NULL )
+      state->containers = (pr_trie_entry **)
+	palloc(state->maxcontainers * sizeof(pr_trie_entry *));
+    else
+      state->containers = (pr_trie_entry **)
+	repalloc(state->containers, state->maxcontainers * sizeof(pr_trie_entry *));
+  }
+  state->containers[state->ncontainers++] = entry;
+}
+
+static void
+pr_overlaps_node(pr_overlaps_state *state, pr_trie_node *node) {
+  pr_trie_entry **entries, *e;
+  int n = 0, i, j, k, saved, base;
+
+  check_stack_depth();
+
+  for(e=node->entries; e != NULL; e=e->next)
+    n++;
+
+  entries = (pr_trie_entry **) palloc(Max(n, 1) * sizeof(pr_trie_entry *));
+
+  n = 0;
+  for(e=node->entries; e != NULL; e=e->next)
+    entries[n++] = e;
+
+  qsort(entries, n, sizeof(pr_trie_entry *), pr_overlaps_cmp);
+
+  if( state->containment )
+    for(i=0; i<state->ncontainers; i++)
+      for(j=0; j<n; j++)
+	pr_overlaps_emit(state, state->containers[i]->pr, entries[j]->pr, "contains");
+
+  /*
+   * Plain prefixes sort first, then ranges by first and last, so that we
+   * can stop looking for ranges overlapping a as soon as they begin
+   * after a ends.
+   */
+  for(i=0; i<n; i++) {
+    prefix_range *a = entries[i]->pr;
+
+    for(j=i+1; j<n; j++) {
+      prefix_range *b = entries[j]->pr;
+
+      if( a->first == 0 ) {
+	if( b->first == 0 )
+	  pr_overlaps_emit(state, a, b, "duplicate");
+	else if( state->containment )
+	  pr_overlaps_emit(state, a, b, "contains");
+	else
+	  break;
+	continue;
+      }
+
+      if( (uint8) b->first > (uint8) a->last )
+	break;
+
+      if( a->first == b->first && a->last == b->last )
+	pr_overlaps_emit(state, a, b, "duplicate");
+
+      else if( a->first == b->first ) {
+	if( state->containment )
+	  pr_overlaps_emit(state, b, a, "contains");
+      }
+      else if( (uint8) b->last <= (uint8) a->last ) {
+	if( state->containment )
+	  pr_overlaps_emit(state, a, b, "contains");
+      }
+      else
+	pr_overlaps_emit(state, a, b, "overlap");
+    }
+  }
+
+  saved = state->ncontainers;
+
+  if( state->containment )
+    for(i=0; i<n && entries[i]->pr->first == 0; i++)
+      pr_overlaps_push(state, entries[i]);
+
+  base = state->ncontainers;
+
+  for(k=0; k<node->nchildren; k++) {
+    unsigned char c = node->labels[k];
+
+    state->ncontainers = base;
+
+    if( state->containment )
+      for(i=0; i<n; i++) {
+	prefix_range *r = entries[i]->pr;
+
+	if( r->first != 0 && (uint8) r->first <= c && c <= (uint8) r->last )
+	  pr_overlaps_push(state, entries[i]);
+      }
+
+    pr_overlaps_node(state, node->children[k]);
+  }
+  state->ncontainers = saved;
+
+  pfree(entries);
+}
+
+PG_FUNCTION_INFO_V1(prefix_overlaps_report);
+Datum
+prefix_overlaps_report(PG_FUNCTION_ARGS)
+{
+  Oid relid = PG_GETARG_OID(0);
+  char *key = NameStr(*PG_GETARG_NAME(1));
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+  pr_overlaps_state state;
+  pr_sync_cursor cursor;
+  MemoryContext cxt, oldcxt;
+  StringInfoData sql;
+  TupleDesc tupdesc;
+  HeapTuple tuple;
+  pr_trie *trie;
+  char *relname, *type;
+
+  if( rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo)
+      || (rsinfo->allowedModes & SFRM_Materialize) == 0 )
+    ereport(ERROR,
+	    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	     errmsg("set-valued function called in context that cannot accept a set")));
+
+  if( get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE )
+    elog(ERROR, "return type must be a row type");
+
+  memset(&state, 0, sizeof(pr_overlaps_state));
+  state.containment = PG_GETARG_BOOL(2);
+
+  oldcxt = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+  state.tupdesc  = CreateTupleDescCopy(tupdesc);
+  state.tupstore = tuplestore_begin_heap(true, false, work_mem);
+  MemoryContextSwitchTo(oldcxt);
+
+  cxt = AllocSetContextCreate(CurrentMemoryContext,
+			      "prefix_overlaps_report",
+			      ALLOCSET_DEFAULT_MINSIZE,
+			      ALLOCSET_DEFAULT_INITSIZE,
+			      ALLOCSET_DEFAULT_MAXSIZE);
+
+  oldcxt = MemoryContextSwitchTo(cxt);
+  trie = pr_trie_create();
+  MemoryContextSwitchTo(oldcxt);
+
+  relname = DatumGetCString(DirectFunctionCall1(regclassout, ObjectIdGetDatum(relid)));
+
+  if( SPI_connect() != SPI_OK_CONNECT )
+    elog(ERROR, "SPI_connect() failed");
+
+  initStringInfo(&sql);
+  appendStringInfo(&sql, "SELECT %s FROM %s", quote_identifier(key), relname);
+  pr_sync_open(&cursor, sql.data);
+
+  type = SPI_gettype(cursor.portal->tupDesc, 1);
+  if( type == NULL || strcmp(type, "prefix_range") != 0 )
+    ereport(ERROR,
+	    (errcode(ERRCODE_DATATYPE_MISMATCH),
+	     errmsg("column \"%s\" of table %s is not a prefix_range", key, relname)));
+
+  while( (tuple = pr_sync_next(&cursor)) != NULL ) {
+    bool isnull;
+    Datum d = SPI_getbinval(tuple, cursor.portal->tupDesc, 1, &isnull);
+    prefix_range *pr;
+
+    if( isnull )
+      continue;
+
+    pr = DatumGetPrefixRangeP(d);
+
+    oldcxt = MemoryContextSwitchTo(cxt);
+    pr_trie_insert(trie, build_pr(pr->prefix, pr->first, pr->last), NULL);
+    MemoryContextSwitchTo(oldcxt);
+  }
+
+  SPI_cursor_close(cursor.portal);
+  SPI_finish();
+
+  pr_overlaps_node(&state, trie->root);
+  MemoryContextDelete(cxt);
+
+  rsinfo->returnMode = SFRM_Materialize;
+  rsinfo->setResult  = state.tupstore;
+  rsinfo->setDesc    = state.tupdesc;
+
+  return (Datum) 0;
+}
+
+/**
+ * Rollup of numbers by prefix
+ *
+ * prefix_rollup(number text, value numeric, max_depth int) counts the
+ * numbers and sums their values for every prefix of the numbers up to
+ * max_depth characters, the empty prefix giving the totals, and returns
+ * a prefix_rollup_row[] sorted by prefix:
+ *
+ *   select r.* from unnest((select prefix_rollup(number, duration, 4) from cdr)) r;
+ *
+ * The transition state is a trie of the prefixes, each node counting
+ * the numbers under it. From PostgreSQL 9.6 on the aggregate runs in
+ * parallel: partial tries are serialized as a list of (prefix, count,
+ * sum) and added to each other.
+ */
+Datum prefix_rollup_trans(PG_FUNCTION_ARGS);
+Datum prefix_rollup_combine(PG_FUNCTION_ARGS);
+Datum prefix_rollup_serialize(PG_FUNCTION_ARGS);
+Datum prefix_rollup_deserialize(PG_FUNCTION_ARGS);
+Datum prefix_rollup_final(PG_FUNCTION_ARGS);
+
+typedef struct
+{
+  int64   count;
+  Datum   sum;        /* numeric, valid when hassum */
+  bool    hassum;
+} pr_rollup_counter;
+
+typedef struct
+{
+  pr_trie  *trie;
+  int       maxdepth;
+} pr_rollup_state;
+
+static pr_rollup_state *
+pr_rollup_create(int maxdepth) {
+  pr_rollup_state *state = (pr_rollup_state *) palloc(sizeof(pr_rollup_state));
+
+  state->trie     = pr_trie_create();
+  state->maxdepth = maxdepth;
+  return state;
+}
+
+/*
+ * Adds count and sum to the node counter, allocated in the current
+ * memory context.
+ */
+static void
+pr_rollup_count(pr_trie_node *node, int64 count, Datum sum, bool hassum) {
+  pr_rollup_counter *counter = (pr_rollup_counter *) node->data;
+
+  if( counter == NULL ) {
+    counter = (pr_rollup_counter *) palloc0(sizeof(pr_rollup_counter));
+    node->data = counter;
+  }
+  counter->count += count;
+
+  if( !hassum )
+    return;
+
+  if( counter->hassum ) {
+    Datum old = counter->sum;
+
+    counter->sum = DirectFunctionCall2(numeric_add, old, sum);
+    pfree(DatumGetPointer(old));
+  }
+  else {
+    counter->sum    = datumCopy(sum, false, -1);
+    counter->hassum = true;
+  }
+}
+
+/*
+ * Counts str and all its prefixes up to the state maxdepth.
+ */
+static void
+pr_rollup_add(pr_rollup_state *state, const char *str, int len,
+	      int64 count, Datum sum, bool hassum) {
+  pr_trie_node *node = state->trie->root;
+  int i;
+
+  if( len > state->maxdepth )
+    len = state->maxdepth;
+
+  pr_rollup_count(node, count, sum, hassum);
+
+  for(i=0; i<len; i++) {
+    node = pr_trie_add_child(state->trie, node, (unsigned char) str[i]);
+    pr_rollup_count(node, count, sum, hassum);
+  }
+
+  if( len > state->trie->maxdepth )
+    state->trie->maxdepth = len;
+}
+
+/*
+ * Counts the node of the given prefix only.
+ */
+static void
+pr_rollup_add_node(pr_rollup_state *state, const char *prefix, int len,
+		   int64 count, Datum sum, bool hassum) {
+  pr_trie_node *node = state->trie->root;
+  int i;
+
+  for(i=0; i<len; i++)
+    node = pr_trie_add_child(state->trie, node, (unsigned char) prefix[i]);
+
+  pr_rollup_count(node, count, sum, hassum);
+
+  if( len > state->trie->maxdepth )
+    state->trie->maxdepth = len;
+}
+
+static void
+pr_rollup_merge(pr_rollup_state *state, pr_trie_node *into, pr_trie_node *node) {
+  pr_rollup_counter *counter = (pr_rollup_counter *) node->data;
+  int i;
+
+  check_stack_depth();
+
+  if( counter != NULL )
+    pr_rollup_count(into, counter->count, counter->sum, counter->hassum);
+
+  for(i=0; i<node->nchildren; i++)
+    pr_rollup_merge(state,
+		    pr_trie_add_child(state->trie, into, node->labels[i]),
+		    node->children[i]);
+}
+
+PG_FUNCTION_INFO_V1(prefix_rollup_trans);
+Datum
+prefix_rollup_trans(PG_FUNCTION_ARGS)
+{
+  MemoryContext aggcontext, oldcxt;
+  pr_rollup_state *state;
+  text *number = NULL;
+  Datum value = (Datum) 0;
+  int maxdepth;
+
+  if( !AggCheckCallContext(fcinfo, &aggcontext) )
+    elog(ERROR, "prefix_rollup_trans called in non-aggregate context");
+
+  if( PG_ARGISNULL(3) || PG_GETARG_INT32(3) < 0 )
+    ereport(ERROR,
+	    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+	     errmsg("prefix_rollup max_depth must not be negative")));
+
+  maxdepth = PG_GETARG_INT32(3);
+
+  if( !PG_ARGISNULL(1) )
+    number = PG_GETARG_TEXT_PP(1);
+
+  if( !PG_ARGISNULL(2) )
+    value = PointerGetDatum(PG_DETOAST_DATUM_PACKED(PG_GETARG_DATUM(2)));
+
+  oldcxt = MemoryContextSwitchTo(aggcontext);
+
+  if( PG_ARGISNULL(0) )
+    state = pr_rollup_create(maxdepth);
+  else {
+    state = (pr_rollup_state *) PG_GETARG_POINTER(0);
+
+    if( state->maxdepth != maxdepth )
+      ereport(ERROR,
+	      (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+	       errmsg("prefix_rollup max_depth must be the same for all rows")));
+  }
+
+  if( number != NULL )
+    pr_rollup_add(state, VARDATA_ANY(number), VARSIZE_ANY_EXHDR(number),
+		  1, value, !PG_ARGISNULL(2));
+
+  MemoryContextSwitchTo(oldcxt);
+
+  PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(prefix_rollup_combine);
+Datum
+prefix_rollup_combine(PG_FUNCTION_ARGS)
+{
+  MemoryContext aggcontext, oldcxt;
+  pr_rollup_state *state1, *state2;
+
+  if( !AggCheckCallContext(fcinfo, &aggcontext) )
+    elog(ERROR, "prefix_rollup_combine called in non-aggregate context");
+
+  if( PG_ARGISNULL(1) ) {
+    if( PG_ARGISNULL(0) )
+      PG_RETURN_NULL();
+    PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+  }
+  state2 = (pr_rollup_state *) PG_GETARG_POINTER(1);
+
+  oldcxt = MemoryContextSwitchTo(aggcontext);
+
+  if( PG_ARGISNULL(0) )
+    state1 = pr_rollup_create(state2->maxdepth);
+  else
+    state1 = (pr_rollup_state *) PG_GETARG_POINTER(0);
+
+  pr_rollup_merge(state1, state1->trie->root, state2->trie->root);
+
+  if( state2->trie->maxdepth > state1->trie->maxdepth )
+    state1->trie->maxdepth = state2->trie->maxdepth;
+
+  MemoryContextSwitchTo(oldcxt);
+
+  PG_RETURN_POINTER(state1);
+}
+
+static void
+pr_rollup_send(StringInfo buf, pr_trie_node *node, char *prefix, int depth) {
+  pr_rollup_counter *counter = (pr_rollup_counter *) node->data;
+  int i;
+
+  check_stack_depth();
+
+  if( counter != NULL ) {
+    pq_sendint(buf, depth, 4);
+    pq_sendbytes(buf, prefix, depth);
+    pq_sendint64(buf, counter->count);
+
+    if( counter->hassum ) {
+      int size = VARSIZE_ANY(DatumGetPointer(counter->sum));
+
+      pq_sendint(buf, size, 4);
+      pq_sendbytes(buf, DatumGetPointer(counter->sum), size);
+    }
+    else
+      pq_sendint(buf, -1, 4);
+  }
+
+  for(i=0; i<node->nchildren; i++) {
+    prefix[depth] = (char) node->labels[i];
+    pr_rollup_send(buf, node->children[i], prefix, depth + 1);
+  }
+}
+
+/**
+ * The serialized state is the max_depth, then for each node its prefix
+ * length and bytes, count, and the size and bytes of the sum or -1.
+ */
+PG_FUNCTION_INFO_V1(prefix_rollup_serialize);
+Datum
+prefix_rollup_serialize(PG_FUNCTION_ARGS)
+{
+  pr_rollup_state *state;
+  StringInfoData buf;
+  char *prefix;
+
+  if( !AggCheckCallContext(fcinfo, NULL) )
+    elog(ERROR, "prefix_rollup_serialize called in non-aggregate context");
+
+  state  = (pr_rollup_state *) PG_GETARG_POINTER(0);
+  prefix = (char *) palloc(state->trie->maxdepth + 1);
+
+  pq_begintypsend(&buf);
+  pq_sendint(&buf, state->maxdepth, 4);
+  pr_rollup_send(&buf, state->trie->root, prefix, 0);
+
+  PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+PG_FUNCTION_INFO_V1(prefix_rollup_deserialize);
+Datum
+prefix_rollup_deserialize(PG_FUNCTION_ARGS)
+{
+  MemoryContext aggcontext, oldcxt;
+  bytea *serialized = PG_GETARG_BYTEA_PP(0);
+  pr_rollup_state *state;
+  StringInfoData buf;
+
+  if( !AggCheckCallContext(fcinfo, &aggcontext) )
+    elog(ERROR, "prefix_rollup_deserialize called in non-aggregate context");
+
+  initStringInfo(&buf);
+  appendBinaryStringInfo(&buf, VARDATA_ANY(serialized), VARSIZE_ANY_EXHDR(serialized));
+
+  oldcxt = MemoryContextSwitchTo(aggcontext);
+  state = pr_rollup_create((int) pq_getmsgint(&buf, 4));
+
+  while( buf.cursor < buf.len ) {
+    int len = (int) pq_getmsgint(&buf, 4);
+    const char *prefix = pq_getmsgbytes(&buf, len);
+    int64 count = pq_getmsgint64(&buf);
+    int size = (int) pq_getmsgint(&buf, 4);
+    Datum sum = (Datum) 0;
+
+    /* copy the numeric so that it's aligned */
+    if( size >= 0 ) {
+      sum = PointerGetDatum(palloc(size));
+      memcpy(DatumGetPointer(sum), pq_getmsgbytes(&buf, size), size);
+    }
+
+    pr_rollup_add_node(state, prefix, len, count, sum, size >= 0);
+
+    if( size >= 0 )
+      pfree(DatumGetPointer(sum));
+  }
+  pq_getmsgend(&buf);
+
+  MemoryContextSwitchTo(oldcxt);
+  pfree(buf.data);
+
+  PG_RETURN_POINTER(state);
+}
+
+static void
+pr_rollup_rows(pr_trie_node *node, char *prefix, int depth,
+	       TupleDesc tupdesc, Datum *elems, int *n) {
+  pr_rollup_counter *counter = (pr_rollup_counter *) node->data;
+  Datum values[3];
+  bool nulls[3] = {false, false, false};
+  int i;
+
+  check_stack_depth();
+
+  prefix[depth] = 0;
+  values[0] = PrefixRangeGetDatum(build_pr(prefix, 0, 0));
+  values[1] = Int64GetDatum(counter == NULL ? 0 : counter->count);
+
+  if( counter != NULL && counter->hassum )
+    values[2] = counter->sum;
+  else {
+    values[2] = (Datum) 0;
+    nulls[2]  = true;
+  }
+  elems[(*n)++] = HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls));
+
+  for(i=0; i<node->nchildren; i++) {
+    prefix[depth] = (char) node->labels[i];
+    pr_rollup_rows(node->children[i], prefix, depth + 1, tupdesc, elems, n);
+  }
+}
+
+PG_FUNCTION_INFO_V1(prefix_rollup_final);
+Datum
+prefix_rollup_final(PG_FUNCTION_ARGS)
+{
+  pr_rollup_state *state;
+  Oid rowtype = get_element_type(get_fn_expr_rettype(fcinfo->flinfo));
+  TupleDesc tupdesc;
+  Datum *elems;
+  char *prefix;
+  int n = 0;
+
+  if( PG_ARGISNULL(0) )
+    PG_RETURN_NULL();
+
+  if( !OidIsValid(rowtype) )
+    ereport(ERROR,
+	    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	     errmsg("could not determine the prefix_rollup_row type")));
+
+  state   = (pr_rollup_state *) PG_GETARG_POINTER(0);
+  tupdesc = lookup_rowtype_tupdesc(rowtype, -1);
+  elems   = (Datum *) palloc(state->trie->nnodes * sizeof(Datum));
+  prefix  = (char *) palloc(state->trie->maxdepth + 1);
+
+  pr_rollup_rows(state->trie->root, prefix, 0, tupdesc, elems, &n);
+  ReleaseTupleDesc(tupdesc);
+
+  PG_RETURN_ARRAYTYPE_P(construct_array(elems, n, rowtype, -1, false, 'd'));
+}
+
+/**
+ * Prefix sets
+ *
+ * A prefix_set is a set of prefix_range values stored in a single
+ * datum, written '{0146,0147[2-5],01480}'. The values are normalized
+ * on input the way prefix_range_compact() does it: redundant values are
+ * removed, siblings are merged into ranges and complete sets of
+ * siblings into their parent, so that the values of a set never
+ * overlap.
+ *
+ * The values are stored as a trie laid out breadth first, as for the
+ * routing snapshots, so that prefix_set @> text walks the number once,
+ * in O(number length):
+ *
+ *   header   see prefix_set
+ *   nodes    nnodes pr_set_node, node 0 is the root
+ *   ranges   nranges pairs of first and last characters
+ *   labels   nnodes bytes, labels[i] is the character leading to node i
+ *
+ * Intersection and difference split the ranges of the first set into
+ * plain prefixes, and walk each of them in the trie of the other set.
+ * The difference has to enumerate the siblings of the removed values,
+ * which it takes from pr_char_class(): digits for phone numbers.
+ *
+ * gin_prefix_set_ops indexes the values of the sets, ranges being split
+ * into plain prefixes, to answer prefix_set && prefix_range: the query
+ * looks up the prefixes of the prefix_range as exact keys, and the keys
+ * it is a prefix of with a partial match.
+ */
+Datum prefix_set_in(PG_FUNCTION_ARGS);
+Datum prefix_set_out(PG_FUNCTION_ARGS);
+Datum prefix_set_recv(PG_FUNCTION_ARGS);
+Datum prefix_set_send(PG_FUNCTION_ARGS);
+Datum prefix_set_from_array(PG_FUNCTION_ARGS);
+Datum prefix_set_to_array(PG_FUNCTION_ARGS);
+Datum prefix_set_contains_text(PG_FUNCTION_ARGS);
+Datum text_contained_by_prefix_set(PG_FUNCTION_ARGS);
+Datum prefix_set_overlaps(PG_FUNCTION_ARGS);
+Datum prefix_set_union(PG_FUNCTION_ARGS);
+Datum prefix_set_inter(PG_FUNCTION_ARGS);
+Datum prefix_set_except(PG_FUNCTION_ARGS);
+Datum gin_prefix_set_extract_value(PG_FUNCTION_ARGS);
+Datum gin_prefix_set_extract_query(PG_FUNCTION_ARGS);
+Datum gin_prefix_set_consistent(PG_FUNCTION_ARGS);
+Datum gin_prefix_set_compare_partial(PG_FUNCTION_ARGS);
+
+typedef struct
+{
+  int32   vl_len_;        /* varlena header (do not touch directly!) */
+  uint32  nvalues;        /* number of prefix_range values */
+  uint32  nnodes;
+  uint32  nranges;
+  uint32  maxdepth;       /* length of the longest prefix */
+} prefix_set;
+
+typedef struct
+{
+  uint32  first_child;    /* node index of the first child */
+  uint32  first_range;    /* index of the first range */
+  uint16  nchildren;
+  uint8   nranges;
+  uint8   plain;          /* a plain prefix ends here */
+} pr_set_node;
+
+#define PR_SET_NODES(s)           ((pr_set_node *) ((char *) (s) + sizeof(prefix_set)))
+#define PR_SET_RANGES(s)          ((uint8 *) (PR_SET_NODES(s) + (s)->nnodes))
+#define PR_SET_LABELS(s)          (PR_SET_RANGES(s) + 2 * (s)->nranges)
+
+#define DatumGetPrefixSet(X)      ((prefix_set *) PG_DETOAST_DATUM(X))
+#define PG_GETARG_PREFIX_SET_P(n) DatumGetPrefixSet(PG_GETARG_DATUM(n))
+#define PG_RETURN_PREFIX_SET_P(x) PG_RETURN_POINTER(x)
+
+static int
+pr_set_range_cmp(const void *a, const void *b) {
+  const prefix_range *pa = *(prefix_range * const *) a;
+  const prefix_range *pb = *(prefix_range * const *) b;
+
+  return (int) (uint8) pa->first - (int) (uint8) pb->first;
+}
+
+/*
+ * Lays out a list of values as a prefix_set, the values must have been
+ * compacted, see pr_compact_list().
+ */
+static prefix_set *
+pr_set_build(List *values) {
+  pr_trie *trie = pr_trie_create();
+  pr_trie_node **queue;
+  prefix_range **ranges;
+  prefix_set *set;
+  pr_set_node *nodes;
+  uint8 *sranges, *labels;
+  ListCell *lc;
+  Size size;
+  uint32 head, tail = 0, nextchild = 1, nextrange = 0, nranges = 0;
+
+  foreach(lc, values) {
+    prefix_range *pr = (prefix_range *) lfirst(lc);
+
+    pr_trie_insert(trie, pr, NULL);
+    if( pr->first != 0 )
+      nranges++;
+  }
+
+  size = sizeof(prefix_set)
+    + (Size) trie->nnodes * (sizeof(pr_set_node) + 1) + 2 * (Size) nranges;
+
+  if( size > MaxAllocSize )
+    ereport(ERROR,
+	    (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+	     errmsg("prefix_set would be too large")));
+
+  set = (prefix_set *) palloc0(size);
+  SET_VARSIZE(set, size);
+  set->nvalues  = list_length(values);
+  set->nnodes   = trie->nnodes;
+  set->nranges  = nranges;
+  set->maxdepth = trie->maxdepth;
+
+  nodes   = PR_SET_NODES(set);
+  sranges = PR_SET_RANGES(set);
+  labels  = PR_SET_LABELS(set);
+
+  queue  = (pr_trie_node **) palloc(trie->nnodes * sizeof(pr_trie_node *));
+  ranges = (prefix_range **) palloc(Max(nranges, 1) * sizeof(prefix_range *));
+
+  queue[tail++] = trie->root;
+
+  for(head = 0; head < tail; head++) {
+    pr_trie_node *node = queue[head];
+    pr_trie_entry *e;
+    int i, n = 0;
+
+    nodes[head].first_child = nextchild;
+    nodes[head].nchildren   = node->nchildren;
+
+    for(i=0; i<node->nchildren; i++) {
+      labels[nextchild + i] = node->labels[i];
+      queue[tail++] = node->children[i];
+    }
+    nextchild += node->nchildren;
+
+    for(e=node->entries; e != NULL; e=e->next) {
+      if( e->pr->first == 0 )
+	nodes[head].plain = 1;
+      else
+	ranges[n++] = e->pr;
+    }
+    qsort(ranges, n, sizeof(prefix_range *), pr_set_range_cmp);
+
+    nodes[head].first_range = nextrange;
+    nodes[head].nranges     = n;
+
+    for(i=0; i<n; i++) {
+      sranges[2 * nextrange]     = (uint8) ranges[i]->first;
+      sranges[2 * nextrange + 1] = (uint8) ranges[i]->last;
+      nextrange++;
+    }
+  }
+  pfree(queue);
+  pfree(ranges);
+
+  return set;
+}
+
+static inline
+prefix_set *pr_set_from_trie(pr_trie *trie) {
+  return pr_set_build(pr_compact_list(trie));
+}
+
+static inline
+int pr_set_child(prefix_set *set, pr_set_node *node, unsigned char c) {
+  uint8 *labels = PR_SET_LABELS(set);
+  uint32 lo = node->first_child, hi = node->first_child + node->nchildren;
+
+  while( lo < hi ) {
+    uint32 mid = lo + (hi - lo) / 2;
+
+    if( labels[mid] < c )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if( lo < node->first_child + node->nchildren && labels[lo] == c )
+    return (int) lo;
+  return -1;
+}
+
+static inline
+bool pr_set_node_covers(prefix_set *set, pr_set_node *node, unsigned char c) {
+  uint8 *ranges = PR_SET_RANGES(set) + 2 * node->first_range;
+  int i;
+
+  for(i=0; i<node->nranges; i++)
+    if( ranges[2 * i] <= c && c <= ranges[2 * i + 1] )
+      return true;
+  return false;
+}
+
+/*
+ * Is the plain prefix str, of length len, contained in the set? When
+ * it is not, *found is the node reached by str, or -1.
+ */
+static bool
+pr_set_covers(prefix_set *set, const char *str, int len, int *found) {
+  pr_set_node *nodes = PR_SET_NODES(set);
+  int current = 0, depth;
+
+  *found = -1;
+
+  for(depth=0; ; depth++) {
+    pr_set_node *node = &nodes[current];
+
+    if( node->plain )
+      return true;
+
+    if( depth == len ) {
+      *found = current;
+      return false;
+    }
+
+    if( pr_set_node_covers(set, node, (unsigned char) str[depth]) )
+      return true;
+
+    current = pr_set_child(set, node, (unsigned char) str[depth]);
+
+    if( current < 0 )
+      return false;
+  }
+}
+
+/*
+ * Appends to *result the values found under the given node, buf holding
+ * the node prefix in its first depth characters.
+ */
+static void
+pr_set_walk(prefix_set *set, int current, char *buf, int depth, List **result) {
+  pr_set_node *node = &PR_SET_NODES(set)[current];
+  uint8 *ranges = PR_SET_RANGES(set) + 2 * node->first_range;
+  uint8 *labels = PR_SET_LABELS(set);
+  int i;
+
+  check_stack_depth();
+
+  buf[depth] = 0;
+
+  if( node->plain )
+    *result = lappend(*result, build_pr(buf, 0, 0));
+
+  for(i=0; i<node->nranges; i++)
+    *result = lappend(*result,
+		      build_pr(buf, (char) ranges[2 * i], (char) ranges[2 * i + 1]));
+
+  for(i=0; i<node->nchildren; i++) {
+    buf[depth] = (char) labels[node->first_child + i];
+    pr_set_walk(set, node->first_child + i, buf, depth + 1, result);
+  }
+}
+
+static List *
+pr_set_values(prefix_set *set) {
+  List *result = NIL;
+  char *buf = (char *) palloc(set->maxdepth + 1);
+
+  pr_set_walk(set, 0, buf, 0, &result);
+  pfree(buf);
+
+  return result;
+}
+
+/*
+ * Adds to result the plain prefixes under the given node that are not
+ * in the set, buf holding the node prefix in its first depth characters
+ * and having room for two more.
+ */
+static void
+pr_set_subtract(prefix_set *set, int current, char *buf, int depth, pr_trie *result) {
+  pr_set_node *node = &PR_SET_NODES(set)[current];
+  uint8 *ranges = PR_SET_RANGES(set) + 2 * node->first_range;
+  uint8 *labels = PR_SET_LABELS(set) + node->first_child;
+  char lo, hi, c0;
+  int c, i;
+
+  check_stack_depth();
+
+  if( node->nranges == 0 && node->nchildren == 0 ) {
+    buf[depth] = 0;
+    pr_trie_insert(result, build_pr(buf, 0, 0), NULL);
+    return;
+  }
+
+  c0 = (char) (node->nranges > 0 ? ranges[0] : labels[0]);
+
+  if( !pr_char_class(c0, &lo, &hi)
+      || (node->nranges > 0
+	  && (ranges[0] < (uint8) lo
+	      || ranges[2 * node->nranges - 1] > (uint8) hi))
+      || (node->nchildren > 0
+	  && (labels[0] < (uint8) lo
+	      || labels[node->nchildren - 1] > (uint8) hi)) )
+    ereport(ERROR,
+	    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	     errmsg("prefix_set difference only supports digits and letters")));
+
+  for(c=(unsigned char) lo; c<=(unsigned char) hi; c++) {
+    if( pr_set_node_covers(set, node, (unsigned char) c) )
+      continue;
+
+    buf[depth] = (char) c;
+    i = pr_set_child(set, node, (unsigned char) c);
+
+    if( i < 0 ) {
+      buf[depth + 1] = 0;
+      pr_trie_insert(result, build_pr(buf, 0, 0), NULL);
+    }
+    else if( !PR_SET_NODES(set)[i].plain )
+      pr_set_subtract(set, i, buf, depth + 1, result);
+  }
+}
+
+/*
+ * Adds to result what of the plain prefix str is in the set (inter) or
+ * is not (!inter). str has room for set->maxdepth + 2 characters.
+ */
+static void
+pr_set_apply(prefix_set *set, char *str, int len, bool inter, pr_trie *result) {
+  List *values = NIL;
+  ListCell *lc;
+  int found;
+
+  str[len] = 0;
+
+  if( pr_set_covers(set, str, len, &found) ) {
+    if( inter )
+      pr_trie_insert(result, build_pr(str, 0, 0), NULL);
+    return;
+  }
+
+  if( found < 0 ) {
+    if( !inter )
+      pr_trie_insert(result, build_pr(str, 0, 0), NULL);
+    return;
+  }
+
+  if( !inter ) {
+    pr_set_subtract(set, found, str, len, result);
+    return;
+  }
+
+  pr_set_walk(set, found, str, len, &values);
+
+  foreach(lc, values)
+    pr_trie_insert(result, (prefix_range *) lfirst(lc), NULL);
+}
+
+/*
+ * a & b when inter, a - b otherwise.
+ */
+static prefix_set *
+pr_set_combine(prefix_set *a, prefix_set *b, bool inter) {
+  pr_trie *trie = pr_trie_create();
+  List *values = pr_set_values(a);
+  ListCell *lc;
+
+  foreach(lc, values) {
+    prefix_range *pr = (prefix_range *) lfirst(lc);
+    int len = strlen(pr->prefix);
+    char *buf = (char *) palloc(Max(len + 1, (int) b->maxdepth) + 2);
+    int c;
+
+    memcpy(buf, pr->prefix, len);
+
+    if( pr->first == 0 )
+      pr_set_apply(b, buf, len, inter, trie);
+    else {
+      for(c=(unsigned char) pr->first; c<=(unsigned char) pr->last; c++) {
+	buf[len] = (char) c;
+	pr_set_apply(b, buf, len + 1, inter, trie);
+      }
+    }
+    pfree(buf);
+  }
+  return pr_set_from_trie(trie);
+}
+
+/*
+ * Does the set overlap with pr?
+ */
+static bool
+pr_set_overlaps(prefix_set *set, prefix_range *pr) {
+  pr_set_node *node;
+  uint8 *ranges, *labels;
+  int len = strlen(pr->prefix), found, i;
+
+  if( set->nvalues == 0 )
+    return false;
+
+  if( pr_set_covers(set, pr->prefix, len, &found) )
+    return true;
+
+  if( found < 0 )
+    return false;
+
+  /* found has values under it */
+  if( pr->first == 0 )
+    return true;
+
+  node   = &PR_SET_NODES(set)[found];
+  ranges = PR_SET_RANGES(set) + 2 * node->first_range;
+  labels = PR_SET_LABELS(set) + node->first_child;
+
+  for(i=0; i<node->nranges; i++)
+    if( ranges[2 * i] <= (uint8) pr->last && ranges[2 * i + 1] >= (uint8) pr->first )
+      return true;
+
+  for(i=0; i<node->nchildren; i++)
+    if( (uint8) pr->first <= labels[i] && labels[i] <= (uint8) pr->last )
+      return true;
+
+  return false;
+}
+
+static inline
+void pr_set_invalid(const char *str) {
+  ereport(ERROR,
+	  (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+	   errmsg("invalid prefix_set value: \"%s\"", str)));
+}
+
+PG_FUNCTION_INFO_V1(prefix_set_in);
+Datum
+prefix_set_in(PG_FUNCTION_ARGS)
+{
+  char *str   = PG_GETARG_CSTRING(0);
+  char *input = pstrdup(str);
+  char *ptr   = input, *end;
+  pr_trie *trie = pr_trie_create();
+
+  while( *ptr == ' ' || *ptr == '\t' || *ptr == '\n' )
+    ptr++;
+
+  end = ptr + strlen(ptr);
+  while( end > ptr && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n') )
+    end--;
+
+  if( end - ptr < 2 || *ptr != '{' || end[-1] != '}' )
+    pr_set_invalid(str);
+
+  ptr++;
+  *--end = 0;
+
+  while( *ptr == ' ' || *ptr == '\t' || *ptr == '\n' )
+    ptr++;
+
+  /* '{}' is the empty set */
+  while( *ptr != 0 ) {
+    char *value = ptr, *last;
+    prefix_range *pr;
+
+    while( *ptr != 0 && *ptr != ',' )
+      ptr++;
+
+    last = ptr;
+    while( last > value && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\n') )
+      last--;
+
+    if( last == value )
+      pr_set_invalid(str);
+
+    if( *ptr == ',' ) {
+      ptr++;
+      while( *ptr == ' ' || *ptr == '\t' || *ptr == '\n' )
+	ptr++;
+
+      if( *ptr == 0 )
+	pr_set_invalid(str);
+    }
+    *last = 0;
+
+    pr = pr_from_str(value);
+    if( pr == NULL )
+      pr_set_invalid(str);
+
+    pr_trie_insert(trie, pr_normalize(pr), NULL);
+  }
+
+  PG_RETURN_PREFIX_SET_P(pr_set_from_trie(trie));
+}
+
+PG_FUNCTION_INFO_V1(prefix_set_out);
+Datum
+prefix_set_out(PG_FUNCTION_ARGS)
+{
+  prefix_set *set = PG_GETARG_PREFIX_SET_P(0);
+  List *values = pr_set_values(set);
+  StringInfoData buf;
+  ListCell *lc;
+
+  initStringInfo(&buf);
+  appendStringInfoChar(&buf, '{');
+
+  foreach(lc, values) {
+    prefix_range *pr = (prefix_range *) lfirst(lc);
+
+    if( lc != list_head(values) )
+      appendStringInfoChar(&buf, ',');
+
+    appendStringInfoString(&buf, pr->prefix);
+
+    if( pr->first != 0 )
+      appendStringInfo(&buf, "[%c-%c]", pr->first, pr->last);
+  }
+  appendStringInfoChar(&buf, '}');
+
+  PG_RETURN_CSTRING(buf.data);
+}
+
+/**
+ * The binary format is the number of values, then each value as in
+ * prefix_range_send().
+ */
+PG_FUNCTION_INFO_V1(prefix_set_recv);
+Datum
+prefix_set_recv(PG_FUNCTION_ARGS)
+{
+  StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+  int nvalues = (int) pq_getmsgint(buf, 4);
+  pr_trie *trie = pr_trie_create();
+  int i;
+
+  for(i=0; i<nvalues; i++) {
+    const char *first  = pq_getmsgbytes(buf, 1);
+    const char *last   = pq_getmsgbytes(buf, 1);
+    const char *prefix = pq_getmsgstring(buf);
+
+    pr_trie_insert(trie, pr_normalize(build_pr(prefix, *first, *last)), NULL);
+  }
+  pq_getmsgend(buf);
+
+  PG_RETURN_PREFIX_SET_P(pr_set_from_trie(trie));
+}
+
+PG_FUNCTION_INFO_V1(prefix_set_send);
+Datum
+prefix_set_send(PG_FUNCTION_ARGS)
+{
+  prefix_set *set = PG_GETARG_PREFIX_SET_P(0);
+  List *values = pr_set_values(set);
+  StringInfoData buf;
+  ListCell *lc;
+
+  pq_begintypsend(&buf);
+  pq_sendint(&buf, list_length(values), 4);
+
+  foreach(lc, values) {
+    prefix_range *pr = (prefix_range *) lfirst(lc);
+
+    pq_sendbyte(&buf, pr->first);
+    pq_sendbyte(&buf, pr->last);
+    pq_sendstring(&buf, pr->prefix);
+  }
+
+  PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+PG_FUNCTION_INFO_V1(prefix_set_from_array);
+Datum
+prefix_set_from_array(PG_FUNCTION_ARGS)
+{
+  ArrayType *array = PG_GETARG_ARRAYTYPE_P(0);
+  pr_trie *trie = pr_trie_create();
+  Datum *elems;
+  bool *nulls;
+  int16 typlen;
+  bool typbyval;
+  char typalign;
+  int nelems, i;
+
+  get_typlenbyvalalign(ARR_ELEMTYPE(array), &typlen, &typbyval, &typalign);
+  deconstruct_array(array, ARR_ELEMTYPE(array), typlen, typbyval, typalign,
+		    &elems, &nulls, &nelems);
+
+  for(i=0; i<nelems; i++) {
+    prefix_range *pr;
+
+    if( nulls[i] )
+      continue;
+
+    pr = DatumGetPrefixRangeP(elems[i]);
+    pr_trie_insert(trie, pr_normalize(pr), NULL);
+  }
+
+  PG_RETURN_PREFIX_SET_P(pr_set_from_trie(trie));
+}
+
+PG_FUNCTION_INFO_V1(prefix_set_to_array);
+Datum
+prefix_set_to_array(PG_FUNCTION_ARGS)
+{
+  prefix_set *set = PG_GETARG_PREFIX_SET_P(0);
+  Oid prtype = get_element_type(get_fn_expr_rettype(fcinfo->flinfo));
+  List *values;
+  ListCell *lc;
+  Datum *elems;
+  int n = 0;
+
+  if( !OidIsValid(prtype) )
+    ereport(ERROR,
+	    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	     errmsg("could not determine the prefix_range type")));
+
+  values = pr_set_values(set);
+  elems  = (Datum *) palloc(Max(list_length(values), 1) * sizeof(Datum));
+
+  foreach(lc, values)
+    elems[n++] = PrefixRangeGetDatum((prefix_range *) lfirst(lc));
+
+  PG_RETURN_ARRAYTYPE_P(construct_array(elems, n, prtype, -1, false, 'i'));
+}
+
+PG_FUNCTION_INFO_V1(prefix_set_contains_text);
+Datum
+prefix_set_contains_text(PG_FUNCTION_ARGS)
+{
+  prefix_set *set = PG_GETARG_PREFIX_SET_P(0);
+  text *number    = PG_GETARG_TEXT_PP(1);
+  int found;
+
+  PG_RETURN_BOOL( pr_set_covers(set, VARDATA_ANY(number),
+				VARSIZE_ANY_EXHDR(number), &found) );
+}
+
+PG_FUNCTION_INFO_V1(text_contained_by_prefix_set);
+Datum
+text_contained_by_prefix_set(PG_FUNCTION_ARGS)
+{
+  text *number    = PG_GETARG_TEXT_PP(0);
+  prefix_set *set = PG_GETARG_PREFIX_SET_P(1);
+  int found;
+
+  PG_RETURN_BOOL( pr_set_covers(set, VARDATA_ANY(number),
+				VARSIZE_ANY_EXHDR(number), &found) );
+}
+
+PG_FUNCTION_INFO_V1(prefix_set_overlaps);
+Datum
+prefix_set_overlaps(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL( pr_set_overlaps(PG_GETARG_PREFIX_SET_P(0),
+				  PG_GETARG_PREFIX_RANGE_P(1)) );
+}
+
+PG_FUNCTION_INFO_V1(prefix_set_union);
+Datum
+prefix_set_union(PG_FUNCTION_ARGS)
+{
+  prefix_set *a = PG_GETARG_PREFIX_SET_P(0);
+  prefix_set *b = PG_GETARG_PREFIX_SET_P(1);
+  pr_trie *trie = pr_trie_create();
+  List *values = list_concat(pr_set_values(a), pr_set_values(b));
+  ListCell *lc;
+
+  foreach(lc, values)
+    pr_trie_insert(trie, (prefix_range *) lfirst(lc), NULL);
+
+  PG_RETURN_PREFIX_SET_P(pr_set_from_trie(trie));
+}
+
+PG_FUNCTION_INFO_V1(prefix_set_inter);
+Datum
+prefix_set_inter(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_PREFIX_SET_P(pr_set_combine(PG_GETARG_PREFIX_SET_P(0),
+					PG_GETARG_PREFIX_SET_P(1), true));
+}
+
+PG_FUNCTION_INFO_V1(prefix_set_except);
+Datum
+prefix_set_except(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_PREFIX_SET_P(pr_set_combine(PG_GETARG_PREFIX_SET_P(0),
+					PG_GETARG_PREFIX_SET_P(1), false));
+}
+
+PG_FUNCTION_INFO_V1(gin_prefix_set_extract_value);
+Datum
+gin_prefix_set_extract_value(PG_FUNCTION_ARGS)
+{
+  prefix_set *set = PG_GETARG_PREFIX_SET_P(0);
+  int32 *nkeys    = (int32 *) PG_GETARG_POINTER(1);
+  List *values    = pr_set_values(set);
+  ListCell *lc;
+  Datum *keys;
+  int n = 0, max = 0;
+
+  foreach(lc, values) {
+    prefix_range *pr = (prefix_range *) lfirst(lc);
+
+    max += pr->first == 0 ? 1 : (unsigned char) pr->last - (unsigned char) pr->first + 1;
+  }
+  keys = (Datum *) palloc(Max(max, 1) * sizeof(Datum));
+
+  foreach(lc, values) {
+    prefix_range *pr = (prefix_range *) lfirst(lc);
+    int len = strlen(pr->prefix), c;
+
+    if( pr->first == 0 ) {
+      keys[n++] = PointerGetDatum(cstring_to_text_with_len(pr->prefix, len));
+      continue;
+    }
+
+    for(c=(unsigned char) pr->first; c<=(unsigned char) pr->last; c++) {
+      char *buf = (char *) palloc(len + 1);
+
+      memcpy(buf, pr->prefix, len);
+      buf[len] = (char) c;
+      keys[n++] = PointerGetDatum(cstring_to_text_with_len(buf, len + 1));
+      pfree(buf);
+    }
+  }
+
+  *nkeys = n;
+  PG_RETURN_POINTER(keys);
+}
+
+/*
+ * The prefixes of the query are exact keys, the query itself is a
+ * partial match key, see gin_prefix_set_compare_partial().
+ */
+PG_FUNCTION_INFO_V1(gin_prefix_set_extract_query);
+Datum
+gin_prefix_set_extract_query(PG_FUNCTION_ARGS)
+{
+  prefix_range *pr     = PG_GETARG_PREFIX_RANGE_P(0);
+  int32 *nkeys         = (int32 *) PG_GETARG_POINTER(1);
+  bool **pmatch        = (bool **) PG_GETARG_POINTER(3);
+  Pointer **extra_data = (Pointer **) PG_GETARG_POINTER(4);
+  int len              = strlen(pr->prefix);
+  Datum *keys;
+  int i;
+
+  keys        = (Datum *) palloc((len + 1) * sizeof(Datum));
+  *pmatch     = (bool *) palloc0((len + 1) * sizeof(bool));
+  *extra_data = (Pointer *) palloc0((len + 1) * sizeof(Pointer));
+
+  for(i=0; i<=len; i++)
+    keys[i] = PointerGetDatum(cstring_to_text_with_len(pr->prefix, i));
+
+  (*pmatch)[len]     = true;
+  (*extra_data)[len] = (Pointer) build_pr(pr->prefix, pr->first, pr->last);
+
+  *nkeys = len + 1;
+  PG_RETURN_POINTER(keys);
+}
+
+/*
+ * Keys are scanned in bytes order from the query prefix on: keys that
+ * have the prefix match, unless the query is a range and the next
+ * character is not in it.
+ */
+PG_FUNCTION_INFO_V1(gin_prefix_set_compare_partial);
+Datum
+gin_prefix_set_compare_partial(PG_FUNCTION_ARGS)
+{
+  text *partial    = PG_GETARG_TEXT_PP(0);
+  text *key        = PG_GETARG_TEXT_PP(1);
+  prefix_range *pr = (prefix_range *) PG_GETARG_POINTER(3);
+  int plen = VARSIZE_ANY_EXHDR(partial);
+  int klen = VARSIZE_ANY_EXHDR(key);
+  unsigned char c;
+
+  if( klen < plen || memcmp(VARDATA_ANY(key), VARDATA_ANY(partial), plen) != 0 )
+    PG_RETURN_INT32(1);
+
+  if( klen == plen || pr->first == 0 )
+    PG_RETURN_INT32(0);
+
+  c = (unsigned char) VARDATA_ANY(key)[plen];
+
+  if( c < (unsigned char) pr->first )
+    PG_RETURN_INT32(-1);
+
+  PG_RETURN_INT32(c > (unsigned char) pr->last ? 1 : 0);
+}
+
+/*
+ * Set values are indexed as plain prefixes, so that any key found means
+ * an overlap, without recheck.
+ */
+PG_FUNCTION_INFO_V1(gin_prefix_set_consistent);
+Datum
+gin_prefix_set_consistent(PG_FUNCTION_ARGS)
+{
+  bool *check   = (bool *) PG_GETARG_POINTER(0);
+  int32 nkeys   = PG_GETARG_INT32(3);
+  bool *recheck = (bool *) PG_GETARG_POINTER(5);
+  int i;
+
+  *recheck = false;
+
+  for(i=0; i<nkeys; i++)
+    if( check[i] )
+      PG_RETURN_BOOL(true);
+
+  PG_RETURN_BOOL(false);
+}
+
+/**
+ * Time-versioned prefixes
+ *
+ * A prefix_period is a prefix_range valid for a period of time, from
+ * its lower bound included to its upper bound excluded, written
+ * '0146[2-5]@[2024-01-01 00:00:00+00,2025-01-01 00:00:00+00)'. Rate
+ * decks with effective dates keep one per row:
+ *
+ *   select * from rates
+ *    where period @> prefix_period('0146640123', '2024-06-01')
+ * order by length(prefix(period)) desc
+ *    limit 1;
+ *
+ * Periods are never empty. The query above builds the period of an
+ * instant as the single microsecond [t, t + 1us), which is contained in
+ * the periods including t, as in tstzrange.
+ *
+ * Two GiST columns (prefix_range, tstzrange) are split independently,
+ * so gist_prefix_period_ops indexes both in a single key instead. The
+ * penalty is the prefix_range one, with the enlargement of the period
+ * as a tie breaker, and picksplit sorts the entries by prefix then by
+ * period, cutting where the prefixes of the neighbours share the
+ * shortest common prefix: pages hold a prefix subtree, and entries of
+ * the same prefixes are split by period.
+ */
+Datum prefix_period_in(PG_FUNCTION_ARGS);
+Datum prefix_period_out(PG_FUNCTION_ARGS);
+Datum prefix_period_recv(PG_FUNCTION_ARGS);
+Datum prefix_period_send(PG_FUNCTION_ARGS);
+Datum prefix_period_make(PG_FUNCTION_ARGS);
+Datum prefix_period_at(PG_FUNCTION_ARGS);
+Datum prefix_period_prefix(PG_FUNCTION_ARGS);
+Datum prefix_period_lower(PG_FUNCTION_ARGS);
+Datum prefix_period_upper(PG_FUNCTION_ARGS);
+Datum prefix_period_contains(PG_FUNCTION_ARGS);
+Datum prefix_period_overlaps(PG_FUNCTION_ARGS);
+Datum gpp_consistent(PG_FUNCTION_ARGS);
+Datum gpp_compress(PG_FUNCTION_ARGS);
+Datum gpp_decompress(PG_FUNCTION_ARGS);
+Datum gpp_penalty(PG_FUNCTION_ARGS);
+Datum gpp_picksplit(PG_FUNCTION_ARGS);
+Datum gpp_union(PG_FUNCTION_ARGS);
+Datum gpp_same(PG_FUNCTION_ARGS);
+
+typedef struct
+{
+  int32         vl_len_;    /* varlena header (do not touch directly!) */
+  int32         reserved;
+  TimestampTz   lower;      /* included */
+  TimestampTz   upper;      /* excluded, greater than lower */
+  prefix_range  pr;         /* variable length, must be last */
+} prefix_period;
+
+#define DatumGetPrefixPeriod(X)       ((prefix_period *) PG_DETOAST_DATUM(X))
+#define PG_GETARG_PREFIX_PERIOD_P(n)  DatumGetPrefixPeriod(PG_GETARG_DATUM(n))
+#define PG_RETURN_PREFIX_PERIOD_P(x)  PG_RETURN_POINTER(x)
+
+static prefix_period *
+pr_period_build(prefix_range *pr, TimestampTz lower, TimestampTz upper) {
+  int len = strlen(pr->prefix);
+  Size size = offsetof(prefix_period, pr) + sizeof(prefix_range) + len;
+  prefix_period *pp = (prefix_period *) palloc0(size);
+
+  SET_VARSIZE(pp, size);
+  pp->lower    = lower;
+  pp->upper    = upper;
+  pp->pr.first = pr->first;
+  pp->pr.last  = pr->last;
+  memcpy(pp->pr.prefix, pr->prefix, len + 1);
+
+  return pp;
+}
+
+static inline
+bool pr_period_contains(prefix_period *a, prefix_period *b) {
+  return a->lower <= b->lower && b->upper <= a->upper
+    && pr_contains(&a->pr, &b->pr, true);
+}
+
+static inline
+bool pr_period_overlaps(prefix_period *a, prefix_period *b) {
+  return a->lower < b->upper && b->lower < a->upper
+    && pr_overlaps(&a->pr, &b->pr);
+}
+
+/*
+ * Part of the union of the periods of a and b that is not in a, from 0
+ * to 1.
+ */
+static float
+pr_period_enlargement(prefix_period *a, prefix_period *b) {
+  double width, enlarged;
+
+  if( a->lower <= b->lower && b->upper <= a->upper )
+    return 0;
+
+  if( TIMESTAMP_NOT_FINITE(b->lower) || TIMESTAMP_NOT_FINITE(b->upper)
+      || TIMESTAMP_NOT_FINITE(a->lower) || TIMESTAMP_NOT_FINITE(a->upper) )
+    return 1;
+
+  width    = (double) a->upper - (double) a->lower;
+  enlarged = (double) Max(a->upper, b->upper) - (double) Min(a->lower, b->lower);
+
+  return enlarged <= 0 ? 0 : (float) ((enlarged - width) / enlarged);
+}
+
+static prefix_period *
+pr_period_union(prefix_period *a, prefix_period *b) {
+  return pr_period_build(pr_union(&a->pr, &b->pr),
+			 Min(a->lower, b->lower), Max(a->upper, b->upper));
+}
+
+static inline
+void pr_period_invalid(const char *str) {
+  ereport(ERROR,
+	  (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+	   errmsg("invalid prefix_period value: \"%s\"", str)));
+}
+
+static inline
+void pr_period_check(TimestampTz lower, TimestampTz upper) {
+  if( lower >= upper )
+    ereport(ERROR,
+	    (errcode(ERRCODE_DATA_EXCEPTION),
+	     errmsg("prefix_period lower bound must be less than upper bound")));
+}
+
+PG_FUNCTION_INFO_V1(prefix_period_in);
+Datum
+prefix_period_in(PG_FUNCTION_ARGS)
+{
+  char *str   = PG_GETARG_CSTRING(0);
+  char *input = pstrdup(str);
+  char *at    = strrchr(input, '@');
+  char *sep, *end;
+  prefix_range *pr;
+  TimestampTz lower, upper;
+
+  if( at == NULL )
+    pr_period_invalid(str);
+
+  *at++ = 0;
+  end = at + strlen(at);
+
+  if( *at != '[' || end == at + 1 || end[-1] != ')' )
+    pr_period_invalid(str);
+
+  sep = strchr(at, ',');
+  if( sep == NULL )
+    pr_period_invalid(str);
+
+  *sep = 0;
+  end[-1] = 0;
+
+  pr = pr_from_str(input);
+  if( pr == NULL )
+    pr_period_invalid(str);
+
+  lower = DatumGetTimestampTz(DirectFunctionCall3(timestamptz_in,
+						  CStringGetDatum(at + 1),
+						  ObjectIdGetDatum(InvalidOid),
+						  Int32GetDatum(-1)));
+  upper = DatumGetTimestampTz(DirectFunctionCall3(timestamptz_in,
+						  CStringGetDatum(sep + 1),
+						  ObjectIdGetDatum(InvalidOid),
+						  Int32GetDatum(-1)));
+  pr_period_check(lower, upper);
+
+  PG_RETURN_PREFIX_PERIOD_P(pr_period_build(pr_normalize(pr), lower, upper));
+}
+
+PG_FUNCTION_INFO_V1(prefix_period_out);
+Datum
+prefix_period_out(PG_FUNCTION_ARGS)
+{
+  prefix_period *pp = PG_GETARG_PREFIX_PERIOD_P(0);
+  StringInfoData buf;
+
+  initStringInfo(&buf);
+  appendStringInfoString(&buf, pp->pr.prefix);
+
+  if( pp->pr.first != 0 )
+    appendStringInfo(&buf, "[%c-%c]", pp->pr.first, pp->pr.last);
+
+  appendStringInfo(&buf, "@[%s,%s)",
+		   DatumGetCString(DirectFunctionCall1(timestamptz_out,
+						       TimestampTzGetDatum(pp->lower))),
+		   DatumGetCString(DirectFunctionCall1(timestamptz_out,
+						       TimestampTzGetDatum(pp->upper))));
+
+  PG_RETURN_CSTRING(buf.data);
+}
+
+/**
+ * The binary format is the prefix_range one, followed by the bounds in
+ * the timestamptz one.
+ */
+PG_FUNCTION_INFO_V1(prefix_period_recv);
+Datum
+prefix_period_recv(PG_FUNCTION_ARGS)
+{
+  StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+  const char *first  = pq_getmsgbytes(buf, 1);
+  const char *last   = pq_getmsgbytes(buf, 1);
+  const char *prefix = pq_getmsgstring(buf);
+  prefix_range *pr   = build_pr(prefix, *first, *last);
+  TimestampTz lower, upper;
+
+#if PG_VERSION_NUM < 100000 && !defined(HAVE_INT64_TIMESTAMP)
+  lower = pq_getmsgfloat8(buf);
+  upper = pq_getmsgfloat8(buf);
+#else
+  lower = pq_getmsgint64(buf);
+  upper = pq_getmsgint64(buf);
+#endif
+  pq_getmsgend(buf);
+  pr_period_check(lower, upper);
+
+  PG_RETURN_PREFIX_PERIOD_P(pr_period_build(pr_normalize(pr), lower, upper));
+}
+
+PG_FUNCTION_INFO_V1(prefix_period_send);
+Datum
+prefix_period_send(PG_FUNCTION_ARGS)
+{
+  prefix_period *pp = PG_GETARG_PREFIX_PERIOD_P(0);
+  StringInfoData buf;
+
+  pq_begintypsend(&buf);
+  pq_sendbyte(&buf, pp->pr.first);
+  pq_sendbyte(&buf, pp->pr.last);
+  pq_sendstring(&buf, pp->pr.prefix);
+
+#if PG_VERSION_NUM < 100000 && !defined(HAVE_INT64_TIMESTAMP)
+  pq_sendfloat8(&buf, pp->lower);
+  pq_sendfloat8(&buf, pp->upper);
+#else
+  pq_sendint64(&buf, pp->lower);
+  pq_sendint64(&buf, pp->upper);
+#endif
+
+  PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+/**
+ * prefix_period(prefix_range, lower timestamptz, upper timestamptz)
+ */
+PG_FUNCTION_INFO_V1(prefix_period_make);
+Datum
+prefix_period_make(PG_FUNCTION_ARGS)
+{
+  prefix_range *pr  = PG_GETARG_PREFIX_RANGE_P(0);
+  TimestampTz lower = PG_GETARG_TIMESTAMPTZ(1);
+  TimestampTz upper = PG_GETARG_TIMESTAMPTZ(2);
+
+  pr_period_check(lower, upper);
+
+  PG_RETURN_PREFIX_PERIOD_P(pr_period_build(pr_normalize(pr), lower, upper));
+}
+
+/**
+ * prefix_period(number text, at timestamptz) is the query for number at
+ * the given instant, that is [at, at + 1us).
+ */
+PG_FUNCTION_INFO_V1(prefix_period_at);
+Datum
+prefix_period_at(PG_FUNCTION_ARGS)
+{
+  prefix_range *pr = pr_from_text(PG_GETARG_TEXT_PP(0));
+  TimestampTz at   = PG_GETARG_TIMESTAMPTZ(1);
+
+  if( TIMESTAMP_NOT_FINITE(at) )
+    ereport(ERROR,
+	    (errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+	     errmsg("prefix_period instant must be finite")));
+
+#if PG_VERSION_NUM < 100000 && !defined(HAVE_INT64_TIMESTAMP)
+  PG_RETURN_PREFIX_PERIOD_P(pr_period_build(pr, at, at + 0.000001));
+#else
+  PG_RETURN_PREFIX_PERIOD_P(pr_period_build(pr, at, at + 1));
+#endif
+}
+
+PG_FUNCTION_INFO_V1(prefix_period_prefix);
+Datum
+prefix_period_prefix(PG_FUNCTION_ARGS)
+{
+  prefix_period *pp = PG_GETARG_PREFIX_PERIOD_P(0);
+
+  PG_RETURN_PREFIX_RANGE_P(build_pr(pp->pr.prefix, pp->pr.first, pp->pr.last));
+}
+
+PG_FUNCTION_INFO_V1(prefix_period_lower);
+Datum
+prefix_period_lower(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_TIMESTAMPTZ(PG_GETARG_PREFIX_PERIOD_P(0)->lower);
+}
+
+PG_FUNCTION_INFO_V1(prefix_period_upper);
+Datum
+prefix_period_upper(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_TIMESTAMPTZ(PG_GETARG_PREFIX_PERIOD_P(0)->upper);
+}
+
+PG_FUNCTION_INFO_V1(prefix_period_contains);
+Datum
+prefix_period_contains(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL( pr_period_contains(PG_GETARG_PREFIX_PERIOD_P(0),
+				     PG_GETARG_PREFIX_PERIOD_P(1)) );
+}
+
+PG_FUNCTION_INFO_V1(prefix_period_overlaps);
+Datum
+prefix_period_overlaps(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL( pr_period_overlaps(PG_GETARG_PREFIX_PERIOD_P(0),
+				     PG_GETARG_PREFIX_PERIOD_P(1)) );
+}
+
+/*
+ * OPERATOR	1	@>,
+ * OPERATOR	2	&&,
+ *
+ * Leaf keys are the indexed values and answer exactly, no recheck.
+ * Internal keys are unions covering their children periods and ranges,
+ * so the same tests tell whether a child may match.
+ */
+PG_FUNCTION_INFO_V1(gpp_consistent);
+Datum
+gpp_consistent(PG_FUNCTION_ARGS)
+{
+  GISTENTRY *entry        = (GISTENTRY *) PG_GETARG_POINTER(0);
+  prefix_period *query    = PG_GETARG_PREFIX_PERIOD_P(1);
+  StrategyNumber strategy = (StrategyNumber) PG_GETARG_UINT16(2);
+  bool *recheck           = (bool *) PG_GETARG_POINTER(4);
+  prefix_period *key      = DatumGetPrefixPeriod(entry->key);
+
+  *recheck = false;
+
+  switch( strategy ) {
+  case 1:
+    PG_RETURN_BOOL( pr_period_contains(key, query) );
+
+  case 2:
+    PG_RETURN_BOOL( pr_period_overlaps(key, query) );
+
+  default:
+    PG_RETURN_BOOL(false);
+  }
+}
+
+PG_FUNCTION_INFO_V1(gpp_compress);
+Datum
+gpp_compress(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+}
+
+PG_FUNCTION_INFO_V1(gpp_decompress);
+Datum
+gpp_decompress(PG_FUNCTION_ARGS)
+{
+  GISTENTRY *entry  = (GISTENTRY *) PG_GETARG_POINTER(0);
+  prefix_period *pp = DatumGetPrefixPeriod(entry->key);
+
+  if( pp != (prefix_period *) DatumGetPointer(entry->key) ) {
+    GISTENTRY *retval = (GISTENTRY *) palloc(sizeof(GISTENTRY));
+
+    gistentryinit(*retval, PointerGetDatum(pp),
+		  entry->rel, entry->page, entry->offset, false);
+    PG_RETURN_POINTER(retval);
+  }
+  PG_RETURN_POINTER(entry);
+}
+
+/*
+ * Different prefix_range penalties are at least 1/255th apart, so the
+ * period enlargement, scaled down to 1/512th, only breaks ties.
+ */
+PG_FUNCTION_INFO_V1(gpp_penalty);
+Datum
+gpp_penalty(PG_FUNCTION_ARGS)
+{
+  GISTENTRY *origentry = (GISTENTRY *) PG_GETARG_POINTER(0);
+  GISTENTRY *newentry  = (GISTENTRY *) PG_GETARG_POINTER(1);
+  float *penalty       = (float *) PG_GETARG_POINTER(2);
+  prefix_period *orig  = DatumGetPrefixPeriod(origentry->key);
+  prefix_period *new   = DatumGetPrefixPeriod(newentry->key);
+
+  *penalty = __pr_penalty(&orig->pr, &new->pr)
+    * (1 + pr_period_enlargement(orig, new) / 512);
+
+  PG_RETURN_POINTER(penalty);
+}
+
+typedef struct
+{
+  OffsetNumber    offset;
+  prefix_period  *pp;
+} pr_period_item;
+
+static int
+pr_period_item_cmp(const void *a, const void *b) {
+  prefix_period *pa = ((const pr_period_item *) a)->pp;
+  prefix_period *pb = ((const pr_period_item *) b)->pp;
+  int cmp = pr_cmp(&pa->pr, &pb->pr);
+
+  if( cmp != 0 )
+    return cmp;
+
+  if( pa->lower != pb->lower )
+    return pa->lower < pb->lower ? -1 : 1;
+
+  if( pa->upper != pb->upper )
+    return pa->upper < pb->upper ? -1 : 1;
+
+  return 0;
+}
+
+static int
+pr_period_common(prefix_period *a, prefix_period *b) {
+  return pr_mismatch(a->pr.prefix, b->pr.prefix,
+		     Min(strlen(a->pr.prefix), strlen(b->pr.prefix)));
+}
+
+PG_FUNCTION_INFO_V1(gpp_picksplit);
+Datum
+gpp_picksplit(PG_FUNCTION_ARGS)
+{
+  GistEntryVector *entryvec = (GistEntryVector *) PG_GETARG_POINTER(0);
+  GIST_SPLITVEC *v          = (GIST_SPLITVEC *) PG_GETARG_POINTER(1);
+  OffsetNumber maxoff       = entryvec->n - 1;
+  int n                     = maxoff;
+  pr_period_item *items;
+  prefix_period *unionL, *unionR;
+  OffsetNumber i;
+  int k, split, best = -1, lo, hi;
+
+  items = (pr_period_item *) palloc(n * sizeof(pr_period_item));
+
+  for(i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i)) {
+    items[i - FirstOffsetNumber].offset = i;
+    items[i - FirstOffsetNumber].pp     = DatumGetPrefixPeriod(entryvec->vector[i].key);
+  }
+  qsort(items, n, sizeof(pr_period_item), pr_period_item_cmp);
+
+  /*
+   * Cut in the middle half where the neighbours share the shortest
+   * prefix, the closest to the middle on ties.
+   */
+  lo    = Max(n / 4, 1);
+  hi    = Max(n - n / 4, lo);
+  split = Max(n / 2, 1);
+
+  for(k=lo; k<=hi && k<n; k++) {
+    int common = pr_period_common(items[k - 1].pp, items[k].pp);
+
+    if( best < 0 || common < best
+	|| (common == best && Abs(k - n / 2) < Abs(split - n / 2)) ) {
+      best  = common;
+      split = k;
+    }
+  }
+
+  v->spl_left   = (OffsetNumber *) palloc((maxoff + 1) * sizeof(OffsetNumber));
+  v->spl_right  = (OffsetNumber *) palloc((maxoff + 1) * sizeof(OffsetNumber));
+  v->spl_nleft  = v->spl_nright = 0;
+
+  unionL = items[0].pp;
+  unionR = items[split].pp;
+
+  for(k=0; k<n; k++) {
+    if( k < split ) {
+      unionL = pr_period_union(unionL, items[k].pp);
+      v->spl_left[v->spl_nleft++] = items[k].offset;
+    }
+    else {
+      unionR = pr_period_union(unionR, items[k].pp);
+      v->spl_right[v->spl_nright++] = items[k].offset;
+    }
+  }
+
+  v->spl_ldatum = PointerGetDatum(unionL);
+  v->spl_rdatum = PointerGetDatum(unionR);
+
+  PG_RETURN_POINTER(v);
+}
+
+PG_FUNCTION_INFO_V1(gpp_union);
+Datum
+gpp_union(PG_FUNCTION_ARGS)
+{
+  GistEntryVector *entryvec = (GistEntryVector *) PG_GETARG_POINTER(0);
+  prefix_period *out = DatumGetPrefixPeriod(entryvec->vector[0].key);
+  int i;
+
+  out = pr_period_build(&out->pr, out->lower, out->upper);
+
+  for(i=1; i<entryvec->n; i++)
+    out = pr_period_union(out, DatumGetPrefixPeriod(entryvec->vector[i].key));
+
+  PG_RETURN_PREFIX_PERIOD_P(out);
+}
+
+PG_FUNCTION_INFO_V1(gpp_same);
+Datum
+gpp_same(PG_FUNCTION_ARGS)
+{
+  prefix_period *a = PG_GETARG_PREFIX_PERIOD_P(0);
+  prefix_period *b = PG_GETARG_PREFIX_PERIOD_P(1);
+  bool *result     = (bool *) PG_GETARG_POINTER(2);
+
+  *result = a->lower == b->lower && a->upper == b->upper && pr_eq(&a->pr, &b->pr);
+  PG_RETURN_POINTER(result);
+}
+
+/**
+ * E.164 prefixes
+ *
+ * E.164 numbers have at most 15 digits, so that a digit prefix with an
+ * optional [x-y] digit range fits in 64 bits, and e164_prefix is passed
+ * by value where 64 bits integers are. The 64 bits are, from the most
+ * significant:
+ *
+ *   - the digits as an integer, padded with zeros to 15 digits
+ *   - the number of digits, 4 bits
+ *   - the range first digit plus one, 4 bits, 0 when there's no range
+ *   - the range last digit plus one, 4 bits
+ *
+ * Comparing the integers orders the values by digits, then by length,
+ * then by range, and the operators work on them without decoding the
+ * digits. Union, intersection and penalty go through prefix_range.
+ */
+Datum e164_prefix_in(PG_FUNCTION_ARGS);
+Datum e164_prefix_out(PG_FUNCTION_ARGS);
+Datum e164_prefix_recv(PG_FUNCTION_ARGS);
+Datum e164_prefix_send(PG_FUNCTION_ARGS);
+Datum e164_prefix_from_prefix_range(PG_FUNCTION_ARGS);
+Datum e164_prefix_to_prefix_range(PG_FUNCTION_ARGS);
+Datum e164_prefix_eq(PG_FUNCTION_ARGS);
+Datum e164_prefix_neq(PG_FUNCTION_ARGS);
+Datum e164_prefix_lt(PG_FUNCTION_ARGS);
+Datum e164_prefix_le(PG_FUNCTION_ARGS);
+Datum e164_prefix_gt(PG_FUNCTION_ARGS);
+Datum e164_prefix_ge(PG_FUNCTION_ARGS);
+Datum e164_prefix_cmp(PG_FUNCTION_ARGS);
+Datum e164_prefix_sortsupport(PG_FUNCTION_ARGS);
+Datum e164_prefix_hash(PG_FUNCTION_ARGS);
+Datum e164_prefix_contains(PG_FUNCTION_ARGS);
+Datum e164_prefix_contained_by(PG_FUNCTION_ARGS);
+Datum e164_prefix_overlaps(PG_FUNCTION_ARGS);
+Datum e164_prefix_union(PG_FUNCTION_ARGS);
+Datum e164_prefix_inter(PG_FUNCTION_ARGS);
+Datum ge164_consistent(PG_FUNCTION_ARGS);
+Datum ge164_compress(PG_FUNCTION_ARGS);
+Datum ge164_decompress(PG_FUNCTION_ARGS);
+Datum ge164_penalty(PG_FUNCTION_ARGS);
+Datum ge164_picksplit(PG_FUNCTION_ARGS);
+Datum ge164_union(PG_FUNCTION_ARGS);
+Datum ge164_same(PG_FUNCTION_ARGS);
+
+#define E164_MAXLEN             15
+
+#define E164_VALUE(v)           ((v) >> 12)
+#define E164_LEN(v)             ((int) (((v) >> 8) & 0x0F))
+#define E164_FIRST(v)           ((int) (((v) >> 4) & 0x0F))
+#define E164_LAST(v)            ((int) ((v) & 0x0F))
+#define E164_MAKE(value, len, first, last) \
+  (((int64) (value) << 12) | ((int64) (len) << 8) | ((first) << 4) | (last))
+
+static const int64 e164_pow10[E164_MAXLEN + 1] = {
+  INT64CONST(1), INT64CONST(10), INT64CONST(100), INT64CONST(1000),
+  INT64CONST(10000), INT64CONST(100000), INT64CONST(1000000),
+  INT64CONST(10000000), INT64CONST(100000000), INT64CONST(1000000000),
+  INT64CONST(10000000000), INT64CONST(100000000000),
+  INT64CONST(1000000000000), INT64CONST(10000000000000),
+  INT64CONST(100000000000000), INT64CONST(1000000000000000)
+};
+
+/* the first len digits of v, as an integer */
+#define E164_DIGITS(v, len)     (E164_VALUE(v) / e164_pow10[E164_MAXLEN - (len)])
+
+/*
+ * Encode a prefix_range, returns false when it's not made of at most 15
+ * digits, including the range ones.
+ */
+static bool
+e164_from_pr(prefix_range *pr, int64 *result) {
+  int len = strlen(pr->prefix);
+  int64 value = 0;
+  int i;
+
+  if( len > (pr->first ? E164_MAXLEN - 1 : E164_MAXLEN)
+      || !pr_all_digits(pr->prefix, len) )
+    return false;
+
+  if( pr->first != 0
+      && (pr->first < '0' || pr->first > '9' || pr->last < '0' || pr->last > '9') )
+    return false;
+
+  for(i=0; i<len; i++)
+    value = value * 10 + (pr->prefix[i] - '0');
+
+  *result = E164_MAKE(value * e164_pow10[E164_MAXLEN - len], len,
+		      pr->first ? pr->first - '0' + 1 : 0,
+		      pr->first ? pr->last  - '0' + 1 : 0);
+  return true;
+}
+
+/*
+ * Decode v into pr, that has room for E164_MAXLEN digits.
+ */
+static prefix_range *
+e164_to_pr(int64 v, prefix_range *pr) {
+  int len = E164_LEN(v);
+  int64 digits = E164_DIGITS(v, len);
+  int i;
+
+  for(i=len-1; i>=0; i--) {
+    pr->prefix[i] = '0' + digits % 10;
+    digits /= 10;
+  }
+  pr->prefix[len] = 0;
+  pr->first = E164_FIRST(v) ? '0' + E164_FIRST(v) - 1 : 0;
+  pr->last  = E164_LAST(v)  ? '0' + E164_LAST(v)  - 1 : 0;
+
+  return pr;
+}
+
+typedef union
+{
+  prefix_range  pr;
+  char          data[sizeof(prefix_range) + E164_MAXLEN + 1];
+} e164_buffer;
+
+static inline
+int64 e164_encode(prefix_range *pr) {
+  int64 v;
+
+  if( !e164_from_pr(pr, &v) )
+    ereport(ERROR,
+	    (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+	     errmsg("invalid e164_prefix value: \"%s\"",
+		    DatumGetCString(DirectFunctionCall1(prefix_range_out,
+							PrefixRangeGetDatum(pr))))));
+  return v;
+}
+
+/*
+ * a @> b, as pr_contains(a, b, true) on the decoded values.
+ */
+static inline
+bool e164_contains(int64 a, int64 b) {
+  int la = E164_LEN(a), lb = E164_LEN(b), digit;
+
+  if( a == b )
+    return true;
+
+  if( lb < la || E164_DIGITS(a, la) != E164_DIGITS(b, la) )
+    return false;
+
+  if( E164_FIRST(a) == 0 )
+    return true;
+
+  if( la == lb )
+    return E164_FIRST(b) != 0
+      && E164_FIRST(a) <= E164_FIRST(b) && E164_LAST(b) <= E164_LAST(a);
+
+  digit = E164_DIGITS(b, la + 1) % 10 + 1;
+
+  return E164_FIRST(a) <= digit && digit <= E164_LAST(a);
+}
+
+static inline
+bool e164_overlaps(int64 a, int64 b) {
+  if( e164_contains(a, b) || e164_contains(b, a) )
+    return true;
+
+  /* same digits, overlapping ranges */
+  return E164_LEN(a) == E164_LEN(b)
+    && E164_VALUE(a) == E164_VALUE(b)
+    && E164_FIRST(a) != 0 && E164_FIRST(b) != 0
+    && E164_FIRST(a) <= E164_LAST(b) && E164_FIRST(b) <= E164_LAST(a);
+}
+
+static int64
+e164_union(int64 a, int64 b) {
+  e164_buffer ba, bb;
+
+  return e164_encode(pr_union(e164_to_pr(a, &ba.pr), e164_to_pr(b, &bb.pr)));
+}
+
+static int64
+e164_inter(int64 a, int64 b) {
+  e164_buffer ba, bb;
+
+  return e164_encode(pr_inter(e164_to_pr(a, &ba.pr), e164_to_pr(b, &bb.pr)));
+}
+
+/* length of the common prefix of the digits of a and b */
+static int
+e164_common(int64 a, int64 b) {
+  int len = Min(E164_LEN(a), E164_LEN(b));
+
+  while( len > 0 && E164_DIGITS(a, len) != E164_DIGITS(b, len) )
+    len--;
+
+  return len;
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_in);
+Datum
+e164_prefix_in(PG_FUNCTION_ARGS)
+{
+  char *str = PG_GETARG_CSTRING(0);
+  prefix_range *pr = pr_from_str(str);
+  int64 v;
+
+  if( pr == NULL || !e164_from_pr(pr, &v) )
+    ereport(ERROR,
+	    (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+	     errmsg("invalid e164_prefix value: \"%s\"", str)));
+
+  PG_RETURN_INT64(v);
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_out);
+Datum
+e164_prefix_out(PG_FUNCTION_ARGS)
+{
+  e164_buffer buf;
+
+  return DirectFunctionCall1(prefix_range_out,
+			     PrefixRangeGetDatum(e164_to_pr(PG_GETARG_INT64(0),
+							    &buf.pr)));
+}
+
+/**
+ * The binary format is the 64 bits integer, checked on receive.
+ */
+PG_FUNCTION_INFO_V1(e164_prefix_recv);
+Datum
+e164_prefix_recv(PG_FUNCTION_ARGS)
+{
+  StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+  int64 v = pq_getmsgint64(buf);
+  e164_buffer pr;
+  int64 check;
+
+  if( v < 0 || E164_LEN(v) > E164_MAXLEN
+      || E164_VALUE(v) >= e164_pow10[E164_MAXLEN]
+      || (E164_FIRST(v) != 0 && E164_FIRST(v) >= E164_LAST(v))
+      || !e164_from_pr(e164_to_pr(v, &pr.pr), &check) || check != v )
+    ereport(ERROR,
+	    (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+	     errmsg("invalid e164_prefix binary value")));
+
+  PG_RETURN_INT64(v);
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_send);
+Datum
+e164_prefix_send(PG_FUNCTION_ARGS)
+{
+  StringInfoData buf;
+
+  pq_begintypsend(&buf);
+  pq_sendint64(&buf, PG_GETARG_INT64(0));
+
+  PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_from_prefix_range);
+Datum
+e164_prefix_from_prefix_range(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_INT64(e164_encode(PG_GETARG_PREFIX_RANGE_P(0)));
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_to_prefix_range);
+Datum
+e164_prefix_to_prefix_range(PG_FUNCTION_ARGS)
+{
+  e164_buffer buf;
+
+  PG_RETURN_PREFIX_RANGE_P(e164_to_pr(PG_GETARG_INT64(0), &buf.pr));
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_eq);
+Datum
+e164_prefix_eq(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL( PG_GETARG_INT64(0) == PG_GETARG_INT64(1) );
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_neq);
+Datum
+e164_prefix_neq(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL( PG_GETARG_INT64(0) != PG_GETARG_INT64(1) );
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_lt);
+Datum
+e164_prefix_lt(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL( PG_GETARG_INT64(0) < PG_GETARG_INT64(1) );
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_le);
+Datum
+e164_prefix_le(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL( PG_GETARG_INT64(0) <= PG_GETARG_INT64(1) );
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_gt);
+Datum
+e164_prefix_gt(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL( PG_GETARG_INT64(0) > PG_GETARG_INT64(1) );
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_ge);
+Datum
+e164_prefix_ge(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL( PG_GETARG_INT64(0) >= PG_GETARG_INT64(1) );
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_cmp);
+Datum
+e164_prefix_cmp(PG_FUNCTION_ARGS)
+{
+  int64 a = PG_GETARG_INT64(0);
+  int64 b = PG_GETARG_INT64(1);
+
+  PG_RETURN_INT32( a < b ? -1 : (a > b ? 1 : 0) );
+}
+
+#if PG_VERSION_NUM >= 90200
+static int
+e164_prefix_fastcmp(Datum x, Datum y, SortSupport ssup)
+{
+  int64 a = DatumGetInt64(x);
+  int64 b = DatumGetInt64(y);
+
+  return a < b ? -1 : (a > b ? 1 : 0);
+}
+#endif
+
+PG_FUNCTION_INFO_V1(e164_prefix_sortsupport);
+Datum
+e164_prefix_sortsupport(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM >= 90200
+  SortSupport ssup = (SortSupport) PG_GETARG_POINTER(0);
+
+  ssup->comparator = e164_prefix_fastcmp;
+#endif
+  PG_RETURN_VOID();
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_hash);
+Datum
+e164_prefix_hash(PG_FUNCTION_ARGS)
+{
+  return DirectFunctionCall1(hashint8, Int64GetDatum(PG_GETARG_INT64(0)));
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_contains);
+Datum
+e164_prefix_contains(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL( e164_contains(PG_GETARG_INT64(0), PG_GETARG_INT64(1)) );
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_contained_by);
+Datum
+e164_prefix_contained_by(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL( e164_contains(PG_GETARG_INT64(1), PG_GETARG_INT64(0)) );
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_overlaps);
+Datum
+e164_prefix_overlaps(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL( e164_overlaps(PG_GETARG_INT64(0), PG_GETARG_INT64(1)) );
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_union);
+Datum
+e164_prefix_union(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_INT64( e164_union(PG_GETARG_INT64(0), PG_GETARG_INT64(1)) );
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_inter);
+Datum
+e164_prefix_inter(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_INT64( e164_inter(PG_GETARG_INT64(0), PG_GETARG_INT64(1)) );
+}
+
+/*
+ * GiST support, with the strategies of gist_prefix_range_ops:
+ *
+ * OPERATOR	1	@>,
+ * OPERATOR	2	<@,
+ * OPERATOR	3	=,
+ * OPERATOR	4	&&,
+ *
+ * Internal keys are unions of the keys under them.
+ */
+PG_FUNCTION_INFO_V1(ge164_consistent);
+Datum
+ge164_consistent(PG_FUNCTION_ARGS)
+{
+  GISTENTRY *entry        = (GISTENTRY *) PG_GETARG_POINTER(0);
+  int64 query             = PG_GETARG_INT64(1);
+  StrategyNumber strategy = (StrategyNumber) PG_GETARG_UINT16(2);
+  bool *recheck           = (bool *) PG_GETARG_POINTER(4);
+  int64 key               = DatumGetInt64(entry->key);
+  bool leaf               = GIST_LEAF(entry);
+
+  *recheck = false;
+
+  switch( strategy ) {
+  case 1:
+    PG_RETURN_BOOL( e164_contains(key, query) );
+
+  case 2:
+    PG_RETURN_BOOL( leaf ? e164_contains(query, key) : e164_overlaps(key, query) );
+
+  case 3:
+    PG_RETURN_BOOL( leaf ? key == query : e164_contains(key, query) );
+
+  case 4:
+    PG_RETURN_BOOL( e164_overlaps(key, query) );
+
+  default:
+    PG_RETURN_BOOL(false);
+  }
+}
+
+PG_FUNCTION_INFO_V1(ge164_compress);
+Datum
+ge164_compress(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+}
+
+PG_FUNCTION_INFO_V1(ge164_decompress);
+Datum
+ge164_decompress(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+}
+
+PG_FUNCTION_INFO_V1(ge164_penalty);
+Datum
+ge164_penalty(PG_FUNCTION_ARGS)
+{
+  GISTENTRY *origentry = (GISTENTRY *) PG_GETARG_POINTER(0);
+  GISTENTRY *newentry  = (GISTENTRY *) PG_GETARG_POINTER(1);
+  float *penalty       = (float *) PG_GETARG_POINTER(2);
+  e164_buffer orig, new;
+
+  *penalty = __pr_penalty(e164_to_pr(DatumGetInt64(origentry->key), &orig.pr),
+			  e164_to_pr(DatumGetInt64(newentry->key), &new.pr));
+
+  PG_RETURN_POINTER(penalty);
+}
+
+static int
+e164_item_cmp(const void *a, const void *b) {
+  int64 va = DatumGetInt64(((const GISTENTRY *) a)->key);
+  int64 vb = DatumGetInt64(((const GISTENTRY *) b)->key);
+
+  return va < vb ? -1 : (va > vb ? 1 : 0);
+}
+
+/*
+ * The values sort by digits: cut in the middle half where the
+ * neighbours share the shortest prefix, the closest to the middle on
+ * ties, as gpp_picksplit() does.
+ */
+PG_FUNCTION_INFO_V1(ge164_picksplit);
+Datum
+ge164_picksplit(PG_FUNCTION_ARGS)
+{
+  GistEntryVector *entryvec = (GistEntryVector *) PG_GETARG_POINTER(0);
+  GIST_SPLITVEC *v          = (GIST_SPLITVEC *) PG_GETARG_POINTER(1);
+  OffsetNumber maxoff       = entryvec->n - 1;
+  int n                     = maxoff;
+  GISTENTRY *items;
+  int64 unionL, unionR;
+  OffsetNumber i;
+  int k, split, best = -1, lo, hi;
+
+  items = (GISTENTRY *) palloc(n * sizeof(GISTENTRY));
+
+  for(i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i)) {
+    items[i - FirstOffsetNumber] = entryvec->vector[i];
+    items[i - FirstOffsetNumber].offset = i;
+  }
+  qsort(items, n, sizeof(GISTENTRY), e164_item_cmp);
+
+  lo    = Max(n / 4, 1);
+  hi    = Max(n - n / 4, lo);
+  split = Max(n / 2, 1);
+
+  for(k=lo; k<=hi && k<n; k++) {
+    int common = e164_common(DatumGetInt64(items[k - 1].key),
+			     DatumGetInt64(items[k].key));
+
+    if( best < 0 || common < best
+	|| (common == best && Abs(k - n / 2) < Abs(split - n / 2)) ) {
+      best  = common;
+      split = k;
+    }
+  }
+
+  v->spl_left   = (OffsetNumber *) palloc((maxoff + 1) * sizeof(OffsetNumber));
+  v->spl_right  = (OffsetNumber *) palloc((maxoff + 1) * sizeof(OffsetNumber));
+  v->spl_nleft  = v->spl_nright = 0;
+
+  unionL = DatumGetInt64(items[0].key);
+  unionR = DatumGetInt64(items[split].key);
+
+  for(k=0; k<n; k++) {
+    int64 key = DatumGetInt64(items[k].key);
+
+    if( k < split ) {
+      unionL = e164_union(unionL, key);
+      v->spl_left[v->spl_nleft++] = items[k].offset;
+    }
+    else {
+      unionR = e164_union(unionR, key);
+      v->spl_right[v->spl_nright++] = items[k].offset;
+    }
+  }
+
+  v->spl_ldatum = Int64GetDatum(unionL);
+  v->spl_rdatum = Int64GetDatum(unionR);
+
+  PG_RETURN_POINTER(v);
+}
+
+PG_FUNCTION_INFO_V1(ge164_union);
+Datum
+ge164_union(PG_FUNCTION_ARGS)
+{
+  GistEntryVector *entryvec = (GistEntryVector *) PG_GETARG_POINTER(0);
+  int64 out = DatumGetInt64(entryvec->vector[0].key);
+  int i;
+
+  for(i=1; i<entryvec->n; i++)
+    out = e164_union(out, DatumGetInt64(entryvec->vector[i].key));
+
+  PG_RETURN_INT64(out);
+}
+
+PG_FUNCTION_INFO_V1(ge164_same);
+Datum
+ge164_same(PG_FUNCTION_ARGS)
+{
+  bool *result = (bool *) PG_GETARG_POINTER(2);
+
+  *result = PG_GETARG_INT64(0) == PG_GETARG_INT64(1);
+  PG_RETURN_POINTER(result);
+}
+
+/**
+ * Split strategies evaluation
+ *
+ * prefix_picksplit_stats(prefix_range[]) runs each picksplit
+ * implementation on the array, taken as the entries of a page to
+ * split, and returns a row per strategy with the size of both sides,
+ * the share of the entries on the smaller side (0.5 is an even split),
+ * both unions and their prefix length (the longer, the more specific),
+ * whether the unions overlap, how many entries overlap both unions, so
+ * that lookups of them visit both sides, and how many entries are not
+ * contained in the union of their side, which is a bug.
+ *
+ * A side left empty has a NULL union, GiST then splits the page its
+ * own way.
+ */
+Datum prefix_picksplit_stats(PG_FUNCTION_ARGS);
+
+static const struct
+{
+  const char *name;
+  PGFunction  picksplit;
+} pr_split_strategies[] = {
+  {"picksplit", gpr_picksplit},
+  {"presort",   gpr_picksplit_presort},
+  {"jordan",    gpr_picksplit_jordan}
+};
+
+/**
+ * Count the entries of a side that are not contained in its union, and
+ * add the ones overlapping both unions to *shared.
+ */
+static int
+pr_split_side(GistEntryVector *entryvec, OffsetNumber *side, int n,
+	      prefix_range *own, prefix_range *other, int *shared) {
+  int i, misplaced = 0;
+
+  for(i=0; i<n; i++) {
+    prefix_range *pr = DatumGetPrefixRange(entryvec->vector[side[i]].key);
+
+    if( own == NULL || !pr_contains(own, pr, true) )
+      misplaced++;
+
+    if( own != NULL && other != NULL
+	&& pr_overlaps(own, pr) && pr_overlaps(other, pr) )
+      (*shared)++;
+  }
+  return misplaced;
+}
+
+PG_FUNCTION_INFO_V1(prefix_picksplit_stats);
+Datum
+prefix_picksplit_stats(PG_FUNCTION_ARGS)
+{
+  ArrayType *array = PG_GETARG_ARRAYTYPE_P(0);
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+  Tuplestorestate *tupstore;
+  TupleDesc tupdesc;
+  MemoryContext oldcxt;
+  GistEntryVector *entryvec;
+  Datum *elems;
+  bool *elnulls;
+  int nelems, n, i, s;
+  int16 typlen;
+  bool typbyval;
+  char typalign;
+
+  if( rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo)
+      || (rsinfo->allowedModes & SFRM_Materialize) == 0 )
+    ereport(ERROR,
+	    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	     errmsg("set-valued function called in context that cannot accept a set")));
+
+  if( get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE )
+    elog(ERROR, "return type must be a row type");
+
+  get_typlenbyvalalign(ARR_ELEMTYPE(array), &typlen, &typbyval, &typalign);
+  deconstruct_array(array, ARR_ELEMTYPE(array), typlen, typbyval, typalign,
+		    &elems, &elnulls, &nelems);
+
+  /**
+   * GiST offsets start at FirstOffsetNumber, vector[0] is unused.
+   */
+  entryvec = (GistEntryVector *)
+    palloc(GEVHDRSZ + (nelems + 1) * sizeof(GISTENTRY));
+  n = FirstOffsetNumber;
+
+  for(i=0; i<nelems; i++) {
+    if( elnulls[i] )
+      continue;
+
+    gistentryinit(entryvec->vector[n], elems[i], NULL, NULL, n, false);
+    n++;
+  }
+  entryvec->n = n;
+
+  if( n - FirstOffsetNumber < 2 )
+    ereport(ERROR,
+	    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+	     errmsg("prefix_picksplit_stats needs at least 2 prefixes to split")));
+
+  oldcxt = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+  tupdesc  = CreateTupleDescCopy(tupdesc);
+  tupstore = tuplestore_begin_heap(true, false, work_mem);
+  MemoryContextSwitchTo(oldcxt);
+
+  for(s=0; s<lengthof(pr_split_strategies); s++) {
+    GIST_SPLITVEC v;
+    prefix_range *unionL, *unionR;
+    Datum values[11];
+    bool nulls[11];
+    int shared = 0, misplaced;
+
+    memset(&v, 0, sizeof(GIST_SPLITVEC));
+    DirectFunctionCall2(pr_split_strategies[s].picksplit,
+			PointerGetDatum(entryvec), PointerGetDatum(&v));
+
+    unionL = v.spl_nleft  > 0 ? DatumGetPrefixRange(v.spl_ldatum) : NULL;
+    unionR = v.spl_nright > 0 ? DatumGetPrefixRange(v.spl_rdatum) : NULL;
+
+    misplaced  = pr_split_side(entryvec, v.spl_left, v.spl_nleft,
+			       unionL, unionR, &shared);
+    misplaced += pr_split_side(entryvec, v.spl_right, v.spl_nright,
+			       unionR, unionL, &shared);
+
+    memset(nulls, false, sizeof(nulls));
+    values[0] = CStringGetTextDatum(pr_split_strategies[s].name);
+    values[1] = Int32GetDatum(v.spl_nleft);
+    values[2] = Int32GetDatum(v.spl_nright);
+    values[3] = Float8GetDatum((double) Min(v.spl_nleft, v.spl_nright)
+			       / (v.spl_nleft + v.spl_nright));
+
+    if( unionL != NULL ) {
+      values[4] = PrefixRangeGetDatum(unionL);
+      values[6] = Int32GetDatum(strlen(unionL->prefix));
+    }
+    else
+      nulls[4] = nulls[6] = true;
+
+    if( unionR != NULL ) {
+      values[5] = PrefixRangeGetDatum(unionR);
+      values[7] = Int32GetDatum(strlen(unionR->prefix));
+    }
+    else
+      nulls[5] = nulls[7] = true;
+
+    if( unionL != NULL && unionR != NULL )
+      values[8] = BoolGetDatum(pr_overlaps(unionL, unionR));
+    else
+      nulls[8] = true;
+
+    values[9]  = Int32GetDatum(shared);
+    values[10] = Int32GetDatum(misplaced);
+
+    tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+  }
+
+  rsinfo->returnMode = SFRM_Materialize;
+  rsinfo->setResult  = tupstore;
+  rsinfo->setDesc    = tupdesc;
+
+  return (Datum) 0;
+}
+
+/**
+ * GiST index inspection
+ *
+ * prefix_index_pages(index regclass) walks a gist_prefix_range_ops
+ * index from its root, breadth first, and returns a row per page: its
+ * level (1 for the root), whether it is a leaf, the number of tuples
+ * and the free space, the average prefix length of the keys, how many
+ * keys have an empty prefix, and on inner pages how many keys overlap
+ * another key of the page.
+ *
+ * prefix_index_stats(index regclass) sums them up by level. Short
+ * inner keys, and empty ones most of all, match a lot of queries, and
+ * overlapping inner keys make lookups descend several subtrees: both
+ * growing over time mean the index would benefit from a REINDEX.
+ *
+ * Pages are read one at a time with a share lock, as a scan does, so
+ * that concurrent inserts may move keys around while we walk.
+ */
+Datum prefix_index_pages(PG_FUNCTION_ARGS);
+Datum prefix_index_stats(PG_FUNCTION_ARGS);
+
+#if PG_VERSION_NUM >= 120000
+
+typedef struct
+{
+  BlockNumber  blkno;
+  int          level;
+  bool         leaf;
+  int          tuples;
+  int          keys;          /* non NULL keys */
+  Size         freespace;
+  int64        length;        /* sum of the keys prefix length */
+  int          empty;
+  int          overlapping;
+} pr_index_page;
+
+/*
+ * Count the keys overlapping another one, keys are few enough on a
+ * page for the quadratic loop.
+ */
+static int
+pr_index_overlapping(prefix_range **keys, int n) {
+  int i, j, count = 0;
+
+  for(i=0; i<n; i++)
+    for(j=0; j<n; j++)
+      if( i != j && pr_overlaps(keys[i], keys[j]) ) {
+	count++;
+	break;
+      }
+
+  return count;
+}
+
+/*
+ * Returns the pages of the index, by level, and their number in
+ * *npages. The array is the queue of the breadth first walk too.
+ */
+static pr_index_page *
+pr_index_walk(Oid indexoid, int *npages) {
+  Relation index = index_open(indexoid, AccessShareLock);
+  TupleDesc desc = RelationGetDescr(index);
+  AclResult aclresult;
+  pr_index_page *pages;
+  int maxpages = 64, n = 0, next;
+
+  pr_index_check(index);
+
+  aclresult = pg_class_aclcheck(index->rd_index->indrelid, GetUserId(), ACL_SELECT);
+  if( aclresult != ACLCHECK_OK )
+    aclcheck_error(aclresult, OBJECT_TABLE, get_rel_name(index->rd_index->indrelid));
+
+  pages = (pr_index_page *) palloc0(maxpages * sizeof(pr_index_page));
+  pages[n].blkno = GIST_ROOT_BLKNO;
+  pages[n].level = 1;
+  n++;
+
+  for(next = 0; next < n; next++) {
+    Buffer buffer;
+    Page page;
+    OffsetNumber off, maxoff;
+    prefix_range **keys;
+    int nkeys = 0, k;
+
+    CHECK_FOR_INTERRUPTS();
+
+    buffer = ReadBuffer(index, pages[next].blkno);
+    LockBuffer(buffer, BUFFER_LOCK_SHARE);
+    page = BufferGetPage(buffer);
+
+    /*
+     * A page deleted by VACUUM after we read its parent is empty.
+     */
+    maxoff = GistPageIsDeleted(page) ? InvalidOffsetNumber : PageGetMaxOffsetNumber(page);
+    keys   = (prefix_range **) palloc((maxoff + 1) * sizeof(prefix_range *));
+
+    pages[next].leaf = GistPageIsLeaf(page);
+    pages[next].freespace = PageGetFreeSpace(page);
+
+    for(off = FirstOffsetNumber; off <= maxoff; off = OffsetNumberNext(off)) {
+      IndexTuple itup = (IndexTuple) PageGetItem(page, PageGetItemId(page, off));
+      prefix_range *pr;
+      bool isnull;
+      Datum d;
+
+      pages[next].tuples++;
+
+      if( !pages[next].leaf ) {
+	if( n == maxpages ) {
+	  maxpages *= 2;
+	  pages = (pr_index_page *) repalloc(pages, maxpages * sizeof(pr_index_page));
+	}
+	memset(&pages[n], 0, sizeof(pr_index_page));
+	pages[n].blkno = ItemPointerGetBlockNumber(&itup->t_tid);
+	pages[n].level = pages[next].level + 1;
+	n++;
+      }
+
+      d = index_getattr(itup, 1, desc, &isnull);
+      if( isnull )
+	continue;
+
+      pr = DatumGetPrefixRangeP(d);
+
+      pages[next].keys++;
+      pages[next].length += strlen(pr->prefix);
+      if( pr->prefix[0] == '\0' )
+	pages[next].empty++;
+
+      if( !pages[next].leaf )
+	keys[nkeys++] = build_pr(pr->prefix, pr->first, pr->last);
+    }
+    UnlockReleaseBuffer(buffer);
+
+    if( !pages[next].leaf )
+      pages[next].overlapping = pr_index_overlapping(keys, nkeys);
+
+    for(k=0; k<nkeys; k++)
+      pfree(keys[k]);
+    pfree(keys);
+  }
+
+  index_close(index, AccessShareLock);
+
+  *npages = n;
+  return pages;
+}
+
+/*
+ * Both functions materialize their result.
+ */
+static Tuplestorestate *
+pr_index_tuplestore(FunctionCallInfo fcinfo, TupleDesc *tupdesc) {
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+  Tuplestorestate *tupstore;
+  MemoryContext oldcxt;
+
+  if( rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo)
+      || (rsinfo->allowedModes & SFRM_Materialize) == 0 )
+    ereport(ERROR,
+	    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	     errmsg("set-valued function called in context that cannot accept a set")));
+
+  if( get_call_result_type(fcinfo, NULL, tupdesc) != TYPEFUNC_COMPOSITE )
+    elog(ERROR, "return type must be a row type");
+
+  oldcxt = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+  *tupdesc = CreateTupleDescCopy(*tupdesc);
+  tupstore = tuplestore_begin_heap(true, false, work_mem);
+  MemoryContextSwitchTo(oldcxt);
+
+  rsinfo->returnMode = SFRM_Materialize;
+  rsinfo->setResult  = tupstore;
+  rsinfo->setDesc    = *tupdesc;
+
+  return tupstore;
+}
+
+#endif  /* PG_VERSION_NUM >= 120000 */
+
+PG_FUNCTION_INFO_V1(prefix_index_pages);
+Datum
+prefix_index_pages(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM >= 120000
+  Oid indexoid = PG_GETARG_OID(0);
+  Tuplestorestate *tupstore;
+  TupleDesc tupdesc;
+  pr_index_page *pages;
+  int npages, i;
+
+  tupstore = pr_index_tuplestore(fcinfo, &tupdesc);
+  pages    = pr_index_walk(indexoid, &npages);
+
+  for(i=0; i<npages; i++) {
+    pr_index_page *p = &pages[i];
+    Datum values[8];
+    bool nulls[8];
+
+    memset(nulls, false, sizeof(nulls));
+    values[0] = Int64GetDatum(p->blkno);
+    values[1] = Int32GetDatum(p->level);
+    values[2] = BoolGetDatum(p->leaf);
+    values[3] = Int32GetDatum(p->tuples);
+    values[4] = Int32GetDatum(p->freespace);
+
+    if( p->keys > 0 )
+      values[5] = Float8GetDatum((double) p->length / p->keys);
+    else
+      nulls[5] = true;
+
+    values[6] = Int32GetDatum(p->empty);
+
+    if( !p->leaf )
+      values[7] = Int32GetDatum(p->overlapping);
+    else
+      nulls[7] = true;
+
+    tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+  }
+
+  return (Datum) 0;
+#else
+  ereport(ERROR,
+	  (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	   errmsg("prefix_index_pages() needs PostgreSQL 12 or later")));
+  PG_RETURN_NULL();
+#endif
+}
+
+PG_FUNCTION_INFO_V1(prefix_index_stats);
+Datum
+prefix_index_stats(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM >= 120000
+  Oid indexoid = PG_GETARG_OID(0);
+  Tuplestorestate *tupstore;
+  TupleDesc tupdesc;
+  pr_index_page *pages;
+  int npages, i, j;
+
+  tupstore = pr_index_tuplestore(fcinfo, &tupdesc);
+  pages    = pr_index_walk(indexoid, &npages);
+
+  /*
+   * The walk is breadth first, a level is a run of pages.
+   */
+  for(i=0; i<npages; i=j) {
+    int64 lpages = 0, tuples = 0, keys = 0, length = 0, empty = 0, overlapping = 0;
+    double freespace = 0;
+    bool leaf = true;
+    Datum values[8];
+    bool nulls[8];
+
+    for(j=i; j<npages && pages[j].level == pages[i].level; j++) {
+      lpages++;
+      tuples      += pages[j].tuples;
+      keys        += pages[j].keys;
+      length      += pages[j].length;
+      empty       += pages[j].empty;
+      overlapping += pages[j].overlapping;
+      freespace   += pages[j].freespace;
+      leaf         = leaf && pages[j].leaf;
+    }
+
+    memset(nulls, false, sizeof(nulls));
+    values[0] = Int32GetDatum(pages[i].level);
+    values[1] = Int64GetDatum(lpages);
+    values[2] = Int64GetDatum(tuples);
+    values[3] = Float8GetDatum((double) tuples / lpages);
+    values[4] = Float8GetDatum(freespace / lpages);
+
+    if( keys > 0 ) {
+      values[5] = Float8GetDatum((double) length / keys);
+      values[6] = Float8GetDatum((double) empty / keys);
+    }
+    else
+      nulls[5] = nulls[6] = true;
+
+    if( !leaf && keys > 0 )
+      values[7] = Float8GetDatum((double) overlapping / keys);
+    else
+      nulls[7] = true;
+
+    tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+  }
+
+  return (Datum) 0;
+#else
+  ereport(ERROR,
+	  (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	   errmsg("prefix_index_stats() needs PostgreSQL 12 or later")));
+  PG_RETURN_NULL();
+#endif
+}
+
+/**
+ * Prefix joins
+ *
+ * A join such as
+ *
+ *   SELECT * FROM cdr JOIN prefixes ON prefixes.prefix @> cdr.number;
+ *
+ * can only be planned as a nested loop, with a GiST probe per outer
+ * row, because @> is neither hashable nor mergeable. The trie join
+ * implements it the way a hash join would: it reads the inner side
+ * (the one with the prefix_range column) once into an in-memory trie,
+ * then streams the outer side through the trie, in O(number length)
+ * per outer row.
+ *
+ * The trie join is offered to the planner from set_join_pathlist_hook,
+ * so the module has to be loaded before planning for it to be
+ * considered, see shared_preload_libraries or session_preload_libraries.
+ */
+static bool prefix_enable_trie_join = true;
+
+#if PG_VERSION_NUM < 150000
+void _PG_init(void);
+#endif
+
+#if PG_VERSION_NUM >= 120000
+
+/* typical telephone number length, used to cost the trie walks */
+#define PR_TRIE_JOIN_DEPTH 12
+
+static set_join_pathlist_hook_type prev_set_join_pathlist_hook = NULL;
+
+static Plan *pr_trie_join_plan(PlannerInfo *root, RelOptInfo *rel,
+			       CustomPath *best_path, List *tlist,
+			       List *clauses, List *custom_plans);
+static Node *pr_trie_join_create_state(CustomScan *cscan);
+static void pr_trie_join_begin(CustomScanState *node,
+			       EState *estate, int eflags);
+static TupleTableSlot *pr_trie_join_exec(CustomScanState *node);
+static void pr_trie_join_end(CustomScanState *node);
+static void pr_trie_join_rescan(CustomScanState *node);
+static void pr_trie_join_explain(CustomScanState *node,
+				 List *ancestors, ExplainState *es);
+
+static CustomPathMethods pr_trie_join_path_methods = {
+  .CustomName     = "PrefixTrieJoin",
+  .PlanCustomPath = pr_trie_join_plan
+};
+
+static CustomScanMethods pr_trie_join_scan_methods = {
+  .CustomName            = "PrefixTrieJoin",
+  .CreateCustomScanState = pr_trie_join_create_state
+};
+
+static CustomExecMethods pr_trie_join_exec_methods = {
+  .CustomName         = "PrefixTrieJoin",
+  .BeginCustomScan    = pr_trie_join_begin,
+  .ExecCustomScan     = pr_trie_join_exec,
+  .EndCustomScan      = pr_trie_join_end,
+  .ReScanCustomScan   = pr_trie_join_rescan,
+  .ExplainCustomScan  = pr_trie_join_explain
+};
+
+/*
+ * Execution state. The scan tuple is built from the current outer
+ * tuple and the current match, map_side[i] and map_resno[i] tell where
+ * to find its i-th attribute.
+ */
+#define PR_TRIE_JOIN_OUTER 0
+#define PR_TRIE_JOIN_INNER 1
+
+typedef struct
+{
+  CustomScanState  css;
+
+  JoinType         jointype;
+  AttrNumber       outer_key;       /* resno in the outer plan tlist */
+  bool             outer_is_text;
+  AttrNumber       inner_key;       /* resno in the inner plan tlist */
+
+  int              nmap;
+  int             *map_side;
+  AttrNumber      *map_resno;
+
+  MemoryContext    trie_cxt;
+  pr_trie         *trie;
+  bool             trie_built;
+  pr_trie_node   **path;
+  int              maxpath;
+
+  TupleTableSlot  *inner_slot;
+  TupleTableSlot  *outer_slot;
+  bool             need_outer;
+
+  prefix_range    *key;             /* reused for plain text keys */
+  int              keysize;
+
+  pr_trie_entry  **matches;
+  int              nmatches;
+  int              maxmatches;
+  int              next_match;
+} pr_trie_join_state;
+
+/*
+ * Is funcid implemented by the given C function of this module?
+ */
+static bool
+pr_func_is(Oid funcid, PGFunction fn)
+{
+  FmgrInfo finfo;
+
+  fmgr_info(funcid, &finfo);
+  return finfo.fn_addr == fn;
+}
+
+/*
+ * Recognize a join clause the trie join implements: the containing
+ * side has to be a prefix_range Var of the inner relation, and the
+ * contained side a prefix_range or a text Var of the outer relation,
+ * the latter being possibly implicitly casted to prefix_range.
+ */
+static bool
+pr_trie_join_clause(Expr *clause, Relids outer_relids, Relids inner_relids,
+		    Var **inner_key, Var **outer_key, bool *outer_is_text)
+{
+  OpExpr *op;
+  Expr *container, *contained;
+  Oid funcid;
+
+  if( !IsA(clause, OpExpr) )
+    return false;
+
+  op = (OpExpr *) clause;
+
+  if( list_length(op->args) != 2 )
+    return false;
+
+  funcid = get_opcode(op->opno);
+  *outer_is_text = false;
+
+  if( pr_func_is(funcid, prefix_range_contains) ) {
+    container = (Expr *) linitial(op->args);
+    contained = (Expr *) lsecond(op->args);
+  }
+  else if( pr_func_is(funcid, prefix_range_contained_by) ) {
+    container = (Expr *) lsecond(op->args);
+    contained = (Expr *) linitial(op->args);
+  }
+  else if( pr_func_is(funcid, prefix_range_contains_text) ) {
+    container = (Expr *) linitial(op->args);
+    contained = (Expr *) lsecond(op->args);
+    *outer_is_text = true;
+  }
+  else if( pr_func_is(funcid, text_contained_by_prefix_range) ) {
+    container = (Expr *) lsecond(op->args);
+    contained = (Expr *) linitial(op->args);
+    *outer_is_text = true;
+  }
+  else
+    return false;
+
+  if( !IsA(container, Var) )
+    return false;
+
+  *inner_key = (Var *) container;
+
+  if( (*inner_key)->varlevelsup != 0
+      || !bms_is_member((*inner_key)->varno, inner_relids) )
+    return false;
+
+  if( !*outer_is_text
+      && IsA(contained, FuncExpr)
+      && list_length(((FuncExpr *) contained)->args) == 1
+      && pr_func_is(((FuncExpr *) contained)->funcid,
+		    prefix_range_cast_from_text) ) {
+    contained = (Expr *) linitial(((FuncExpr *) contained)->args);
+    *outer_is_text = true;
+  }
+
+  if( IsA(contained, RelabelType) )
+    contained = ((RelabelType *) contained)->arg;
+
+  if( !IsA(contained, Var) )
+    return false;
+
+  *outer_key = (Var *) contained;
+
+  return (*outer_key)->varlevelsup == 0
+    && bms_is_member((*outer_key)->varno, outer_relids);
+}
+
+static void
+pr_trie_join_pathlist(PlannerInfo *root, RelOptInfo *joinrel,
+		      RelOptInfo *outerrel, RelOptInfo *innerrel,
+		      JoinType jointype, JoinPathExtraData *extra)
+{
+  RestrictInfo *joinclause = NULL;
+  List *other_clauses = NIL;
+  Var *inner_key, *outer_key;
+  bool outer_is_text;
+  Path *outer_path, *inner_path;
+  CustomPath *cpath;
+  QualCost qual_cost;
+  double rows;
+  ListCell *lc;
+
+  if( prev_set_join_pathlist_hook )
+    prev_set_join_pathlist_hook(root, joinrel, outerrel, innerrel,
+				jointype, extra);
+
+  if( !prefix_enable_trie_join )
+    return;
+
+  /*
+   * Row marks and EvalPlanQual rechecks are not supported.
+   */
+  if( root->parse->commandType != CMD_SELECT || root->parse->rowMarks != NIL )
+    return;
+
+  if( jointype != JOIN_INNER && jointype != JOIN_LEFT && jointype != JOIN_RIGHT )
+    return;
+
+  if( !bms_is_empty(joinrel->lateral_relids) )
+    return;
+
+  /*
+   * add_paths_to_joinrel() calls us for both join orders, we always
+   * build the trie from the prefix_range side, which becomes the inner
+   * one here whatever the order we've been given.
+   */
+  foreach(lc, extra->restrictlist) {
+    RestrictInfo *rinfo = lfirst_node(RestrictInfo, lc);
+
+    if( joinclause == NULL ) {
+      if( pr_trie_join_clause(rinfo->clause,
+			      outerrel->relids, innerrel->relids,
+			      &inner_key, &outer_key, &outer_is_text) ) {
+	joinclause = rinfo;
+	continue;
+      }
+      if( pr_trie_join_clause(rinfo->clause,
+			      innerrel->relids, outerrel->relids,
+			      &inner_key, &outer_key, &outer_is_text) ) {
+	RelOptInfo *swap = outerrel;
+
+	outerrel = innerrel;
+	innerrel = swap;
+	jointype = jointype == JOIN_RIGHT ? JOIN_LEFT :
+	  jointype == JOIN_LEFT ? JOIN_RIGHT : jointype;
+
+	joinclause = rinfo;
+	continue;
+      }
+    }
+    other_clauses = lappend(other_clauses, rinfo);
+  }
+
+  if( joinclause == NULL || jointype == JOIN_RIGHT )
+    return;
+
+  /*
+   * Outer joins are only supported when the prefix clause is the only
+   * one, and we don't want to deal with placeholders.
+   */
+  if( jointype == JOIN_LEFT
+      && (other_clauses != NIL
+	  || RINFO_IS_PUSHED_DOWN(joinclause, joinrel->relids)) )
+    return;
+
+  foreach(lc, joinrel->reltarget->exprs) {
+    if( !IsA(lfirst(lc), Var) )
+      return;
+  }
+
+  foreach(lc, other_clauses) {
+    RestrictInfo *rinfo = lfirst_node(RestrictInfo, lc);
+    List *vars = pull_var_clause((Node *) rinfo->clause,
+				 PVC_INCLUDE_PLACEHOLDERS);
+    ListCell *lv;
+
+    foreach(lv, vars) {
+      if( !IsA(lfirst(lv), Var) )
+	return;
+    }
+  }
+
+  outer_path = outerrel->cheapest_total_path;
+  inner_path = innerrel->cheapest_total_path;
+
+  if( outer_path == NULL || inner_path == NULL
+      || PATH_REQ_OUTER(outer_path) != NULL
+      || PATH_REQ_OUTER(inner_path) != NULL )
+    return;
+
+  rows = joinrel->rows;
+
+  cpath = makeNode(CustomPath);
+  cpath->path.pathtype   = T_CustomScan;
+  cpath->path.parent     = joinrel;
+  cpath->path.pathtarget = joinrel->reltarget;
+  cpath->path.param_info = NULL;
+  cpath->path.parallel_aware = false;
+  cpath->path.parallel_safe  = joinrel->consider_parallel
+    && outer_path->parallel_safe && inner_path->parallel_safe;
+  cpath->path.parallel_workers = 0;
+  cpath->path.pathkeys   = NIL;
+  cpath->path.rows       = clamp_row_est(rows);
+
+  /*
+   * Building the trie costs a walk of each inner key, then each outer
+   * row costs a walk of its key. Matches are rechecked and emitted.
+   */
+  cost_qual_eval(&qual_cost, other_clauses, root);
+
+  cpath->path.startup_cost = inner_path->total_cost
+    + inner_path->rows * (cpu_tuple_cost + PR_TRIE_JOIN_DEPTH * cpu_operator_cost)
+    + outer_path->startup_cost
+    + qual_cost.startup;
+
+  cpath->path.total_cost = cpath->path.startup_cost
+    + (outer_path->total_cost - outer_path->startup_cost)
+    + outer_path->rows * PR_TRIE_JOIN_DEPTH * cpu_operator_cost
+    + cpath->path.rows * (cpu_tuple_cost + cpu_operator_cost
+			  + qual_cost.per_tuple
+			  + joinrel->reltarget->cost.per_tuple);
+
+  cpath->flags = 0;
+#ifdef CUSTOMPATH_SUPPORT_PROJECTION
+  cpath->flags |= CUSTOMPATH_SUPPORT_PROJECTION;
+#endif
+  cpath->custom_paths   = list_make2(outer_path, inner_path);
+  cpath->custom_private = list_make3(joinclause, other_clauses,
+				     list_make1_int(jointype));
+  cpath->methods = &pr_trie_join_path_methods;
+
+  add_path(joinrel, &cpath->path);
+}
+
+/*
+ * Find the resno of a Var in a plan target list, ignoring the nulling
+ * bits that outer joins may have added to it.
+ */
+static AttrNumber
+pr_trie_join_resno(List *tlist, Var *var)
+{
+  ListCell *lc;
+
+  foreach(lc, tlist) {
+    TargetEntry *tle = lfirst_node(TargetEntry, lc);
+    Var *tvar = (Var *) tle->expr;
+
+    if( IsA(tvar, Var)
+	&& tvar->varno == var->varno
+	&& tvar->varattno == var->varattno
+	&& tvar->varlevelsup == var->varlevelsup )
+      return tle->resno;
+  }
+  return InvalidAttrNumber;
+}
+
+static Plan *
+pr_trie_join_plan(PlannerInfo *root, RelOptInfo *rel,
+		  CustomPath *best_path, List *tlist,
+		  List *clauses, List *custom_plans)
+{
+  CustomScan *cscan = makeNode(CustomScan);
+  RestrictInfo *joinclause = (RestrictInfo *) linitial(best_path->custom_private);
+  List *other_clauses = (List *) lsecond(best_path->custom_private);
+  List *flags = (List *) lthird(best_path->custom_private);
+  Path *outer_path = (Path *) linitial(best_path->custom_paths);
+  Path *inner_path = (Path *) lsecond(best_path->custom_paths);
+  Plan *outer_plan = (Plan *) linitial(custom_plans);
+  Plan *inner_plan = (Plan *) lsecond(custom_plans);
+  Var *inner_key, *outer_key;
+  bool outer_is_text;
+  List *scan_tlist = NIL;
+  List *quals, *vars, *private;
+  AttrNumber outer_resno, inner_resno;
+  ListCell *lc;
+
+  if( !pr_trie_join_clause(joinclause->clause,
+			   outer_path->parent->relids, inner_path->parent->relids,
+			   &inner_key, &outer_key, &outer_is_text) )
+    elog(ERROR, "prefix trie join: unrecognized join clause");
+
+  /*
+   * The scan tuple is made of the join relation target, plus the Vars
+   * needed to evaluate the other join quals and to explain the prefix
+   * join clause.
+   */
+  foreach(lc, rel->reltarget->exprs) {
+    scan_tlist = lappend(scan_tlist,
+			 makeTargetEntry((Expr *) copyObject(lfirst(lc)),
+					 list_length(scan_tlist) + 1,
+					 NULL, false));
+  }
+
+  quals = extract_actual_clauses(other_clauses, false);
+  vars  = pull_var_clause((Node *) lappend(list_copy(quals), joinclause->clause),
+			  PVC_RECURSE_PLACEHOLDERS);
+
+  foreach(lc, vars) {
+    if( !tlist_member((Expr *) lfirst(lc), scan_tlist) )
+      scan_tlist = lappend(scan_tlist,
+			   makeTargetEntry((Expr *) copyObject(lfirst(lc)),
+					   list_length(scan_tlist) + 1,
+					   NULL, true));
+  }
+
+  outer_resno = pr_trie_join_resno(outer_plan->targetlist, outer_key);
+  inner_resno = pr_trie_join_resno(inner_plan->targetlist, inner_key);
+
+  if( outer_resno == InvalidAttrNumber || inner_resno == InvalidAttrNumber )
+    elog(ERROR, "prefix trie join: join keys not found in subplan target lists");
+
+  private = list_make4_int(linitial_int(flags),
+			   outer_resno, outer_is_text, inner_resno);
+
+  foreach(lc, scan_tlist) {
+    TargetEntry *tle = lfirst_node(TargetEntry, lc);
+    AttrNumber resno;
+
+    if( (resno = pr_trie_join_resno(outer_plan->targetlist,
+				    (Var *) tle->expr)) != InvalidAttrNumber )
+      private = lappend_int(lappend_int(private, PR_TRIE_JOIN_OUTER), resno);
+
+    else if( (resno = pr_trie_join_resno(inner_plan->targetlist,
+					 (Var *) tle->expr)) != InvalidAttrNumber )
+      private = lappend_int(lappend_int(private, PR_TRIE_JOIN_INNER), resno);
+
+    else
+      elog(ERROR, "prefix trie join: variable not found in subplan target lists");
+  }
+
+  cscan->scan.plan.targetlist = tlist;
+  cscan->scan.plan.qual       = quals;
+  cscan->scan.scanrelid       = 0;
+  cscan->flags                = best_path->flags;
+  cscan->custom_plans         = custom_plans;
+  cscan->custom_exprs         = list_make1(joinclause->clause);
+  cscan->custom_private       = private;
+  cscan->custom_scan_tlist    = scan_tlist;
+  cscan->methods              = &pr_trie_join_scan_methods;
+
+  return &cscan->scan.plan;
+}
+
+static Node *
+pr_trie_join_create_state(CustomScan *cscan)
+{
+  pr_trie_join_state *state = palloc0(sizeof(pr_trie_join_state));
+  List *private = cscan->custom_private;
+  int i;
+
+  NodeSetTag(state, T_CustomScanState);
+  state->css.methods = &pr_trie_join_exec_methods;
+
+  state->jointype      = (JoinType) list_nth_int(private, 0);
+  state->outer_key     = (AttrNumber) list_nth_int(private, 1);
+  state->outer_is_text = (bool) list_nth_int(private, 2);
+  state->inner_key     = (AttrNumber) list_nth_int(private, 3);
+
+  state->nmap      = (list_length(private) - 4) / 2;
+  state->map_side  = (int *) palloc(Max(state->nmap, 1) * sizeof(int));
+  state->map_resno = (AttrNumber *) palloc(Max(state->nmap, 1) * sizeof(AttrNumber));
+
+  for(i=0; i<state->nmap; i++) {
+    state->map_side[i]  = list_nth_int(private, 4 + 2*i);
+    state->map_resno[i] = (AttrNumber) list_nth_int(private, 4 + 2*i + 1);
+  }
+  return (Node *) state;
+}
+
+static void
+pr_trie_join_begin(CustomScanState *node, EState *estate, int eflags)
+{
+  pr_trie_join_state *state = (pr_trie_join_state *) node;
+  CustomScan *cscan = (CustomScan *) node->ss.ps.plan;
+  PlanState *outer, *inner;
+
+  eflags &= ~(EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK);
+
+  outer = ExecInitNode((Plan *) linitial(cscan->custom_plans), estate, eflags);
+  inner = ExecInitNode((Plan *) lsecond(cscan->custom_plans), estate, eflags);
+  node->custom_ps = list_make2(outer, inner);
+
+  state->inner_slot = MakeSingleTupleTableSlot(ExecGetResultType(inner),
+					       &TTSOpsMinimalTuple);
+  state->trie_cxt = AllocSetContextCreate(estate->es_query_cxt,
+					  "prefix trie join",
+					  ALLOCSET_DEFAULT_SIZES);
+  state->trie_built = false;
+  state->need_outer = true;
+}
+
+/*
+ * Read the whole inner side into the trie, keeping a copy of each
+ * tuple as the trie entry payload.
+ */
+static void
+pr_trie_join_build(pr_trie_join_state *state)
+{
+  PlanState *inner = (PlanState *) lsecond(state->css.custom_ps);
+  MemoryContext oldcxt;
+
+  MemoryContextReset(state->trie_cxt);
+
+  oldcxt = MemoryContextSwitchTo(state->trie_cxt);
+  state->trie = pr_trie_create();
+  MemoryContextSwitchTo(oldcxt);
+
+  for(;;) {
+    TupleTableSlot *slot = ExecProcNode(inner);
+    MinimalTuple tuple;
+    struct varlena *key;
+    bool isnull;
+    Datum d;
+
+    if( TupIsNull(slot) )
+      break;
+
+    d = slot_getattr(slot, state->inner_key, &isnull);
+
+    if( isnull )
+      continue;
+
+    oldcxt = MemoryContextSwitchTo(state->trie_cxt);
+    key   = PG_DETOAST_DATUM_COPY(d);
+    tuple = ExecCopySlotMinimalTuple(slot);
+    pr_trie_insert(state->trie, DatumGetPrefixRange(key), tuple);
+    MemoryContextSwitchTo(oldcxt);
+  }
+  state->trie_built = true;
+}
+
+/*
+ * Get the outer key as a prefix_range, using the same input rules as
+ * the text to prefix_range cast, but without allocating in the common
+ * case of a plain number. An invalid number gives NULL, and matches no
+ * prefix, as with text <@ prefix_range.
+ */
+static prefix_range *
+pr_trie_join_outer_key(pr_trie_join_state *state, Datum d)
+{
+  text *txt;
+  char *str;
+  int len;
+
+  if( !state->outer_is_text )
+    return DatumGetPrefixRangeP(d);
+
+  txt = (text *) PG_DETOAST_DATUM_PACKED(d);
+  str = VARDATA_ANY(txt);
+  len = VARSIZE_ANY_EXHDR(txt);
+
+  if( memchr(str, PR_OPEN, len) != NULL || memchr(str, PR_CLOSE, len) != NULL )
+    return pr_from_str(text_to_cstring(txt));
+
+  if( state->keysize < (int) sizeof(prefix_range) + len ) {
+    state->keysize = sizeof(prefix_range) + len;
+    state->key = (prefix_range *)
+      MemoryContextAlloc(state->css.ss.ps.state->es_query_cxt, state->keysize);
+  }
+  state->key->first = 0;
+  state->key->last  = 0;
+  memcpy(state->key->prefix, str, len);
+  state->key->prefix[len] = 0;
+
+  return state->key;
+}
+
+/*
+ * Collect the trie entries containing the current outer key.
+ */
+static void
+pr_trie_join_match(pr_trie_join_state *state)
+{
+  ExprContext *econtext = state->css.ss.ps.ps_ExprContext;
+  MemoryContext oldcxt;
+  prefix_range *key;
+  int depth, len, d;
+  bool isnull;
+  Datum datum;
+
+  state->nmatches   = 0;
+  state->next_match = 0;
+
+  datum = slot_getattr(state->outer_slot, state->outer_key, &isnull);
+
+  if( isnull )
+    return;
+
+  oldcxt = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+  key = pr_trie_join_outer_key(state, datum);
+  MemoryContextSwitchTo(oldcxt);
+
+  if( key == NULL )
+    return;
+
+  len = strlen(key->prefix);
+
+  if( state->maxpath < len + 1 ) {
+    state->maxpath = len + 1;
+    state->path = (pr_trie_node **)
+      MemoryContextAlloc(state->css.ss.ps.state->es_query_cxt,
+			 state->maxpath * sizeof(pr_trie_node *));
+  }
+  depth = pr_trie_path(state->trie, key->prefix, len, state->path);
+
+  /*
+   * Deepest nodes first, so that the longest matches come first.
+   */
+  for(d=depth-1; d>=0; d--) {
+    pr_trie_entry *entry;
+
+    for(entry=state->path[d]->entries; entry != NULL; entry=entry->next) {
+      if( !pr_contains(entry->pr, key, true) )
+	continue;
+
+      if( state->nmatches == state->maxmatches ) {
+	state->maxmatches = state->maxmatches == 0 ? 16 : 2 * state->maxmatches;
+
+	if( state->matches == NULL )
+	  state->matches = (pr_trie_entry **)
+	    MemoryContextAlloc(state->css.ss.ps.state->es_query_cxt,
+			       state->maxmatches * sizeof(pr_trie_entry *));
+	else
+	  state->matches = (pr_trie_entry **)
+	    repalloc(state->matches, state->maxmatches * sizeof(pr_trie_entry *));
+      }
+      state->matches[state->nmatches++] = entry;
+    }
+  }
+}
+
+/*
+ * Form the scan tuple from the current outer tuple and the given
+ * match, or null inner attributes when there's no match.
+ */
+static TupleTableSlot *
+pr_trie_join_fill(pr_trie_join_state *state, pr_trie_entry *match)
+{
+  TupleTableSlot *slot = state->css.ss.ss_ScanTupleSlot;
+  int i;
+
+  ExecClearTuple(slot);
+
+  if( match != NULL ) {
+    ExecStoreMinimalTuple((MinimalTuple) match->data, state->inner_slot, false);
+    slot_getallattrs(state->inner_slot);
+  }
+
+  for(i=0; i<state->nmap; i++) {
+    int att = state->map_resno[i] - 1;
+
+    if( state->map_side[i] == PR_TRIE_JOIN_OUTER ) {
+      slot->tts_values[i] = state->outer_slot->tts_values[att];
+      slot->tts_isnull[i] = state->outer_slot->tts_isnull[att];
+    }
+    else if( match != NULL ) {
+      slot->tts_values[i] = state->inner_slot->tts_values[att];
+      slot->tts_isnull[i] = state->inner_slot->tts_isnull[att];
+    }
+    else {
+      slot->tts_values[i] = (Datum) 0;
+      slot->tts_isnull[i] = true;
+    }
+  }
+  return ExecStoreVirtualTuple(slot);
+}
+
+static TupleTableSlot *
+pr_trie_join_next(ScanState *ss)
+{
+  pr_trie_join_state *state = (pr_trie_join_state *) ss;
+  PlanState *outer = (PlanState *) linitial(state->css.custom_ps);
+
+  if( !state->trie_built )
+    pr_trie_join_build(state);
+
+  for(;;) {
+    if( state->need_outer ) {
+      TupleTableSlot *slot = ExecProcNode(outer);
+
+      if( TupIsNull(slot) )
+	return ExecClearTuple(ss->ss_ScanTupleSlot);
+
+      state->outer_slot = slot;
+      slot_getallattrs(slot);
+
+      pr_trie_join_match(state);
+      state->need_outer = false;
+
+      if( state->nmatches == 0 && state->jointype == JOIN_LEFT ) {
+	state->need_outer = true;
+	return pr_trie_join_fill(state, NULL);
+      }
+    }
+
+    if( state->next_match < state->nmatches )
+      return pr_trie_join_fill(state, state->matches[state->next_match++]);
+
+    state->need_outer = true;
+  }
+}
+
+/*
+ * We don't support EvalPlanQual, see pr_trie_join_pathlist().
+ */
+static bool
+pr_trie_join_recheck(ScanState *ss, TupleTableSlot *slot)
+{
+  return true;
+}
+
+static TupleTableSlot *
+pr_trie_join_exec(CustomScanState *node)
+{
+  return ExecScan(&node->ss,
+		  (ExecScanAccessMtd) pr_trie_join_next,
+		  (ExecScanRecheckMtd) pr_trie_join_recheck);
+}
+
+static void
+pr_trie_join_end(CustomScanState *node)
+{
+  pr_trie_join_state *state = (pr_trie_join_state *) node;
+
+  ExecEndNode((PlanState *) linitial(node->custom_ps));
+  ExecEndNode((PlanState *) lsecond(node->custom_ps));
+  ExecDropSingleTupleTableSlot(state->inner_slot);
+  MemoryContextDelete(state->trie_cxt);
+}
+
+/*
+ * The trie is only built again when the inner side depends on changed
+ * parameters.
+ */
+static void
+pr_trie_join_rescan(CustomScanState *node)
+{
+  pr_trie_join_state *state = (pr_trie_join_state *) node;
+  PlanState *outer = (PlanState *) linitial(node->custom_ps);
+  PlanState *inner = (PlanState *) lsecond(node->custom_ps);
+
+  if( node->ss.ps.chgParam != NULL ) {
+    UpdateChangedParamSet(outer, node->ss.ps.chgParam);
+    UpdateChangedParamSet(inner, node->ss.ps.chgParam);
+  }
+
+  if( outer->chgParam == NULL )
+    ExecReScan(outer);
+
+  if( inner->chgParam != NULL )
+    state->trie_built = false;
+
+  state->need_outer = true;
+  state->nmatches   = 0;
+  state->next_match = 0;
+}
+
+static void
+pr_trie_join_explain(CustomScanState *node, List *ancestors, ExplainState *es)
+{
+  pr_trie_join_state *state = (pr_trie_join_state *) node;
+  CustomScan *cscan = (CustomScan *) node->ss.ps.plan;
+  bool useprefix = list_length(es->rtable) > 1 || es->verbose;
+  List *context;
+  char *cond;
+
+#if PG_VERSION_NUM >= 130000
+  context = set_deparse_context_plan(es->deparse_cxt,
+				     (Plan *) cscan, ancestors);
+#else
+  context = set_deparse_context_planstate(es->deparse_cxt,
+					  (Node *) node, ancestors);
+#endif
+  cond = deparse_expression((Node *) linitial(cscan->custom_exprs),
+			    context, useprefix, false);
+
+  ExplainPropertyText("Join Cond", cond, es);
+
+  if( state->jointype == JOIN_LEFT )
+    ExplainPropertyText("Join Type", "Left", es);
+
+  if( es->analyze && state->trie != NULL )
+    ExplainPropertyInteger("Trie Nodes", NULL, state->trie->nnodes, es);
+}
+
+#endif  /* PG_VERSION_NUM >= 120000 */
+
+/**
+ * Planner support
+ *
+ * From PostgreSQL 12 on, prefix_range_support() is attached to the
+ * functions implementing the @> and <@ operators, and derives index
+ * conditions for btree and hash indexes.
+ *
+ * When the prefix_range column has a hash_prefix_range_prefix_ops
+ * index, it rewrites
+ *
+ *   prefix @> $1
+ *
+ * into the index condition
+ *
+ *   prefix ~= ANY(prefix_candidates($1, false))
+ *
+ * which is answered with one probe per truncation of $1, finding every
+ * entry with the same prefix whatever its [x-y] range. The original
+ * clause is kept as a filter. Exact probes with = can't be used: the
+ * ranges that may contain $1 are too many to enumerate.
+ *
+ * When a text column is indexed with a btree, it rewrites
+ *
+ *   number <@ '0146[2-5]'
+ *
+ * into number >= '01462' AND number < '01466', as LIKE 'abc%' does,
+ * which needs the index to be sorted in byte order: either the column
+ * collation is "C" or the index uses text_pattern_ops.
+ *
+ * When the table is partitioned by prefix_key(prefix, 2), it rewrites
+ *
+ *   prefix @> $1
+ *
+ * into
+ *
+ *   prefix @> $1
+ *   AND prefix_key(prefix, 2) = ANY(ARRAY[prefix_key($1, 0),
+ *                                         prefix_key($1, 1),
+ *                                         prefix_key($1, 2)])
+ *
+ * so that the partitions that can't contain $1 are pruned, at plan time
+ * or at executor startup for generic plans of prepared statements.
+ */
+#if PG_VERSION_NUM >= 120000
+
+/*
+ * Find one of our functions, in the schema where the extension is
+ * installed, that's the schema of funcid.
+ */
+static Oid
+pr_lookup_function(Oid funcid, const char *funcname, int nargs, Oid *argtypes)
+{
+  char *nspname = get_namespace_name(get_func_namespace(funcid));
+  List *name;
+
+  if( nspname == NULL )
+    return InvalidOid;
+
+  name = list_make2(makeString(nspname), makeString(pstrdup(funcname)));
+
+  return LookupFuncName(name, nargs, argtypes, true);
+}
+
+static List *
+pr_candidates_index_condition(SupportRequestIndexCondition *req,
+			      Node *key, Node *query)
+{
+  Oid prtype = exprType(key), eqop, candfunc, arraytype;
+  Oid argtypes[2];
+  FuncExpr *candidates;
+  ScalarArrayOpExpr *saop;
+
+  if( req->index->relam != HASH_AM_OID )
+    return NIL;
+
+  eqop = get_opfamily_member(req->opfamily, prtype, prtype, HTEqualStrategyNumber);
+
+  if( !OidIsValid(eqop) || !pr_func_is(get_opcode(eqop), prefix_range_same_prefix) )
+    return NIL;
+
+#if PG_VERSION_NUM >= 140000
+  if( !is_pseudo_constant_for_index(req->root, query, req->index) )
+    return NIL;
+#else
+  if( !is_pseudo_constant_for_index(query, req->index) )
+    return NIL;
+#endif
+
+  /*
+   * With the prefix_range @> text operator, cast the query first.
+   */
+  if( exprType(query) == TEXTOID ) {
+    Oid castfunc;
+
+    argtypes[0] = TEXTOID;
+    castfunc = pr_lookup_function(req->funcid, "prefix_range", 1, argtypes);
+
+    if( !OidIsValid(castfunc) )
+      return NIL;
+
+    query = (Node *) makeFuncExpr(castfunc, prtype,
+				  list_make1(copyObject(query)),
+				  InvalidOid, InvalidOid, COERCE_IMPLICIT_CAST);
+  }
+  else
+    query = (Node *) copyObject(query);
+
+  argtypes[0] = prtype;
+  argtypes[1] = BOOLOID;
+  candfunc  = pr_lookup_function(req->funcid, "prefix_candidates", 2, argtypes);
+  arraytype = get_array_type(prtype);
+
+  if( !OidIsValid(candfunc) || !OidIsValid(arraytype) )
+    return NIL;
+
+  candidates = makeFuncExpr(candfunc, arraytype,
+			    list_make2(query, makeBoolConst(false, false)),
+			    InvalidOid, InvalidOid, COERCE_EXPLICIT_CALL);
+
+  saop = makeNode(ScalarArrayOpExpr);
+  saop->opno        = eqop;
+  saop->opfuncid    = get_opcode(eqop);
+  saop->useOr       = true;
+  saop->inputcollid = InvalidOid;
+  saop->args        = list_make2(copyObject(key), candidates);
+  saop->location    = -1;
+
+  /*
+   * Entries sharing a prefix with a truncation of the query don't all
+   * contain it, so keep rechecking with the original operator.
+   */
+  req->lossy = true;
+
+  return list_make1(saop);
+}
+
+static bool
+pr_collation_is_c(Oid collation)
+{
+  if( !OidIsValid(collation) )
+    return false;
+
+#if PG_VERSION_NUM >= 180000
+  return pg_newlocale_from_collation(collation)->collate_is_c;
+#else
+  return lc_collate_is_c(collation);
+#endif
+}
+
+/*
+ * The smallest string greater than all the strings beginning with
+ * str[0..len), when we know how to build it.
+ */
+static text *
+pr_text_upper_bound(char *str, int len)
+{
+  while( len > 0 ) {
+    unsigned char c = (unsigned char) str[len-1];
+
+    /* don't build invalid multibyte characters */
+    if( c < 0x7F ) {
+      str[len-1] = c + 1;
+      return cstring_to_text_with_len(str, len);
+    }
+    len--;
+  }
+  return NULL;
+}
+
+static List *
+pr_text_range_index_condition(SupportRequestIndexCondition *req,
+			      Node *key, Node *query)
+{
+  Oid collation = req->index->indexcollations[req->indexcol];
+  Oid geop, ltop;
+  prefix_range *pr;
+  char *buf;
+  int len;
+  text *lo, *hi;
+  List *result;
+
+  if( req->index->relam != BTREE_AM_OID || exprType(key) != TEXTOID )
+    return NIL;
+
+  /*
+   * We need the bounds at plan time.
+   */
+  if( !IsA(query, Const) || ((Const *) query)->constisnull )
+    return NIL;
+
+  if( req->opfamily != TEXT_PATTERN_BTREE_FAM_OID
+      && !pr_collation_is_c(collation) )
+    return NIL;
+
+  geop = get_opfamily_member(req->opfamily, TEXTOID, TEXTOID,
+			     BTGreaterEqualStrategyNumber);
+  ltop = get_opfamily_member(req->opfamily, TEXTOID, TEXTOID,
+			     BTLessStrategyNumber);
+
+  if( !OidIsValid(geop) || !OidIsValid(ltop) )
+    return NIL;
+
+  pr  = DatumGetPrefixRangeP(((Const *) query)->constvalue);
+  len = strlen(pr->prefix);
+  buf = (char *) palloc(len + 1);
+  memcpy(buf, pr->prefix, len);
+
+  /*
+   * Numbers written as ranges are contained too, and they sort apart
+   * from the plain ones: 0146[2-3] is in 0146[2-5], after 01469, and
+   * 014[6-6] is 0146. Scan the smallest range covering both, the
+   * filter then skips the numbers in between.
+   */
+  if( pr->first != 0 ) {
+    /* the plain numbers from 01462, then the ranges from 0146[ */
+    buf[len] = Min((unsigned char) pr->first, PR_OPEN);
+    lo = cstring_to_text_with_len(buf, len + 1);
+
+    if( (unsigned char) pr->last < 0x7F ) {
+      buf[len] = Max((unsigned char) pr->last + 1, PR_OPEN + 1);
+      hi = cstring_to_text_with_len(buf, len + 1);
+    }
+    else
+      hi = pr_text_upper_bound(buf, len);
+  }
+  else {
+    unsigned char c;
+
+    /* the empty prefix contains any number */
+    if( len == 0 )
+      return NIL;
+
+    /* the plain numbers from 0146, then the ranges from 014[ */
+    c = (unsigned char) buf[len-1];
+
+    if( c < PR_OPEN ) {
+      lo = cstring_to_text_with_len(buf, len);
+      buf[len-1] = PR_OPEN + 1;
+      hi = cstring_to_text_with_len(buf, len);
+    }
+    else {
+      buf[len-1] = PR_OPEN;
+      lo = cstring_to_text_with_len(buf, len);
+      buf[len-1] = c;
+      hi = pr_text_upper_bound(buf, len);
+    }
+  }
+
+  result = list_make1(make_opclause(geop, BOOLOID, false,
+				    (Expr *) copyObject(key),
+				    (Expr *) makeConst(TEXTOID, -1, collation, -1,
+						       PointerGetDatum(lo),
+						       false, false),
+				    InvalidOid, collation));
+  if( hi != NULL )
+    result = lappend(result,
+		     make_opclause(ltop, BOOLOID, false,
+				   (Expr *) copyObject(key),
+				   (Expr *) makeConst(TEXTOID, -1, collation, -1,
+						      PointerGetDatum(hi),
+						      false, false),
+				   InvalidOid, collation));
+  req->lossy = true;
+
+  return result;
+}
+
+static List *
+pr_index_condition(SupportRequestIndexCondition *req)
+{
+  OpExpr *op;
+  Node *left, *right;
+  bool contains;
+
+  if( !is_opclause(req->node) )
+    return NIL;
+
+  op = (OpExpr *) req->node;
+
+  if( list_length(op->args) != 2 )
+    return NIL;
+
+  left  = (Node *) linitial(op->args);
+  right = (Node *) lsecond(op->args);
+
+  if( pr_func_is(req->funcid, prefix_range_contains)
+      || pr_func_is(req->funcid, prefix_range_contains_text) )
+    contains = true;
+
+  else if( pr_func_is(req->funcid, prefix_range_contained_by)
+	   || pr_func_is(req->funcid, text_contained_by_prefix_range) )
+    contains = false;
+
+  else
+    return NIL;
+
+  /*
+   * Normalize to container @> contained, then see which one is indexed.
+   */
+  if( !contains ) {
+    Node *swap = left;
+
+    left  = right;
+    right = swap;
+  }
+
+  if( req->indexarg == (contains ? 0 : 1) )
+    return pr_candidates_index_condition(req, left, right);
+  else
+    return pr_text_range_index_condition(req, right, left);
+}
+
+/*
+ * The query side of a partition key clause: an array of the keys of
+ * query truncated to 0 to len characters, folded to a constant when
+ * query is known at plan time and evaluated at executor startup
+ * otherwise.
+ */
+static Node *
+pr_partition_keys(SupportRequestSimplify *req, Oid keyfunc, Node *query, int len)
+{
+  ArrayExpr *keys = makeNode(ArrayExpr);
+  int i;
+
+  keys->array_typeid   = TEXTARRAYOID;
+  keys->array_collid   = DEFAULT_COLLATION_OID;
+  keys->element_typeid = TEXTOID;
+  keys->multidims      = false;
+  keys->location       = -1;
+
+  for(i=0; i<=len; i++)
+    keys->elements = lappend(keys->elements,
+			     makeFuncExpr(keyfunc, TEXTOID,
+					  list_make2(copyObject(query),
+						     makeConst(INT4OID, -1, InvalidOid,
+							       sizeof(int32),
+							       Int32GetDatum(i),
+							       false, true)),
+					  DEFAULT_COLLATION_OID, InvalidOid,
+					  COERCE_EXPLICIT_CALL));
+
+  return eval_const_expressions(req->root, (Node *) keys);
+}
+
+/*
+ * When prefix @> $1 applies to a table partitioned by prefix_key(prefix,
+ * len), add prefix_key(prefix, len) = ANY(keys of $1) to it, that the
+ * planner knows how to prune partitions with.
+ */
+static Node *
+pr_partition_simplify(SupportRequestSimplify *req)
+{
+  FuncExpr *fexpr = req->fcall;
+  Node *left, *right, *query;
+  Var *var;
+  RangeTblEntry *rte;
+  Relation rel;
+  PartitionKey partkey;
+  List *clauses = NIL;
+  Oid prtype, keyfunc, opno;
+  Oid argtypes[2];
+  char *nspname;
+  const char *opname;
+  int i, nexpr = 0;
+
+  if( req->root == NULL || list_length(fexpr->args) != 2 )
+    return NULL;
+
+  left  = (Node *) linitial(fexpr->args);
+  right = (Node *) lsecond(fexpr->args);
+
+  if( pr_func_is(fexpr->funcid, prefix_range_contains)
+      || pr_func_is(fexpr->funcid, prefix_range_contains_text) ) {
+    opname = "@>";
+    var    = (Var *) left;
+    query  = right;
+  }
+  else if( pr_func_is(fexpr->funcid, prefix_range_contained_by)
+	   || pr_func_is(fexpr->funcid, text_contained_by_prefix_range) ) {
+    opname = "<@";
+    var    = (Var *) right;
+    query  = left;
+  }
+  else
+    return NULL;
+
+  if( !IsA(var, Var) || var->varlevelsup != 0
+      || contain_var_clause(query) || contain_volatile_functions(query) )
+    return NULL;
+
+  rte = rt_fetch(var->varno, req->root->parse->rtable);
+
+  if( rte->rtekind != RTE_RELATION
+      || rte->relkind != RELKIND_PARTITIONED_TABLE )
+    return NULL;
+
+  prtype = var->vartype;
+  argtypes[0] = prtype;
+  argtypes[1] = INT4OID;
+  keyfunc = pr_lookup_function(fexpr->funcid, "prefix_key", 2, argtypes);
+
+  if( !OidIsValid(keyfunc) )
+    return NULL;
+
+  /*
+   * prefix_key() takes a prefix_range, cast text queries as @> does.
+   */
+  if( exprType(query) == TEXTOID ) {
+    Oid castfunc;
+
+    argtypes[0] = TEXTOID;
+    castfunc = pr_lookup_function(fexpr->funcid, "prefix_range", 1, argtypes);
+
+    if( !OidIsValid(castfunc) )
+      return NULL;
+
+    query = (Node *) makeFuncExpr(castfunc, prtype, list_make1(query),
+				  InvalidOid, InvalidOid, COERCE_IMPLICIT_CAST);
+  }
+
+  rel = table_open(rte->relid, NoLock);
+  partkey = RelationGetPartitionKey(rel);
+
+  for(i=0; i<partkey->partnatts; i++) {
+    FuncExpr *keyexpr;
+    Var *keyvar;
+    Const *keylen;
+    ScalarArrayOpExpr *saop;
+    int strategy;
+
+    if( partkey->partattrs[i] != 0 )
+      continue;
+
+    keyexpr = (FuncExpr *) list_nth(partkey->partexprs, nexpr++);
+
+    if( !IsA(keyexpr, FuncExpr) || keyexpr->funcid != keyfunc
+	|| partkey->parttypid[i] != TEXTOID )
+      continue;
+
+    keyvar = (Var *) linitial(keyexpr->args);
+    keylen = (Const *) lsecond(keyexpr->args);
+
+    if( !IsA(keyvar, Var) || keyvar->varattno != var->varattno
+	|| !IsA(keylen, Const) || keylen->constisnull
+	|| DatumGetInt32(keylen->constvalue) < 0 )
+      continue;
+
+    strategy = partkey->strategy == PARTITION_STRATEGY_HASH
+      ? HTEqualStrategyNumber : BTEqualStrategyNumber;
+    opno = get_opfamily_member(partkey->partopfamily[i],
+			       TEXTOID, TEXTOID, strategy);
+
+    if( !OidIsValid(opno) )
+      continue;
+
+    /* the key expression as the planner sees it for this relation */
+    keyexpr = copyObject(keyexpr);
+    ChangeVarNodes((Node *) keyexpr, 1, var->varno, 0);
+
+    saop = makeNode(ScalarArrayOpExpr);
+    saop->opno        = opno;
+    saop->opfuncid    = get_opcode(opno);
+    saop->useOr       = true;
+    saop->inputcollid = partkey->partcollation[i];
+    saop->args        = list_make2(keyexpr,
+				   pr_partition_keys(req, keyfunc, query,
+						     DatumGetInt32(keylen->constvalue)));
+    saop->location    = -1;
+
+    clauses = lappend(clauses, saop);
+  }
+  table_close(rel, NoLock);
+
+  if( clauses == NIL )
+    return NULL;
+
+  /*
+   * Keep the original clause first, as an operator so that it is still
+   * matched to the partitions indexes.
+   */
+  nspname = get_namespace_name(get_func_namespace(fexpr->funcid));
+  opno = OpernameGetOprid(list_make2(makeString(nspname),
+				     makeString(pstrdup(opname))),
+			  exprType(left), exprType(right));
+
+  if( !OidIsValid(opno) || get_opcode(opno) != fexpr->funcid )
+    return NULL;
+
+  return (Node *) make_andclause(lcons(make_opclause(opno, BOOLOID, false,
+						    (Expr *) left,
+						    (Expr *) right,
+						    InvalidOid,
+						    fexpr->inputcollid),
+				       clauses));
+}
+
+#endif  /* PG_VERSION_NUM >= 120000 */
+
+PG_FUNCTION_INFO_V1(prefix_range_support);
+Datum
+prefix_range_support(PG_FUNCTION_ARGS)
+{
+  Node *ret = NULL;
+
+#if PG_VERSION_NUM >= 120000
+  Node *rawreq = (Node *) PG_GETARG_POINTER(0);
+
+  if( IsA(rawreq, SupportRequestIndexCondition) )
+    ret = (Node *) pr_index_condition((SupportRequestIndexCondition *) rawreq);
+
+  else if( IsA(rawreq, SupportRequestSimplify) )
+    ret = pr_partition_simplify((SupportRequestSimplify *) rawreq);
+#endif
+
+  PG_RETURN_POINTER(ret);
+}
+
+void
+_PG_init(void)
+{
+  DefineCustomBoolVariable("prefix.enable_trie_join",
+			   "Enables the planner's use of prefix trie joins.",
+			   NULL,
+			   &prefix_enable_trie_join,
+			   true,
+			   PGC_USERSET,
+			   0,
+			   NULL, NULL, NULL);
+
+#if PG_VERSION_NUM >= 150000
+  MarkGUCPrefixReserved("prefix");
+#else
+  EmitWarningsOnPlaceholders("prefix");
+#endif
+
+#if PG_VERSION_NUM >= 120000
+  RegisterCustomScanMethods(&pr_trie_join_scan_methods);
+
+  prev_set_join_pathlist_hook = set_join_pathlist_hook;
+  set_join_pathlist_hook = pr_trie_join_pathlist;
+#endif
+}
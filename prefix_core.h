@@ -0,0 +1,673 @@
+/**
+ * prefix_range core: the data type and its algorithms, comparisons,
+ * containment, union, intersection and GiST penalty, with no other
+ * dependency than the C library.
+ *
+ * The functions are static inline so that the fmgr entry points of
+ * prefix.c, that include this file after postgres.h, get them inlined.
+ * The file also compiles alone, for the microbenchmark and the fuzz
+ * harness (see TESTS.md), where it provides the few PostgreSQL macros
+ * it needs.
+ *
+ * Memory is allocated with pr_alloc() and released with pr_free(),
+ * palloc() and pfree() in the backend and malloc() and free() outside,
+ * unless the including file defines them first. All the functions
+ * returning a prefix_range return a new allocation, that the caller
+ * owns.
+ */
+#ifndef PREFIX_CORE_H
+#define PREFIX_CORE_H
+
+#ifndef POSTGRES_H
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint64_t uint64;
+
+#define UINT64CONST(x)      (x##ULL)
+#define Min(x, y)           ((x) < (y) ? (x) : (y))
+#define Assert(condition)   assert(condition)
+
+#define NOTICE              0
+#define elog(level, ...)    (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define WORDS_BIGENDIAN 1
+#endif
+#endif
+
+#include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#ifndef pr_alloc
+#ifdef POSTGRES_H
+#define pr_alloc(size)      palloc(size)
+#define pr_free(ptr)        pfree(ptr)
+#else
+#define pr_alloc(size)      malloc(size)
+#define pr_free(ptr)        free(ptr)
+#endif
+#endif
+
+/**
+ * prefix_range datatype, varlena structure
+ */
+typedef struct {
+  char first;
+  char last;
+  char prefix[1]; /* this is a varlena structure, data follows */
+} prefix_range;
+
+enum pr_delimiters_t {
+  PR_OPEN   = '[',
+  PR_CLOSE  = ']',
+  PR_SEP    = '-'
+};
+
+/**
+ * Byte kernels
+ *
+ * pr_mismatch() returns the length of the common prefix of a and b,
+ * both at least len bytes long, and pr_all_digits() tells whether the
+ * len bytes of s are all digits.
+ *
+ * They compare 16 bytes at a time with SSE2 on x86-64 and NEON on
+ * AArch64, that those architectures always have, then 8 bytes at a
+ * time in a register, then byte per byte: typical telephone keys of 8
+ * to 15 digits are done in one or two steps.
+ */
+static inline
+int pr_mismatch(const char *a, const char *b, int len) {
+  int i = 0;
+
+#if defined(__SSE2__)
+  for(; i + 16 <= len; i += 16) {
+    __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+
+    if( mask != 0xFFFF )
+      return i + __builtin_ctz(~mask & 0xFFFF);
+  }
+#elif defined(__aarch64__)
+  for(; i + 16 <= len; i += 16) {
+    uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t *) (a + i)),
+			     vld1q_u8((const uint8_t *) (b + i)));
+
+    if( vminvq_u8(eq) != 0xFF )
+      break;
+  }
+#endif
+
+#if defined(__GNUC__) && !defined(WORDS_BIGENDIAN)
+  for(; i + 8 <= len; i += 8) {
+    uint64 wa, wb;
+
+    memcpy(&wa, a + i, 8);
+    memcpy(&wb, b + i, 8);
+
+    if( wa != wb )
+      return i + __builtin_ctzll(wa ^ wb) / 8;
+  }
+#endif
+
+  for(; i < len && a[i] == b[i]; i++);
+
+  return i;
+}
+
+static inline
+bool pr_all_digits(const char *s, int len) {
+  int i = 0;
+
+#if defined(__SSE2__)
+  for(; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+    __m128i d = _mm_subs_epu8(_mm_sub_epi8(v, _mm_set1_epi8('0')),
+			      _mm_set1_epi8(9));
+
+    if( _mm_movemask_epi8(_mm_cmpeq_epi8(d, _mm_setzero_si128())) != 0xFFFF )
+      return false;
+  }
+#elif defined(__aarch64__)
+  for(; i + 16 <= len; i += 16) {
+    uint8x16_t d = vsubq_u8(vld1q_u8((const uint8_t *) (s + i)), vdupq_n_u8('0'));
+
+    if( vmaxvq_u8(d) > 9 )
+      return false;
+  }
+#endif
+
+  /* '0' to '9' are 0x30 to 0x39: high nibble 3, still 3 adding 6 */
+  for(; i + 8 <= len; i += 8) {
+    uint64 w;
+
+    memcpy(&w, s + i, 8);
+
+    if( (w & UINT64CONST(0xF0F0F0F0F0F0F0F0)) != UINT64CONST(0x3030303030303030)
+	|| ((w + UINT64CONST(0x0606060606060606)) & UINT64CONST(0xF0F0F0F0F0F0F0F0))
+	   != UINT64CONST(0x3030303030303030) )
+      return false;
+  }
+
+  for(; i < len; i++)
+    if( s[i] < '0' || s[i] > '9' )
+      return false;
+
+  return true;
+}
+
+/**
+ * Used by prefix_contains_internal and pr_contains_prefix.
+ *
+ * plen is the length of string p, qlen the length of string q, the
+ * caller are dealing with either text * or char * and its their
+ * responsabolity to use either strlen() or VARSIZE_ANY_EXHDR()
+ */
+static inline
+bool __prefix_contains(char *p, char *q, int plen, int qlen) {
+  if(qlen < plen )
+    return false;
+
+  return pr_mismatch(p, q, plen) == plen;
+}
+
+/**
+ * Helper functions which build a prefix_range from a prefix, a first
+ * and a last component, making a copy of the len first characters of
+ * the prefix string. There's room for one more character in the
+ * prefix, see pr_normalize_inplace().
+ */
+static inline
+prefix_range *build_pr_len(const char *prefix, int len, char first, char last) {
+  prefix_range *pr = pr_alloc(sizeof(prefix_range) + len + 1);
+  memcpy(pr->prefix, prefix, len);
+  pr->prefix[len] = 0;
+  pr->first = first;
+  pr->last  = last;
+
+#ifdef DEBUG_PR_IN
+  elog(NOTICE,
+       "build_pr: pr->prefix = '%s', pr->first = %d, pr->last = %d",
+       pr->prefix, pr->first, pr->last);
+#endif
+
+  return pr;
+}
+
+static inline
+prefix_range *build_pr(const char *prefix, char first, char last) {
+  return build_pr_len(prefix, strlen(prefix), first, last);
+}
+
+/**
+ * Normalize a prefix_range. Two cases are handled:
+ *
+ *  abc[x-x] is rewritten abcx
+ *  abc[x-y] is rewritten abc[y-x] when y < x
+ *
+ * pr_normalize_inplace() rewrites a value made with build_pr(),
+ * pr_normalize() returns a normalized copy of its argument.
+ */
+static inline
+prefix_range *pr_normalize_inplace(prefix_range *pr) {
+  char tmpswap;
+
+  if( pr->first != 0 && pr->first == pr->last ) {
+    int len = strlen(pr->prefix);
+
+#ifdef DEBUG_PR_NORMALIZE
+    elog(NOTICE, "prefix_range %s[%c-%c]", pr->prefix, pr->first, pr->last);
+#endif
+
+    pr->prefix[len]   = pr->first;
+    pr->prefix[len+1] = 0;
+    pr->first = pr->last = 0;
+  }
+  else if( pr->first > pr->last ) {
+    tmpswap   = pr->first;
+    pr->first = pr->last;
+    pr->last  = tmpswap;
+  }
+  return pr;
+}
+
+static inline
+prefix_range *pr_normalize(prefix_range *a) {
+  return pr_normalize_inplace(build_pr(a->prefix, a->first, a->last));
+}
+
+/*
+ * Init a prefix value from the prefix_range(text, text, text)
+ * function
+ */
+static inline
+prefix_range *make_prefix_range(char *str, char first, char last) {
+  return pr_normalize_inplace(build_pr(str != NULL ? str : "", first, last));
+}
+
+/*
+ * Allow users to use length(prefix) rather than length(prefix::text), and
+ * while at it, provides an implementation which won't count the displaying
+ * artifacts that are the [] and -.
+ */
+static inline
+int pr_length(prefix_range *pr) {
+  int len = strlen(pr->prefix);
+
+  if( pr->first != 0 || pr->last != 0 )
+    len += 1;
+
+  return len;
+}
+
+static inline
+bool pr_eq(prefix_range *a, prefix_range *b) {
+  int sa = strlen(a->prefix);
+  int sb = strlen(b->prefix);
+
+  return sa == sb
+    && memcmp(a->prefix, b->prefix, sa) == 0
+    && a->first == b->first
+    && a->last  == b->last;
+}
+
+/*
+ * We invent a prefix_range ordering for convenience, but that's
+ * dangerous. Use the BTree opclass at your own risk.
+ *
+ * On the other hand, when your routing table does contain pretty static
+ * data and you test it carefully or know it will fit into the ordering
+ * simplification, you're good to go.
+ *
+ * Baring bug, the constraint is to have non-overlapping data.
+ */
+
+/*static inline
+bool pr_lt(prefix_range *a, prefix_range *b, bool eqval) {
+*/
+
+static inline
+int pr_cmp(prefix_range *a, prefix_range *b) {
+  int cmp = 0;
+  int alen = strlen(a->prefix);
+  int blen = strlen(b->prefix);
+  int mlen = alen; /* minimum length */
+  char *p  = a->prefix;
+  char *q  = b->prefix;
+
+  /*
+   * First case, common prefix length
+   */
+  if( alen == blen ) {
+    cmp = memcmp(p, q, alen);
+
+    /* Uncommon prefix, easy to compare */
+    if( cmp != 0 )
+      return cmp;
+
+    /* Common prefix, check for (sub)ranges */
+    else
+      return (a->first == b->first) ? (a->last - b->last) : (a->first - b->first);
+  }
+
+  /* For memcmp() safety, we need the minimum length */
+  if( mlen > blen )
+    mlen = blen;
+
+  /*
+   * Don't forget we may have [x-y] prefix style, that's empty prefix, only range.
+   */
+  if( alen == 0 && a->first != 0 ) {
+    /* return (eqval ? (a->first <= q[0]) : (a->first < q[0])); */
+    return a->first - q[0];
+  }
+  else if( blen == 0 && b->first != 0 ) {
+    /* return (eqval ? (p[0] <= b->first) : (p[0] < b->first)); */
+    return p[0] - b->first;
+  }
+
+  /*
+   * General case
+   *
+   * When memcmp() on the shorter of p and q returns 0, that means they
+   * share a common prefix: avoid to say that '93' < '9377' and '9377' <
+   * '93'.
+   */
+  cmp = memcmp(p, q, mlen);
+
+  if( cmp == 0 )
+    /*
+     * we are comparing e.g. '1' and '12' (the shorter contains the
+     * smaller), so let's pretend '12' < '1' as it contains less elements.
+     */
+    return (alen == mlen) ? 1 : -1;
+
+  return cmp;
+}
+
+static inline
+bool pr_lt(prefix_range *a, prefix_range *b, bool eqval) {
+  int cmp = pr_cmp(a, b);
+  return eqval ? cmp <= 0 : cmp < 0;
+}
+
+static inline
+bool pr_gt(prefix_range *a, prefix_range *b, bool eqval) {
+  int cmp = pr_cmp(a, b);
+  return eqval ? cmp >= 0 : cmp > 0;
+}
+
+static inline
+bool pr_contains(prefix_range *left, prefix_range *right, bool eqval) {
+  int sl;
+  int sr;
+  bool left_prefixes_right;
+
+  if( pr_eq(left, right) )
+    return eqval;
+
+  sl = strlen(left->prefix);
+  sr = strlen(right->prefix);
+
+  if( sr < sl )
+    return false;
+
+  left_prefixes_right = pr_mismatch(left->prefix, right->prefix, sl) == sl;
+
+  if( left_prefixes_right ) {
+    if( sl == sr )
+      return left->first == 0 ||
+	(left->first <= right->first && left->last >= right->last);
+
+    return left->first == 0 ||
+      (left->first <= right->prefix[sl] && right->prefix[sl] <= left->last);
+  }
+  return false;
+}
+
+/**
+ * The union of a and b is the smallest prefix_range containing both.
+ */
+static inline
+prefix_range *pr_union(prefix_range *a, prefix_range *b) {
+  prefix_range *res = NULL;
+  int alen = strlen(a->prefix);
+  int blen = strlen(b->prefix);
+  int gplen = pr_mismatch(a->prefix, b->prefix, Min(alen, blen));
+  char min, max;
+
+  if( 0 == alen && 0 == blen ) {
+    if( a->first == 0 || b->first == 0 )
+      return build_pr("", 0, 0);
+
+    res = build_pr("",
+		   a->first <= b->first ? a->first : b->first,
+		   a->last  >= b->last  ? a->last : b->last);
+    return pr_normalize_inplace(res);
+  }
+
+  if( gplen == 0 ) {
+    res = build_pr("", 0, 0);
+    if( alen > 0 && blen > 0 ) {
+      res->first = a->prefix[0];
+      res->last  = b->prefix[0];
+    }
+    else if( alen == 0 && a->first != 0 ) {
+      res->first = a->first <= b->prefix[0] ? a->first : b->prefix[0];
+      res->last  = a->last  >= b->prefix[0] ? a->last  : b->prefix[0];
+    }
+    else if( blen == 0 && b->first != 0 ) {
+      res->first = b->first <= a->prefix[0] ? b->first : a->prefix[0];
+      res->last  = b->last  >= a->prefix[0] ? b->last  : a->prefix[0];
+    }
+  }
+  else {
+    /* a side without a range contains all the values of its prefix */
+    res = build_pr_len(a->prefix, gplen, 0, 0);
+
+    if( gplen == alen && alen == blen ) {
+      if( a->first != 0 && b->first != 0 ) {
+	res->first = a->first <= b->first ? a->first : b->first;
+	res->last  = a->last  >= b->last  ? a->last : b->last;
+      }
+    }
+    else if( gplen == alen ) {
+      Assert(alen < blen);
+      if( a->first != 0 ) {
+	res->first = a->first <= b->prefix[alen] ? a->first : b->prefix[alen];
+	res->last  = a->last  >= b->prefix[alen] ? a->last  : b->prefix[alen];
+      }
+    }
+    else if( gplen == blen ) {
+      Assert(blen < alen);
+      if( b->first != 0 ) {
+	res->first = b->first <= a->prefix[blen] ? b->first : a->prefix[blen];
+	res->last  = b->last  >= a->prefix[blen] ? b->last  : a->prefix[blen];
+      }
+    }
+    else {
+      Assert(gplen < alen && gplen < blen);
+      min = a->prefix[gplen];
+      max = b->prefix[gplen];
+
+      if( min > max ) {
+	min = b->prefix[gplen];
+	max = a->prefix[gplen];
+      }
+      res->first = min;
+      res->last  = max;
+    }
+  }
+#ifdef DEBUG_UNION
+  elog(NOTICE, "union a: %s %d %d", a->prefix, a->first, a->last);
+  elog(NOTICE, "union b: %s %d %d", b->prefix, b->first, b->last);
+  elog(NOTICE, "union r: %s %d %d", res->prefix, res->first, res->last);
+#endif
+  return pr_normalize_inplace(res);
+}
+
+/**
+ * The intersection of a and b, or the empty prefix_range '' when they
+ * don't overlap: check with pr_overlaps() first, as '' contains any
+ * prefix_range.
+ */
+static inline
+prefix_range *pr_inter(prefix_range *a, prefix_range *b) {
+  prefix_range *res = NULL;
+  prefix_range *shorter, *longer;
+  int alen = strlen(a->prefix);
+  int blen = strlen(b->prefix);
+  int gplen = pr_mismatch(a->prefix, b->prefix, Min(alen, blen));
+  char first, last;
+
+  if( gplen != alen && gplen != blen )
+    return build_pr("", 0, 0);
+
+  if( alen == blen ) {
+    if( a->first == 0 ) {
+      first = b->first;
+      last  = b->last;
+    }
+    else if( b->first == 0 ) {
+      first = a->first;
+      last  = a->last;
+    }
+    else {
+      first = a->first > b->first ? a->first : b->first;
+      last  = a->last  < b->last  ? a->last  : b->last;
+
+      if( first > last )
+	return build_pr("", 0, 0);
+    }
+    res = pr_normalize_inplace(build_pr_len(a->prefix, alen, first, last));
+
+#ifdef DEBUG_INTER
+    elog(NOTICE, "inter a: %s %d %d", a->prefix, a->first, a->last);
+    elog(NOTICE, "inter b: %s %d %d", b->prefix, b->first, b->last);
+    elog(NOTICE, "inter r: %s %d %d", res->prefix, res->first, res->last);
+#endif
+    return res;
+  }
+
+  /* the longer one, when its next character is in the shorter range */
+  shorter = alen < blen ? a : b;
+  longer  = alen < blen ? b : a;
+
+  if( shorter->first == 0
+      || (shorter->first <= longer->prefix[gplen]
+	  && longer->prefix[gplen] <= shorter->last) )
+    return pr_normalize(longer);
+
+  return build_pr("", 0, 0);
+}
+
+/**
+ * true if ranges have at least one common element: when one of them
+ * contains the other, or when they have the same prefix and
+ * overlapping ranges.
+ */
+static inline
+bool pr_overlaps(prefix_range *a, prefix_range *b) {
+  if( pr_contains(a, b, true) || pr_contains(b, a, true) )
+    return true;
+
+  return a->first != 0 && b->first != 0
+    && strcmp(a->prefix, b->prefix) == 0
+    && a->first <= b->last && b->first <= a->last;
+}
+
+static inline
+float __pr_penalty(prefix_range *orig, prefix_range *new)
+{
+  float penalty;
+  int  nlen, olen, gplen, dist = 0;
+  char tmp;
+
+#ifdef DEBUG_PENALTY
+  if( orig->prefix[0] != 0 ) {
+    /**
+     * The prefix main test case deals with phone number data, hence
+     * containing only numbers...
+     */
+    if( orig->prefix[0] < '0' || orig->prefix[0] > '9' )
+      elog(NOTICE, "__pr_penalty(%s, %s) orig->first=%d orig->last=%d ",
+	   orig->prefix, new->prefix, orig->first, orig->last);
+    Assert(orig->prefix[0] >= '0' && orig->prefix[0] <= '9');
+  }
+#endif
+
+  olen  = strlen(orig->prefix);
+  nlen  = strlen(new->prefix);
+  gplen = pr_mismatch(orig->prefix, new->prefix, Min(olen, nlen));
+
+  dist  = 1;
+
+  if( 0 == olen && 0 == nlen ) {
+    if( orig->last >= new->first )
+      dist = 0;
+    else
+      dist = new->first - orig->last;
+  }
+  else if( 0 == olen ) {
+    /**
+     * penalty('[a-b]', 'xyz');
+     */
+    if( orig->first != 0 ) {
+      tmp = new->prefix[0];
+
+      if( orig->first <= tmp && tmp <= orig->last ) {
+	gplen = 1;
+
+	dist = 1 + (int)tmp - (int)orig->first;
+	if( (1 + (int)orig->last - (int)tmp) < dist )
+	  dist = 1 + (int)orig->last - (int)tmp;
+      }
+      else
+	dist = (orig->first > tmp ? orig->first - tmp  : tmp - orig->last );
+    }
+  }
+  else if( 0 == nlen ) {
+    /**
+     * penalty('abc', '[x-y]');
+     */
+    if( new->first != 0 ) {
+      tmp = orig->prefix[0];
+
+      if( new->first <= tmp && tmp <= new->last ) {
+	gplen = 1;
+
+	dist = 1 + (int)tmp - (int)new->first;
+	if( (1 + (int)new->last - (int)tmp) < dist )
+	  dist = 1 + (int)new->last - (int)tmp;
+      }
+      else
+	dist = (new->first > tmp ? new->first - tmp  : tmp - new->last );
+    }
+  }
+  else {
+    /**
+     * General case
+     */
+
+    if( gplen > 0 ) {
+      if( olen > gplen && nlen == gplen && new->first != 0 ) {
+	/**
+	 * gpr_penalty('abc[f-l]', 'ab[x-y]')
+	 */
+	if( new->first <= orig->prefix[gplen]
+	    && orig->prefix[gplen] <= new->last ) {
+
+	  dist   = 1 + (int)orig->prefix[gplen] - (int)new->first;
+	  if( (1 + (int)new->last - (int)orig->prefix[gplen]) < dist )
+	    dist = 1 + (int)new->last - (int)orig->prefix[gplen];
+
+	  gplen += 1;
+	}
+	else {
+	  dist += 1;
+	}
+      }
+      else if( nlen > gplen && olen == gplen && orig->first != 0 ) {
+	/**
+	 * gpr_penalty('ab[f-l]', 'abc[x-y]')
+	 */
+	if( orig->first <= new->prefix[gplen]
+	    && new->prefix[gplen] <= orig->last ) {
+
+	  dist   = 1 + (int)new->prefix[gplen] - (int)orig->first;
+	  if( (1 + (int)orig->last - (int)new->prefix[gplen]) < dist )
+	    dist = 1 + (int)orig->last - (int)new->prefix[gplen];
+
+	  gplen += 1;
+	}
+	else {
+	  dist += 1;
+	}
+      }
+    }
+    /**
+     * penalty('abc[f-l]', 'xyz[g-m]'), nothing common
+     * dist = 1, gplen = 0, penalty = 1
+     */
+  }
+  penalty = (((float)dist) / powf(256, gplen));
+
+#ifdef DEBUG_PENALTY
+  elog(NOTICE, "__pr_penalty(%s[%d-%d], %s[%d-%d]) == %d/(256^%d) == %g",
+       orig->prefix, orig->first, orig->last, new->prefix, new->first, new->last,
+       dist, gplen, penalty);
+#endif
+
+  return penalty;
+}
+
+#endif /* PREFIX_CORE_H */
@@ -0,0 +1,30 @@
+select pr, prefix_range_send(pr)
+  from (values ('0146[2-5]'::prefix_range), ('01466'), ('4'), ('[1-3]'),
+               ('ab[c-d]'), ('')) as t(pr);
+
+create table wire(pr prefix_range);
+insert into wire select prefix from ranges;
+insert into wire values ('0146[2-5]'), ('01466'), ('[1-3]'), ('ab[c-d]'), ('');
+\copy wire to 'results/wire.data' with (format binary)
+create table wire_in(pr prefix_range);
+\copy wire_in from 'results/wire.data' with (format binary)
+select count(*) from wire_in;
+select count(*)
+  from (select pr::text from wire except all select pr::text from wire_in) as t;
+
+-- the former format, and normalization of the received values
+create table legacy(pr bytea);
+insert into legacy values ('\x32353031343600'), ('\x0000303134363600'),
+                          ('\x3737303100'), ('\x3532303100');
+\copy legacy to 'results/legacy.data' with (format binary)
+create table legacy_in(pr prefix_range);
+\copy legacy_in from 'results/legacy.data' with (format binary)
+select pr from legacy_in;
+
+create table invalid(pr bytea);
+insert into invalid values ('\x020000014a');
+\copy invalid to 'results/invalid.data' with (format binary)
+\copy legacy_in from 'results/invalid.data' with (format binary)
+
+-- short values are stored with a 1 byte varlena header
+select pg_column_size(prefix) from ranges where prefix = '0146';
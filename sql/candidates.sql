@@ -0,0 +1,22 @@
+select prefix_candidates('0146', false);
+select prefix_candidates('0146[4-5]', false);
+select count(*) from unnest(prefix_candidates('0146')) c;
+select count(*) from unnest(prefix_candidates('0146[4-5]')) c;
+select bool_and(c @> '0146[4-5]') from unnest(prefix_candidates('0146[4-5]')) c;
+
+select a, b, a ~= b as same_prefix
+  from (values('0146[4-5]'::prefix_range, '0146'::prefix_range),
+              ('014[0-z]', '0146'),
+              ('', '[1-2]')) as t(a, b);
+
+create table cand as select prefix, name from ranges;
+insert into cand values ('0146[6-7]', 'RANGE'), ('014[0-z]', 'CROSS'), ('01[#-9]', 'PUNCT');
+create index cand_prefix_hash on cand using hash(prefix hash_prefix_range_prefix_ops);
+analyze cand;
+
+set enable_seqscan to off;
+explain (costs off) select * from cand where prefix @> '0146640123';
+select * from cand where prefix @> '0146640123' order by length(prefix), name;
+select * from cand where '0146640123' <@ prefix order by length(prefix), name;
+
+reset enable_seqscan;
@@ -0,0 +1,14 @@
+create table deck(prefix prefix_range, rate numeric);
+
+insert into deck select '0146' || d, 0.01 from generate_series(0, 9) d;
+insert into deck select '0147' || d, 0.01 from generate_series(0, 5) d;
+insert into deck values ('01478', 0.01), ('01479', 0.01), ('0146[2-3]', 0.01), ('014655', 0.01);
+insert into deck values ('0148[0-4]', 0.02), ('0148[5-9]', 0.02), ('0149', 0.02), ('014[0-5]', 0.02);
+insert into deck values ('33', 0.03), ('3[0-2]', 0.03), ('3[4-9]', 0.03);
+insert into deck values ('01', 0.04), ('', 0.04);
+
+select rate, prefix_range_compact(prefix) from deck group by rate order by rate;
+
+select unnest(prefix_range_compact(prefix)) from deck where rate = 0.02;
+
+select prefix_range_compact(prefix) from deck where rate > 1;
@@ -0,0 +1,20 @@
+select id, n,
+       prefix_contains_any(array['0146[2-5]', '0147', '33']::prefix_range[], n) as any,
+       prefix_longest_any(array['01', '0146[2-5]', '0147', '014', null, '01463']::prefix_range[], n) as longest
+  from (values (1, '0146312345'), (2, '0146612345'), (3, '0147'),
+               (4, '33'), (5, '3'), (6, '0146[3-4]')) as t(id, n)
+order by id;
+
+select id, prefix_longest_any(prefixes, '0146312345')
+  from (values (1, array['0146']::prefix_range[]),
+               (2, array['01', '0146[3-4]']::prefix_range[]),
+               (3, array['02']::prefix_range[]),
+               (4, array['0146']::prefix_range[])) as t(id, prefixes)
+order by id;
+
+select count(*) from numbers
+ where prefix_contains_any(array['0146[2-5]', '0147']::prefix_range[], number);
+
+select count(*) from numbers
+ where prefix_contains_any(array['0146[2-5]', '0147', '0100']::prefix_range[], number)
+       <> (number <@ any(array['0146[2-5]', '0147', '0100']::prefix_range[]));
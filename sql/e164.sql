@@ -0,0 +1,47 @@
+select '0146[2-5]'::e164_prefix as a, '33'::e164_prefix as b,
+       ''::e164_prefix as c, '123456789012345'::e164_prefix as d;
+select 'ab'::e164_prefix;
+select '1234567890123456'::e164_prefix;
+select '123456789012345[5-6]'::e164_prefix;
+
+select '0146[2-5]'::prefix_range::e164_prefix as e164,
+       '0146[2-5]'::e164_prefix::prefix_range as prefix_range;
+select 'ab'::prefix_range::e164_prefix;
+
+select a, b, a = b as "=", a < b as "<", a @> b as "@>", a <@ b as "<@", a && b as "&&"
+  from (values ('0146'::e164_prefix, '01462'::e164_prefix),
+               ('0146[2-5]', '01463'),
+               ('0146[2-5]', '01466'),
+               ('0146[2-5]', '0146[4-7]'),
+               ('01', '0146'),
+               ('', '33')) as t(a, b);
+
+select '01462'::e164_prefix | '01465' as union,
+       '0146[2-5]'::e164_prefix & '0146[4-7]' as intersect;
+
+select p
+  from (values ('0146'::e164_prefix), ('01'), ('0146[2-5]'), ('01462'),
+               ('33'), (''), ('0147')) as t(p)
+order by p;
+
+select e164_prefix_send('0146[2-5]'), e164_prefix_send('33'), e164_prefix_send('');
+
+create table e164_wire(p e164_prefix);
+insert into e164_wire select prefix from ranges;
+\copy e164_wire to 'results/e164.data' with (format binary)
+create table e164_in(p e164_prefix);
+\copy e164_in from 'results/e164.data' with (format binary)
+select count(*), count(distinct p) from e164_in;
+
+create table e164_invalid(p int8);
+insert into e164_invalid values (x'00d4753d05000463'::int8);
+\copy e164_invalid to 'results/e164_invalid.data' with (format binary)
+\copy e164_in from 'results/e164_invalid.data' with (format binary)
+
+create index e164_idx on e164_in using gist(p);
+set enable_seqscan to off;
+select p from e164_in where p @> '0146640123';
+select p from e164_in where p @> '3612345';
+select count(*) from e164_in where p <@ '014';
+select count(*) from e164_in where p && '0[1-2]';
+reset enable_seqscan;
@@ -0,0 +1,17 @@
+create table pool as select number from numbers;
+insert into pool values ('0146[2-3]');
+create index pool_number_gin on pool using gin(number gin_prefix_text_ops);
+analyze pool;
+
+set enable_seqscan to off;
+explain (costs off) select * from pool where number <@ '0146[2-5]';
+select count(*) from pool where number <@ '0146[2-5]';
+select count(*) from pool where number <@ '0146';
+select count(*) from pool where number <@ '';
+
+explain (costs off) select * from pool where number <@ any(array['0146[2-5]', '0147']::prefix_range[]);
+select count(*) from pool where number <@ any(array['0146[2-5]', '0147']::prefix_range[]);
+reset enable_seqscan;
+
+select count(*) from pool where number <@ '0146[2-5]';
+select count(*) from pool where number <@ '0146';
@@ -0,0 +1,33 @@
+create table istats(prefix prefix_range);
+insert into istats values ('0146'), ('01'), (''), ('33[1-2]'), ('0147');
+create index istats_idx on istats using gist(prefix);
+
+select level, pages, tuples, avg_tuples, avg_prefix_length, empty_ratio, overlap_ratio
+  from prefix_index_stats('istats_idx');
+select blkno, level, leaf, tuples, avg_prefix_length, empty, overlapping
+  from prefix_index_pages('istats_idx');
+
+create index istats_btree on istats(prefix);
+select * from prefix_index_stats('istats_btree');
+
+insert into istats
+     select trim(to_char(i, '00000'))
+       from generate_series(1, 20000) as i;
+reindex index istats_idx;
+
+with s as (select * from prefix_index_stats('istats_idx'))
+select count(*) >= 2 as levels,
+       (select pages from s where level = 1) as root_pages,
+       (select tuples from s order by level desc limit 1) as leaf_tuples,
+       (select overlap_ratio from s order by level desc limit 1) is null as leaf_overlap,
+       sum(pages) = pg_relation_size('istats_idx') / current_setting('block_size')::int as all_pages
+  from s;
+
+select level, count(*) as pages, sum(tuples) as tuples
+  from prefix_index_pages('istats_idx')
+group by level
+except
+select level, pages, tuples
+  from prefix_index_stats('istats_idx');
+
+drop table istats;
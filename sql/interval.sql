@@ -0,0 +1,17 @@
+select * from prefix_ranges_from_interval('0146200000', '0146499999');
+select * from prefix_ranges_from_interval('0146250000', '0146499999');
+select * from prefix_ranges_from_interval('0146200017', '0146200123');
+select * from prefix_ranges_from_interval('0100000000', '0199999999');
+select * from prefix_ranges_from_interval('0146250000', '0146250000');
+select * from prefix_ranges_from_interval('0000000000', '9999999999');
+
+select (select count(*) from numbers
+         where number between '0146250000' and '0147499999')
+     = (select count(*) from numbers n
+         where exists (select 1
+                         from prefix_ranges_from_interval('0146250000', '0147499999') p
+                        where p @> n.number)) as same;
+
+select * from prefix_ranges_from_interval('0146', '01');
+select * from prefix_ranges_from_interval('0147', '0146');
+select * from prefix_ranges_from_interval('01a6', '0147');
@@ -0,0 +1,41 @@
+select * from prefix_lookup('idx_prefix', '0146640123')
+         as t(prefix prefix_range, name text, shortname text, state char);
+select * from prefix_lookup('idx_prefix', '0100091234')
+         as t(prefix prefix_range, name text, shortname text, state char);
+select * from prefix_lookup('idx_prefix', '2222')
+         as t(prefix prefix_range, name text, shortname text, state char);
+
+create table lpm(prefix prefix_range, hop int);
+insert into lpm values ('0', 1), ('01', 2), ('0146[4-7]', 3), ('02', 4);
+create index lpm_prefix on lpm using gist(prefix gist_prefix_range_ops);
+
+begin;
+select * from prefix_lookup('lpm_prefix', '0146512345') as t(prefix prefix_range, hop int);
+select * from prefix_lookup('lpm_prefix', '0146812345') as t(prefix prefix_range, hop int);
+select * from prefix_lookup('lpm_prefix', '0299') as t(prefix prefix_range, hop int);
+select n.number, t.hop
+  from (values ('0146412345'), ('0155'), ('0')) as n(number),
+       lateral prefix_lookup('lpm_prefix', n.number) as t(prefix prefix_range, hop int)
+order by n.number;
+select * from prefix_lookup('idx_prefix', '0146640123')
+         as t(prefix prefix_range, name text, shortname text, state char);
+commit;
+
+select * from prefix_lookup('numbers_pkey', '0146') as t(number text);
+select * from prefix_lookup('lpm_prefix', '0146') as t(prefix prefix_range, hop text);
+
+create role regress_prefix_lookup;
+set role regress_prefix_lookup;
+select * from prefix_lookup('lpm_prefix', '0146512345') as t(prefix prefix_range, hop int);
+reset role;
+grant select on lpm to regress_prefix_lookup;
+alter table lpm enable row level security;
+set role regress_prefix_lookup;
+select * from prefix_lookup('lpm_prefix', '0146512345') as t(prefix prefix_range, hop int);
+reset role;
+alter table lpm disable row level security;
+set role regress_prefix_lookup;
+select * from prefix_lookup('lpm_prefix', '0146512345') as t(prefix prefix_range, hop int);
+reset role;
+revoke select on lpm from regress_prefix_lookup;
+drop role regress_prefix_lookup;
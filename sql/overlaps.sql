@@ -0,0 +1,11 @@
+create table ov(prefix prefix_range);
+insert into ov values ('0146'), ('0146[2-5]'), ('0146[4-7]'), ('01463'),
+                      ('0146[2-5]'), ('02'), ('0146[2-3]'), ('01'), (null);
+
+select * from prefix_overlaps_report('ov');
+select * from prefix_overlaps_report('ov', 'prefix', true);
+
+select count(*) from prefix_overlaps_report('ranges');
+
+create table ov_bad(prefix text);
+select * from prefix_overlaps_report('ov_bad');
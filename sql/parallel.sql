@@ -0,0 +1,30 @@
+select proname, proparallel
+  from pg_proc
+ where proname in ('prefix_range_contains', 'prefix_range_compact', 'range_union_agg',
+                   'prefix_lookup', 'prefix_overlaps_report', 'prefix_table_sync')
+ order by proname;
+
+create table compact_serial as select prefix_range_compact(prefix) as compact from ranges;
+
+set max_parallel_workers_per_gather = 2;
+set parallel_setup_cost = 0;
+set parallel_tuple_cost = 0;
+set min_parallel_table_scan_size = 0;
+
+explain (costs off) select range_union_agg(prefix) from ranges;
+select range_union_agg(prefix) from ranges;
+
+explain (costs off) select prefix_range_compact(prefix) from ranges;
+select compact = (select prefix_range_compact(prefix) from ranges) from compact_serial;
+
+set enable_indexscan to off;
+set enable_bitmapscan to off;
+explain (costs off) select count(*) from ranges where prefix @> '0146640123';
+select count(*) from ranges where prefix @> '0146640123';
+reset enable_indexscan;
+reset enable_bitmapscan;
+
+reset max_parallel_workers_per_gather;
+reset parallel_setup_cost;
+reset parallel_tuple_cost;
+reset min_parallel_table_scan_size;
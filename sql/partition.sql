@@ -0,0 +1,43 @@
+select prefix_key('0146[2-5]'::prefix_range, 2) as two,
+       prefix_key('0146[2-5]'::prefix_range, 6) as six,
+       prefix_key('0146640123'::prefix_range, 0) as zero;
+select prefix_key('0146', -1);
+
+create table ranges_by_cc(prefix prefix_range, name text)
+  partition by list (prefix_key(prefix, 2));
+create table ranges_by_cc_short partition of ranges_by_cc
+  for values in ('', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9');
+create table ranges_by_cc_01 partition of ranges_by_cc for values in ('01');
+create table ranges_by_cc_36 partition of ranges_by_cc for values in ('36');
+create table ranges_by_cc_other partition of ranges_by_cc default;
+insert into ranges_by_cc select prefix, name from ranges;
+
+create function scanned(query text) returns setof text language plpgsql as $$
+declare
+  line text;
+begin
+  for line in execute 'explain (costs off) ' || query
+  loop
+    if line ~ 'Scan on '
+    then
+      return next substring(line from 'Scan on (\S+)');
+    elsif line ~ 'Subplans Removed'
+    then
+      return next trim(line);
+    end if;
+  end loop;
+end;
+$$;
+
+select scanned('select * from ranges_by_cc where prefix @> ''0146640123''');
+select scanned('select * from ranges_by_cc where ''3612345678'' <@ prefix');
+select scanned('select * from ranges_by_cc where prefix @> ''0912345678''::prefix_range');
+select prefix, name from ranges_by_cc where prefix @> '0146640123';
+
+prepare q(text) as select prefix, name from ranges_by_cc where prefix @> $1;
+set plan_cache_mode to force_generic_plan;
+select scanned('execute q(''0146640123'')');
+select scanned('execute q(''3612345678'')');
+execute q('3612345678');
+reset plan_cache_mode;
+deallocate q;
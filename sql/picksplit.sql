@@ -0,0 +1,41 @@
+select strategy, nleft, nright, round(balance::numeric, 2) as balance,
+       union_left, union_right, left_length, right_length,
+       overlap, shared, misplaced
+  from prefix_picksplit_stats(array['0146', '0147', '33', '3312', '0148', '334',
+                                    '01', '3315', '0149', '33[1-2]', '01467',
+                                    '335']::prefix_range[]);
+
+select strategy, nleft, nright, union_left, union_right, overlap, misplaced
+  from prefix_picksplit_stats(array['0146', null, '33', '0147']::prefix_range[]);
+
+select * from prefix_picksplit_stats(array['0146', null]::prefix_range[]);
+
+create table split(prefix prefix_range);
+insert into split
+     select trim(to_char(i, '00000'))
+       from generate_series(1, 20000) as i;
+
+create index split_presort on split using gist(prefix gist_prefix_range_presort_ops);
+create index split_jordan on split using gist(prefix gist_prefix_range_jordan_ops);
+
+set enable_seqscan to off;
+
+drop index split_jordan;
+select count(*) from split where prefix <@ '1';
+select count(*) from split where prefix <@ '155';
+select count(*) from split where prefix @> '123456';
+select count(*) from split where prefix @> '123456'::text;
+select count(*) from split where prefix && '0[1-2]';
+select count(*) from split where prefix = '01234';
+
+create index split_jordan on split using gist(prefix gist_prefix_range_jordan_ops);
+drop index split_presort;
+select count(*) from split where prefix <@ '1';
+select count(*) from split where prefix <@ '155';
+select count(*) from split where prefix @> '123456';
+select count(*) from split where prefix @> '123456'::text;
+select count(*) from split where prefix && '0[1-2]';
+select count(*) from split where prefix = '01234';
+
+reset enable_seqscan;
+drop table split;
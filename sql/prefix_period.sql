@@ -0,0 +1,55 @@
+set datestyle to ISO;
+set timezone to 'UTC';
+
+select '0146[2-5]@[2024-01-01,2025-01-01)'::prefix_period;
+select '0146@[2024-01-01,infinity)'::prefix_period;
+select '0146@[2025-01-01,2024-01-01)'::prefix_period;
+select '0146@[2024-01-01,2024-01-01)'::prefix_period;
+select '0146[2-5]'::prefix_period;
+
+select prefix(p), lower(p), upper(p)
+  from (select '0146[2-5]@[2024-01-01,2025-01-01)'::prefix_period as p) as t;
+
+select prefix_period('0146640123', '2024-06-01');
+select prefix_period('0146640123', 'infinity');
+
+select p, '0146@[2024-01-01,2025-01-01)'::prefix_period @> p as contains
+  from (values (prefix_period('0146640123', '2024-06-01')),
+               (prefix_period('0146640123', '2025-01-01')),
+               (prefix_period('0147640123', '2024-06-01')),
+               ('01462@[2024-02-01,2024-03-01)'::prefix_period),
+               ('01462@[2024-02-01,2025-03-01)'::prefix_period)) as t(p);
+
+select p, '0146@[2024-01-01,2025-01-01)'::prefix_period && p as overlaps
+  from (values ('01@[2024-12-01,2025-02-01)'::prefix_period),
+               ('01@[2025-01-01,2025-02-01)'::prefix_period),
+               (prefix_period('0146640123', '2024-12-31 23:59:59.999999')),
+               (prefix_period('0146640123', '2025-01-01')),
+               ('0147@[2024-06-01,2024-07-01)'::prefix_period)) as t(p);
+
+create table rates(period prefix_period, rate numeric);
+insert into rates
+     select prefix_period(prefix, '2024-01-01', '2025-01-01'), 0.01
+       from ranges;
+insert into rates
+     select prefix_period(prefix, '2025-01-01', 'infinity'), 0.02
+       from ranges
+      where prefix <@ '014';
+insert into rates values ('01466@[2024-06-01,2024-09-01)', 0.05);
+create index on rates using gist(period);
+
+set enable_seqscan to off;
+set enable_bitmapscan to off;
+explain (costs off)
+ select * from rates where period @> prefix_period('0146640123', '2024-06-01');
+
+select * from rates where period @> prefix_period('0146640123', '2024-06-01')
+ order by length(prefix(period)) desc limit 1;
+select * from rates where period @> prefix_period('0146640123', '2024-10-01')
+ order by length(prefix(period)) desc limit 1;
+select * from rates where period @> prefix_period('0146640123', '2026-10-01')
+ order by length(prefix(period)) desc limit 1;
+select * from rates where period @> prefix_period('0146640123', '2023-10-01');
+select count(*) from rates where period && '0146@[2024-12-31,2025-01-02)';
+reset enable_bitmapscan;
+reset enable_seqscan;
@@ -0,0 +1,35 @@
+select '{0146, 0147[2-5], 01472, 01480}'::prefix_set;
+select '{01460,01461,01462,01463,01464,01465,01466,01467,01468,01469,0147[0-4],0147[5-9]}'::prefix_set;
+select '{}'::prefix_set;
+select '{0146,}'::prefix_set;
+
+select number, '{0146,0147[2-5],01480}'::prefix_set @> number
+  from (values ('0146640123'), ('0147312345'), ('0147612345'),
+               ('0148'), ('01480'), ('0148012')) as t(number);
+
+select pr, '{0146,0147[2-5],01480}'::prefix_set && pr::prefix_range
+  from (values ('01'), ('0146123'), ('0147[6-9]'), ('0147[4-7]'),
+               ('0148[0-1]'), ('0149'), ('')) as t(pr);
+
+select a | b as a_or_b, a & b as a_and_b, a - b as a_minus_b, b - a as b_minus_a
+  from (select '{0146,0147[2-5],01480}'::prefix_set as a,
+               '{01465,0147,0149}'::prefix_set as b) as t;
+
+select '{0146}'::prefix_set - '{0146#}'::prefix_set;
+
+select prefix_ranges('{0146,0147[2-5],01480}'::prefix_set);
+select prefix_set(array['0146', '01460', '0147']::prefix_range[]);
+
+create table customers(id int, allowed prefix_set);
+insert into customers values (1, '{0146,0147[2-5],01480}'), (2, '{01465,0147,0149}'),
+                             (3, '{01}'), (4, '{}'), (5, '{02[3-5]}');
+create index on customers using gin(allowed);
+
+set enable_seqscan to off;
+explain (costs off) select id from customers where allowed && '0147[6-9]';
+
+select id from customers where allowed && '0147[6-9]' order by id;
+select id from customers where allowed && '014' order by id;
+select id from customers where allowed && '024' order by id;
+select id from customers where allowed && '' order by id;
+reset enable_seqscan;
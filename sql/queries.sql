@@ -30,6 +30,17 @@ select a, b, a | b as union, a & b as intersect
                        ('123', '[2-3]')) as t(a, b)
         ) as x;
 
+-- set operations, both ways
+select a, b, a | b as union, b | a as "b | a", (a | b) = a as "a | b = a",
+       a & b as intersect, b & a as "b & a", a && b as "&&"
+  from  (select a::prefix_range, b::prefix_range
+           from (values('123', '123[4-5]'),
+                       ('123[4-5]', '123[7-8]'),
+                       ('12[3-4]', '1256'),
+                       ('12', '125'),
+                       ('[2-3]', '123')) as t(a, b)
+        ) as x;
+
 -- casting to and from text
 select prefix_range('123');
 select prefix_range('123[4-5]');
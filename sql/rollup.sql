@@ -0,0 +1,23 @@
+create table rollup_cdr(number text, duration numeric);
+insert into rollup_cdr values ('0146640123', 60), ('0146640124', 30.5), ('0146123456', 10),
+                              ('0147000000', null), ('0212345678', 5), (null, 100);
+
+select r.* from unnest((select prefix_rollup(number, duration, 4) from rollup_cdr)) r;
+select r.* from unnest((select prefix_rollup(number, duration, 0) from rollup_cdr)) r;
+
+set max_parallel_workers_per_gather = 2;
+set parallel_setup_cost = 0;
+set parallel_tuple_cost = 0;
+set min_parallel_table_scan_size = 0;
+
+select count(*)
+  from unnest((select prefix_rollup(number, 1, 5) from numbers)) r
+ where r.count <> (select count(*) from numbers where number like r.prefix::text || '%')
+    or r.sum <> r.count;
+
+reset max_parallel_workers_per_gather;
+reset parallel_setup_cost;
+reset parallel_tuple_cost;
+reset min_parallel_table_scan_size;
+
+select r.* from unnest((select prefix_rollup(number, duration, -1) from rollup_cdr)) r;
@@ -0,0 +1,39 @@
+create table routes(prefix prefix_range, hop int8);
+insert into routes values ('', 0), ('0', 1), ('01', 2), ('0146[4-7]', 3), ('01465', 4), ('02', 5);
+
+create table snapshots as
+  select 'routes'::text as name, prefix_snapshot_agg(prefix, hop) as image
+    from routes;
+
+select name, encode(substr(image, 1, 4), 'escape') as magic, length(image)
+  from snapshots;
+
+select n, prefix_snapshot_lookup(image, n)
+  from snapshots,
+       (values ('0146512345'), ('01465'), ('0146812345'), ('0299'), ('3'), ('')) as t(n)
+order by n;
+
+select prefix_snapshot_lookup(prefix_snapshot_agg(prefix, hop), '0146')
+  from routes where hop > 10;
+
+select count(*)
+  from numbers n,
+       (select prefix_snapshot_agg(prefix, length(prefix)) as image from ranges) s
+ where prefix_snapshot_lookup(s.image, n.number)
+       is distinct from (select max(length(prefix)) from ranges r where r.prefix @> n.number);
+
+-- toasted images are detoasted once per query, check that changing the
+-- image in between calls is noticed
+create table big_snapshots as
+  select h.hop, prefix_snapshot_agg(r.prefix, length(r.prefix) + h.hop) as image
+    from ranges r, (values (0), (100)) as h(hop)
+group by h.hop;
+
+select count(*)
+  from numbers n, big_snapshots s
+ where prefix_snapshot_lookup(s.image, n.number)
+       is distinct from (select max(length(prefix)) + s.hop
+                           from ranges r where r.prefix @> n.number);
+
+select prefix_snapshot_lookup('\x00'::bytea, '0146');
+select prefix_snapshot_lookup(substr(image, 1, 100), '0146') from snapshots;
@@ -0,0 +1,19 @@
+create table rt(prefix prefix_range, hop int, name text);
+create index rt_prefix on rt using gist(prefix);
+insert into rt values ('0146', 1, 'a'), ('0146[2-5]', 2, 'b'), ('0147', 3, 'c'),
+                      ('02', 4, null), ('03', 5, 'e');
+
+create table rt_staging (like rt);
+insert into rt_staging values ('0146', 1, 'a'), ('0146[2-5]', 2, 'B'), ('0147', 3, 'c'),
+                              ('02', 4, null), ('04', 6, 'f'), ('0148', 7, 'g');
+
+select * from prefix_table_sync('rt', 'rt_staging');
+select * from rt order by prefix::text collate "C";
+select * from prefix_table_sync('rt', 'rt_staging');
+
+truncate rt_staging;
+select * from prefix_table_sync('rt', 'rt_staging');
+select count(*) from rt;
+
+create table rt_bad(prefix prefix_range, hop text);
+select * from prefix_table_sync('rt', 'rt_bad');
@@ -0,0 +1,44 @@
+create table cdr as select number from numbers;
+create index cdr_number_pattern on cdr(number text_pattern_ops);
+vacuum analyze cdr;
+
+set enable_seqscan to off;
+set enable_bitmapscan to off;
+explain (costs off) select number from cdr where number <@ '0146[2-5]';
+select count(*) from cdr where number <@ '0146[2-5]';
+select count(*) from cdr where '0146[2-5]' @> number;
+select count(*) from cdr where number <@ '0146';
+reset enable_bitmapscan;
+reset enable_seqscan;
+
+set enable_indexscan to off;
+set enable_indexonlyscan to off;
+set enable_bitmapscan to off;
+select count(*) from cdr where number <@ '0146[2-5]';
+select count(*) from cdr where number <@ '0146';
+reset enable_bitmapscan;
+reset enable_indexonlyscan;
+reset enable_indexscan;
+
+-- numbers written as ranges sort after the digits, invalid ones match
+-- nothing: same rows with and without the index
+insert into cdr values ('0146[2-3]'), ('014[6-6]'), ('0146[7-8]'), ('0146]');
+
+set enable_seqscan to off;
+set enable_bitmapscan to off;
+explain (costs off) select number from cdr where number <@ '0146';
+select count(*) from cdr where number <@ '0146[2-5]';
+select count(*) from cdr where number <@ '0146';
+select number from cdr where number <@ '0146' and number ~ '[^0-9]' order by number collate "C";
+reset enable_bitmapscan;
+reset enable_seqscan;
+
+set enable_indexscan to off;
+set enable_indexonlyscan to off;
+set enable_bitmapscan to off;
+select count(*) from cdr where number <@ '0146[2-5]';
+select count(*) from cdr where number <@ '0146';
+select number from cdr where number <@ '0146' and number ~ '[^0-9]' order by number collate "C";
+reset enable_bitmapscan;
+reset enable_indexonlyscan;
+reset enable_indexscan;
@@ -0,0 +1,30 @@
+load 'prefix';
+set prefix.enable_trie_join to on;
+
+explain (costs off) select * from numbers n join ranges r on r.prefix @> n.number;
+
+select count(*) from numbers n join ranges r on r.prefix @> n.number;
+select count(*) from numbers n left join ranges r on r.prefix @> n.number;
+
+set prefix.enable_trie_join to off;
+select count(*) from numbers n join ranges r on r.prefix @> n.number;
+select count(*) from numbers n left join ranges r on r.prefix @> n.number;
+reset prefix.enable_trie_join;
+
+create table tj_ranges(prefix prefix_range, name text);
+insert into tj_ranges values ('0', 'zero'), ('01', 'one'), ('014', 'fourteen'),
+                             ('0146[4-7]', 'range'), ('02', 'two');
+create table tj_numbers(number text);
+insert into tj_numbers values ('0146512345'), ('0140000000'), ('0299'), ('0399'), ('12');
+
+select n.number, r.prefix, r.name
+  from tj_numbers n join tj_ranges r on r.prefix @> n.number
+order by n.number, length(r.prefix);
+
+select n.number, r.prefix
+  from tj_numbers n left join tj_ranges r on n.number <@ r.prefix
+order by n.number, length(r.prefix);
+
+select distinct on (n.number) n.number, r.prefix, r.name
+  from tj_numbers n join tj_ranges r on r.prefix @> n.number
+order by n.number, length(r.prefix) desc;